@@ -0,0 +1,38 @@
+#include "async.h"
+#include "lu.h"
+
+namespace {
+
+size_t all_threads() {
+    return ThreadPool::instance().concurrency();
+}
+
+}
+
+AsyncMatrix sum_async(const AsyncMatrix &a, const AsyncMatrix &b) {
+    return when_ready([](const Matrix &x, const Matrix &y) { return x.fast_sum_with(y, all_threads()); }, a, b);
+}
+
+AsyncMatrix subtract_async(const AsyncMatrix &a, const AsyncMatrix &b) {
+    return when_ready([](const Matrix &x, const Matrix &y) { return x.fast_subtract_with(y, all_threads()); }, a, b);
+}
+
+AsyncMatrix multiply_async(const AsyncMatrix &a, const AsyncMatrix &b) {
+    return when_ready([](const Matrix &x, const Matrix &y) { return x.fast_multiply_with(y, all_threads()); }, a, b);
+}
+
+MatrixFuture<double> det_async(const AsyncMatrix &a) {
+    return when_ready([](const Matrix &x) {
+        const size_t threads = CostModel::instance().threads_for(
+                WorkEstimate::lu(x.getRows(), LUDecomposition::kBlock), all_threads());
+        return LUDecomposition(x, threads).det();
+    }, a);
+}
+
+AsyncMatrix solve_async(const AsyncMatrix &a, const AsyncMatrix &b) {
+    return when_ready([](const Matrix &x, const Matrix &y) { return solve(x, y); }, a, b);
+}
+
+AsyncMatrix inverse_async(const AsyncMatrix &a) {
+    return when_ready([](const Matrix &x) { return x.inverse(); }, a);
+}
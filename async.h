@@ -0,0 +1,188 @@
+#pragma once
+
+#include "matrix.h"
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Non-blocking Matrix operations. Every *_async call returns at once with a MatrixFuture; the
+// operation becomes a node of a task graph whose edges are its operands, and it is pushed to the
+// ThreadPool the moment its last operand is ready - no thread blocks in between. Independent
+// nodes (A * B and C + D) therefore overlap, and a chain ((A * B) + C).det() runs each step as
+// soon as the previous one finishes, without a join of the whole pool between them. Inside a
+// node the operation still splits its own work with the usual fast_* partitioning.
+//
+// An exception thrown by a node is stored in its future and passed on to every node depending
+// on it, which then does not run; get() rethrows it.
+template<typename T>
+class MatrixFuture;
+
+namespace detail {
+
+template<typename T>
+struct AsyncState {
+    std::mutex mutex;
+    std::atomic<bool> ready{false};
+    std::optional<T> value;
+    std::exception_ptr error;
+    std::vector<std::function<void()>> continuations;
+
+    // Runs `continuation` once the state is ready: now if it already is, else from complete().
+    void on_ready(std::function<void()> continuation) {
+        {
+            std::lock_guard lock(mutex);
+            if (!ready.load()) {
+                continuations.push_back(std::move(continuation));
+                return;
+            }
+        }
+        continuation();
+    }
+
+    template<typename F>
+    void complete(F &&produce) {
+        std::optional<T> result;
+        std::exception_ptr failure;
+        try {
+            result.emplace(produce());
+        } catch (...) {
+            failure = std::current_exception();
+        }
+        std::vector<std::function<void()>> pending;
+        {
+            std::lock_guard lock(mutex);
+            value = std::move(result);
+            error = failure;
+            ready = true;
+            pending.swap(continuations);
+        }
+        for (auto &continuation: pending) continuation();
+    }
+};
+
+template<typename T>
+struct unwrap_future {
+    using type = T;
+};
+
+template<typename T>
+struct unwrap_future<MatrixFuture<T>> {
+    using type = T;
+};
+
+}
+
+template<typename T>
+class MatrixFuture final {
+public:
+    using value_type = T;
+
+    // An already completed future; lets plain values be passed wherever a future is expected.
+    MatrixFuture(T value) : m_state(std::make_shared<detail::AsyncState<T>>()) {
+        m_state->complete([&] { return std::move(value); });
+    }
+
+    [[nodiscard]] bool ready() const { return m_state->ready.load(); }
+
+    // Waits for the value, running queued pool tasks meanwhile (so it is safe inside a task).
+    // Rethrows the exception of the node or of the operand that failed first.
+    const T &get() const {
+        ThreadPool &pool = ThreadPool::instance();
+        while (!ready()) {
+            if (!pool.run_pending_task()) std::this_thread::yield();
+        }
+        if (m_state->error) std::rethrow_exception(m_state->error);
+        return *m_state->value;
+    }
+
+    // A node computing f(value) once this future is ready.
+    template<typename F>
+    auto then(F &&f) const {
+        return when_ready(std::forward<F>(f), *this);
+    }
+
+    // The graph node behind every async operation: f(values...) is pushed to the pool as soon as
+    // every dependency is ready. f may return a plain value or another MatrixFuture.
+    template<typename F, typename... Deps>
+    friend auto when_ready(F &&f, const MatrixFuture<Deps> &...deps)
+            -> MatrixFuture<typename detail::unwrap_future<std::invoke_result_t<F, const Deps &...>>::type>;
+
+private:
+    std::shared_ptr<detail::AsyncState<T>> m_state;
+
+    MatrixFuture() : m_state(std::make_shared<detail::AsyncState<T>>()) {}
+
+    template<typename U>
+    friend class MatrixFuture;
+};
+
+template<typename F, typename... Deps>
+auto when_ready(F &&f, const MatrixFuture<Deps> &...deps)
+        -> MatrixFuture<typename detail::unwrap_future<std::invoke_result_t<F, const Deps &...>>::type> {
+    using Produced = std::invoke_result_t<F, const Deps &...>;
+    using R = typename detail::unwrap_future<Produced>::type;
+    MatrixFuture<R> result;
+    auto state = result.m_state;
+    auto inputs = std::make_tuple(deps.m_state...);
+    auto remaining = std::make_shared<std::atomic<size_t>>(sizeof...(Deps) + 1);
+
+    auto launch = [state, inputs, remaining, f = std::forward<F>(f)]() mutable {
+        if (remaining->fetch_sub(1) != 1) return;
+        (void) ThreadPool::instance().submit([state, inputs, f = std::move(f)]() mutable {
+            std::exception_ptr failure;
+            std::apply([&](const auto &...input) { ((failure = failure ? failure : input->error), ...); }, inputs);
+            if (failure) {
+                state->complete([&]() -> R { std::rethrow_exception(failure); });
+                return;
+            }
+            if constexpr (std::is_same_v<Produced, MatrixFuture<R>>) {
+                // f returned a future: forward its value once it is ready, still without blocking.
+                std::optional<MatrixFuture<R>> inner;
+                try {
+                    inner.emplace(std::apply([&](const auto &...input) { return f(*input->value...); }, inputs));
+                } catch (...) {
+                    state->complete([failure = std::current_exception()]() -> R { std::rethrow_exception(failure); });
+                    return;
+                }
+                auto inner_state = inner->m_state;
+                inner_state->on_ready([state, inner_state] {
+                    state->complete([&]() -> R {
+                        if (inner_state->error) std::rethrow_exception(inner_state->error);
+                        return *inner_state->value;
+                    });
+                });
+            } else {
+                state->complete([&] { return std::apply([&](const auto &...input) { return f(*input->value...); }, inputs); });
+            }
+        });
+    };
+    // One count per dependency plus one for this call, so the node cannot start half-registered.
+    auto shared_launch = std::make_shared<decltype(launch)>(std::move(launch));
+    std::apply([&](const auto &...input) { (input->on_ready([shared_launch] { (*shared_launch)(); }), ...); }, inputs);
+    (*shared_launch)();
+    return result;
+}
+
+using AsyncMatrix = MatrixFuture<Matrix>;
+
+// Operands are taken by future; a Matrix converts into a ready one (by copy, or std::move it in).
+// Threads inside each node come from the cost model, as for the fast_* paths.
+[[nodiscard]] AsyncMatrix sum_async(const AsyncMatrix &a, const AsyncMatrix &b);
+
+[[nodiscard]] AsyncMatrix subtract_async(const AsyncMatrix &a, const AsyncMatrix &b);
+
+[[nodiscard]] AsyncMatrix multiply_async(const AsyncMatrix &a, const AsyncMatrix &b);
+
+[[nodiscard]] MatrixFuture<double> det_async(const AsyncMatrix &a);
+
+// solve(A, B) and A.inverse(); singular matrices surface as SingularMatrixError from get().
+[[nodiscard]] AsyncMatrix solve_async(const AsyncMatrix &a, const AsyncMatrix &b);
+
+[[nodiscard]] AsyncMatrix inverse_async(const AsyncMatrix &a);
@@ -0,0 +1,411 @@
+#pragma once
+
+#include "calculator_manager.h"
+#include "gemm.h"
+#include "matrix.h"
+#include <algorithm>
+#include <atomic>
+#include <complex>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+// Dense matrix of float, double, std::complex<double> or int64_t elements, stored like Matrix
+// (MatrixStorage<T>: aligned rows, padded stride) and computed with the same pool and row-interval
+// partitioning. Matrix stays the double workhorse with expressions, LU and friends; BasicMatrix
+// covers the other element types:
+//  - float halves the memory traffic and doubles the elements per SIMD register,
+//  - std::complex<double> gets complex arithmetic and a complex determinant,
+//  - int64_t has an exact determinant (fraction-free Bareiss elimination, std::overflow_error if
+//    an intermediate minor leaves the int64_t range).
+// The double instantiation routes to the SIMD table and the packed gemm; the other types use loops
+// written for the compiler's auto-vectorizer. Shape mismatches return an empty matrix.
+template<typename T>
+concept MatrixElement = std::same_as<T, float> || std::same_as<T, double> ||
+                        std::same_as<T, std::complex<double>> || std::same_as<T, int64_t>;
+
+template<MatrixElement T>
+class BasicMatrix;
+
+// CalculationManager for any element type: the rows are split with make_row_intervals and every
+// interval is computed by one pool task.
+template<MatrixElement T>
+class BasicCalculationManager final {
+public:
+    BasicCalculationManager(const BasicMatrix<T> &m1, const BasicMatrix<T> &m2, size_t count_of_threads)
+            : m_count_of_threads(count_of_threads), m1(m1), m2(m2) {}
+
+    // The result must already have the right shape.
+    void sum(BasicMatrix<T> &result);
+
+    void subtract(BasicMatrix<T> &result);
+
+    void multiply(BasicMatrix<T> &result);
+
+private:
+    size_t m_count_of_threads;
+    const BasicMatrix<T> &m1;
+    const BasicMatrix<T> &m2;
+
+    template<typename F>
+    void calculate(F &&sub);
+};
+
+template<MatrixElement T>
+class BasicMatrix final {
+public:
+    using value_type = T;
+
+    BasicMatrix() = default;
+
+    BasicMatrix(size_t nRows, size_t nCols, T value = T{}) : m_matrix(nRows, nCols) {
+        if (value != T{}) fill(value);
+    }
+
+    // Element-wise conversion from the double Matrix.
+    explicit BasicMatrix(const Matrix &mat) : m_matrix(mat.getRows(), mat.getCols()) {
+        for (size_t i = 0; i < getRows(); i++) {
+            for (size_t j = 0; j < getCols(); j++) {
+                m_matrix(i, j) = static_cast<T>(mat.at(i, j));
+            }
+        }
+    }
+
+    template<MatrixElement U>
+    requires (!std::same_as<U, T> && requires(U u) { static_cast<T>(u); })
+    explicit BasicMatrix(const BasicMatrix<U> &other) : m_matrix(other.getRows(), other.getCols()) {
+        for (size_t i = 0; i < getRows(); i++) {
+            for (size_t j = 0; j < getCols(); j++) {
+                m_matrix(i, j) = static_cast<T>(other.at(i, j));
+            }
+        }
+    }
+
+    static BasicMatrix createDiagonal(size_t rank, T value) {
+        BasicMatrix diagonal(rank, rank);
+        for (size_t i = 0; i < rank; i++) {
+            diagonal.at(i, i) = value;
+        }
+        return diagonal;
+    }
+
+    [[nodiscard]] Matrix to_matrix() const requires std::is_arithmetic_v<T> {
+        Matrix mat(getRows(), getCols());
+        for (size_t i = 0; i < getRows(); i++) {
+            for (size_t j = 0; j < getCols(); j++) {
+                mat.at(i, j) = static_cast<double>(m_matrix(i, j));
+            }
+        }
+        return mat;
+    }
+
+    void multithreadingOn() { m_multithread = true; }
+
+    void multithreadingOff() { m_multithread = false; }
+
+    [[nodiscard]] size_t getRows() const { return m_matrix.rows(); }
+
+    [[nodiscard]] size_t getCols() const { return m_matrix.cols(); }
+
+    T &at(size_t i, size_t j) { return m_matrix(i, j); }
+
+    [[nodiscard]] const T &at(size_t i, size_t j) const { return m_matrix(i, j); }
+
+    T *data() { return m_matrix.data(); }
+
+    [[nodiscard]] const T *data() const { return m_matrix.data(); }
+
+    [[nodiscard]] size_t stride() const { return m_matrix.stride(); }
+
+    RowView<T> row(size_t i) { return m_matrix.row_view(i); }
+
+    [[nodiscard]] RowView<const T> row(size_t i) const { return m_matrix.row_view(i); }
+
+    void fill(T value) {
+        for (size_t i = 0; i < getRows(); i++) {
+            std::fill_n(m_matrix.row(i), getCols(), value);
+        }
+    }
+
+    bool operator==(const BasicMatrix &another) const {
+        if (getRows() != another.getRows() || getCols() != another.getCols()) return false;
+        for (size_t i = 0; i < getRows(); i++) {
+            if (!std::equal(m_matrix.row(i), m_matrix.row(i) + getCols(), another.m_matrix.row(i))) return false;
+        }
+        return true;
+    }
+
+    bool operator!=(const BasicMatrix &another) const { return !(*this == another); }
+
+    // Serial unless multithreading is on, then the cost model picks the thread count.
+    friend BasicMatrix operator+(const BasicMatrix &a, const BasicMatrix &b) {
+        return a.fast_sum_with(b, a.default_threads());
+    }
+
+    friend BasicMatrix operator-(const BasicMatrix &a, const BasicMatrix &b) {
+        return a.fast_subtract_with(b, a.default_threads());
+    }
+
+    friend BasicMatrix operator*(const BasicMatrix &a, const BasicMatrix &b) {
+        return a.fast_multiply_with(b, a.default_threads());
+    }
+
+    [[nodiscard]] BasicMatrix fast_sum_with(const BasicMatrix &another, size_t num_of_threads) const {
+        BasicMatrix result;
+        sum_into(another, result, num_of_threads);
+        return result;
+    }
+
+    [[nodiscard]] BasicMatrix fast_subtract_with(const BasicMatrix &another, size_t num_of_threads) const {
+        BasicMatrix result;
+        subtract_into(another, result, num_of_threads);
+        return result;
+    }
+
+    [[nodiscard]] BasicMatrix fast_multiply_with(const BasicMatrix &another, size_t num_of_threads) const {
+        BasicMatrix result;
+        multiply_into(another, result, num_of_threads);
+        return result;
+    }
+
+    void sum_into(const BasicMatrix &another, BasicMatrix &out, size_t num_of_threads) const {
+        if (!elementwise_shape(another, out)) return;
+        BasicCalculationManager<T>(*this, another, elementwise_threads(num_of_threads)).sum(out);
+    }
+
+    void subtract_into(const BasicMatrix &another, BasicMatrix &out, size_t num_of_threads) const {
+        if (!elementwise_shape(another, out)) return;
+        BasicCalculationManager<T>(*this, another, elementwise_threads(num_of_threads)).subtract(out);
+    }
+
+    void multiply_into(const BasicMatrix &another, BasicMatrix &out, size_t num_of_threads) const {
+        if (getCols() != another.getRows()) {
+            out = BasicMatrix();
+            return;
+        }
+        if (&out == this || &out == &another) {
+            BasicMatrix result;
+            multiply_into(another, result, num_of_threads);
+            out = std::move(result);
+            return;
+        }
+        out.reshape(getRows(), another.getCols());
+        out.fill(T{});
+        const size_t threads = CostModel::instance().threads_for(
+                WorkEstimate::multiply(getRows(), another.getCols(), getCols()), std::max<size_t>(num_of_threads, 1));
+        BasicCalculationManager<T>(*this, another, threads).multiply(out);
+    }
+
+    // Gaussian elimination with partial pivoting; Bareiss for int64_t. Throws std::invalid_argument
+    // for a non-square matrix.
+    [[nodiscard]] T det() const {
+        return fast_det(m_multithread ? ThreadPool::instance().concurrency() : 1);
+    }
+
+    [[nodiscard]] T fast_det(size_t num_of_threads) const;
+
+private:
+    bool m_multithread = false;
+
+    MatrixStorage<T> m_matrix;
+
+    [[nodiscard]] size_t default_threads() const {
+        return m_multithread ? ThreadPool::instance().concurrency() : 1;
+    }
+
+    void reshape(size_t nRows, size_t nCols) {
+        if (getRows() != nRows || getCols() != nCols) {
+            m_matrix = MatrixStorage<T>(nRows, nCols, m_matrix.resource());
+        }
+    }
+
+    bool elementwise_shape(const BasicMatrix &another, BasicMatrix &out) const {
+        if (getRows() != another.getRows() || getCols() != another.getCols()) {
+            out = BasicMatrix();
+            return false;
+        }
+        out.reshape(getRows(), getCols());
+        return true;
+    }
+
+    [[nodiscard]] size_t elementwise_threads(size_t num_of_threads) const {
+        WorkEstimate work = WorkEstimate::elementwise(getRows(), getCols());
+        work.bytes = work.bytes / sizeof(double) * sizeof(T);
+        return CostModel::instance().threads_for(work, std::max<size_t>(num_of_threads, 1));
+    }
+
+    friend class BasicCalculationManager<T>;
+};
+
+using FloatMatrix = BasicMatrix<float>;
+using ComplexMatrix = BasicMatrix<std::complex<double>>;
+using IntMatrix = BasicMatrix<int64_t>;
+
+namespace detail {
+
+template<typename T>
+void add_rows(const T *a, const T *b, T *out, size_t n) {
+    if constexpr (std::is_same_v<T, double>) {
+        simd().add(a, b, out, n);
+    } else {
+        for (size_t j = 0; j < n; j++) out[j] = a[j] + b[j];
+    }
+}
+
+template<typename T>
+void sub_rows(const T *a, const T *b, T *out, size_t n) {
+    if constexpr (std::is_same_v<T, double>) {
+        simd().sub(a, b, out, n);
+    } else {
+        for (size_t j = 0; j < n; j++) out[j] = a[j] - b[j];
+    }
+}
+
+// y += alpha * x.
+template<typename T>
+void axpy_row(T alpha, const T *x, T *y, size_t n) {
+    if constexpr (std::is_same_v<T, double>) {
+        simd().axpy(alpha, x, y, n);
+    } else {
+        for (size_t j = 0; j < n; j++) y[j] += alpha * x[j];
+    }
+}
+
+template<typename T>
+double magnitude(const T &value) {
+    return static_cast<double>(std::abs(value));
+}
+
+}
+
+template<MatrixElement T>
+template<typename F>
+void BasicCalculationManager<T>::calculate(F &&sub) {
+    const auto intervals = make_row_intervals(m1.getRows(), m_count_of_threads);
+    ThreadPool::instance().parallel_for(intervals.size(), [&](size_t i) {
+        sub(intervals[i].first, intervals[i].second);
+    });
+}
+
+template<MatrixElement T>
+void BasicCalculationManager<T>::sum(BasicMatrix<T> &result) {
+    calculate([&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            detail::add_rows(m1.m_matrix.row(i), m2.m_matrix.row(i), result.m_matrix.row(i), m1.getCols());
+        }
+    });
+}
+
+template<MatrixElement T>
+void BasicCalculationManager<T>::subtract(BasicMatrix<T> &result) {
+    calculate([&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            detail::sub_rows(m1.m_matrix.row(i), m2.m_matrix.row(i), result.m_matrix.row(i), m1.getCols());
+        }
+    });
+}
+
+template<MatrixElement T>
+void BasicCalculationManager<T>::multiply(BasicMatrix<T> &result) {
+    const size_t inner = m1.getCols();
+    const size_t n = m2.getCols();
+    calculate([&](size_t begin, size_t end) {
+        if constexpr (std::is_same_v<T, double>) {
+            gemm(end - begin, n, inner, 1.0, m1.m_matrix.row(begin), m1.stride(), m2.data(), m2.stride(),
+                 result.m_matrix.row(begin), result.stride());
+        } else {
+            // i-k-j order: the inner loop streams a row of B into a row of C.
+            for (size_t i = begin; i < end; i++) {
+                T *c_row = result.m_matrix.row(i);
+                const T *a_row = m1.m_matrix.row(i);
+                for (size_t k = 0; k < inner; k++) {
+                    detail::axpy_row(a_row[k], m2.m_matrix.row(k), c_row, n);
+                }
+            }
+        }
+    });
+}
+
+template<MatrixElement T>
+T BasicMatrix<T>::fast_det(size_t num_of_threads) const {
+    const size_t n = getRows();
+    if (n != getCols()) {
+        throw std::invalid_argument("BasicMatrix::det: matrix must be square");
+    }
+    if (n == 0) return T{1};
+    MatrixStorage<T> work(m_matrix);
+    const size_t threads = CostModel::instance().threads_for(WorkEstimate::determinant(n),
+                                                             std::max<size_t>(num_of_threads, 1));
+    ThreadPool &pool = ThreadPool::instance();
+    bool negative = false;
+
+    if constexpr (std::is_same_v<T, int64_t>) {
+        // Bareiss: after step k every entry is a (k+1)x(k+1) minor, so all divisions are exact.
+        std::atomic<bool> overflow{false};
+        int64_t previous = 1;
+        for (size_t k = 0; k + 1 < n; k++) {
+            if (work(k, k) == 0) {
+                size_t r = k + 1;
+                while (r < n && work(r, k) == 0) r++;
+                if (r == n) return 0;
+                work.swap_rows(k, r);
+                negative = !negative;
+            }
+            const int64_t pivot = work(k, k);
+            pool.parallel_ranges(k + 1, n, threads, 64, [&](size_t from, size_t to) {
+                for (size_t i = from; i < to; i++) {
+                    const int64_t factor = work(i, k);
+                    for (size_t j = k + 1; j < n; j++) {
+                        // Each product fits in __int128, but their difference need not (both near 2^126).
+                        __int128 kept, removed, difference;
+                        if (__builtin_mul_overflow(static_cast<__int128>(work(i, j)), pivot, &kept) ||
+                            __builtin_mul_overflow(static_cast<__int128>(factor), work(k, j), &removed) ||
+                            __builtin_sub_overflow(kept, removed, &difference)) {
+                            overflow = true;
+                            continue;
+                        }
+                        const __int128 value = difference / previous;
+                        if (value > std::numeric_limits<int64_t>::max() || value < std::numeric_limits<int64_t>::min()) {
+                            overflow = true;
+                            continue;
+                        }
+                        work(i, j) = static_cast<int64_t>(value);
+                    }
+                    work(i, k) = 0;
+                }
+            });
+            if (overflow) throw std::overflow_error("BasicMatrix<int64_t>::det: intermediate minor overflows int64_t");
+            previous = pivot;
+        }
+        const int64_t last = work(n - 1, n - 1);
+        if (!negative) return last;
+        if (last == std::numeric_limits<int64_t>::min()) {
+            throw std::overflow_error("BasicMatrix<int64_t>::det: determinant overflows int64_t");
+        }
+        return -last;
+    } else {
+        T det{1};
+        for (size_t k = 0; k < n; k++) {
+            size_t best = k;
+            for (size_t r = k + 1; r < n; r++) {
+                if (detail::magnitude(work(r, k)) > detail::magnitude(work(best, k))) best = r;
+            }
+            if (work(best, k) == T{}) return T{};
+            if (best != k) {
+                work.swap_rows(k, best);
+                negative = !negative;
+            }
+            const T pivot = work(k, k);
+            det *= pivot;
+            pool.parallel_ranges(k + 1, n, threads, 64, [&](size_t from, size_t to) {
+                for (size_t i = from; i < to; i++) {
+                    const T factor = work(i, k) / pivot;
+                    detail::axpy_row(-factor, work.row(k) + k + 1, work.row(i) + k + 1, n - k - 1);
+                }
+            });
+        }
+        return negative ? -det : det;
+    }
+}
@@ -0,0 +1,215 @@
+#include "batch.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+size_t lane_groups(size_t count) {
+    return (count + kBatchLanes - 1) / kBatchLanes;
+}
+
+bool interleavable(std::span<const Matrix> matrices) {
+    if (matrices.empty()) return false;
+    const size_t rows = matrices.front().getRows();
+    const size_t cols = matrices.front().getCols();
+    if (rows > kInterleaveMaxSize || cols > kInterleaveMaxSize) return false;
+    return std::all_of(matrices.begin(), matrices.end(), [&](const Matrix &m) {
+        return m.getRows() == rows && m.getCols() == cols;
+    });
+}
+
+// Runs body(begin, end) over [0, units) with as many pool tasks as `work` is worth.
+template<typename F>
+void run_batch(size_t units, WorkEstimate work, size_t num_of_threads, F &&body) {
+    work.syncs = 1;
+    work.max_parallelism = units;
+    const size_t threads = CostModel::instance().threads_for(work, std::max<size_t>(num_of_threads, 1));
+    ThreadPool::instance().parallel_ranges(0, units, threads, 1, body);
+}
+
+// Lanes [count, kBatchLanes) of a partial group hold identity matrices and are never unpacked.
+void pack(std::span<const Matrix> group, double *packed) {
+    const size_t rows = group.front().getRows();
+    const size_t cols = group.front().getCols();
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < cols; j++) {
+            double *lanes = packed + (i * cols + j) * kBatchLanes;
+            for (size_t l = 0; l < kBatchLanes; l++) {
+                lanes[l] = l < group.size() ? group[l].at(i, j) : (i == j ? 1.0 : 0.0);
+            }
+        }
+    }
+}
+
+// Matrix::fast_det on kBatchLanes interleaved n x n matrices at once: the pivot search and row
+// swap are per lane, the elimination of each row runs across the lanes.
+void interleaved_det(double *a, size_t n, double *det) {
+    std::array<double, kBatchLanes> sign, mul, pivot;
+    std::array<bool, kBatchLanes> singular{};
+    sign.fill(1);
+    auto at = [&](size_t i, size_t j) { return a + (i * n + j) * kBatchLanes; };
+    for (size_t k = 0; k + 1 < n; k++) {
+        for (size_t l = 0; l < kBatchLanes; l++) {
+            size_t best = k;
+            for (size_t r = k + 1; r < n; r++) {
+                if (std::abs(at(r, k)[l]) > std::abs(at(best, k)[l])) best = r;
+            }
+            if (std::abs(at(best, k)[l]) < std::numeric_limits<double>::epsilon()) singular[l] = true;
+            if (best != k && !singular[l]) {
+                sign[l] = -sign[l];
+                for (size_t j = k; j < n; j++) std::swap(at(k, j)[l], at(best, j)[l]);
+            }
+            // A singular lane keeps eliminating with a harmless pivot; its result is 0 anyway.
+            pivot[l] = singular[l] ? 1.0 : at(k, k)[l];
+        }
+        for (size_t i = k + 1; i < n; i++) {
+            for (size_t l = 0; l < kBatchLanes; l++) mul[l] = -at(i, k)[l] / pivot[l];
+            for (size_t j = k + 1; j < n; j++) {
+                double *row = at(i, j);
+                const double *pivot_row = at(k, j);
+                for (size_t l = 0; l < kBatchLanes; l++) row[l] += mul[l] * pivot_row[l];
+            }
+        }
+    }
+    for (size_t l = 0; l < kBatchLanes; l++) det[l] = sign[l];
+    for (size_t i = 0; i < n; i++) {
+        for (size_t l = 0; l < kBatchLanes; l++) det[l] *= at(i, i)[l];
+    }
+    for (size_t l = 0; l < kBatchLanes; l++) {
+        if (singular[l]) det[l] = 0;
+    }
+}
+
+// c = a * b for kBatchLanes interleaved (m x k) * (k x n) products, i-k-j order across the lanes.
+void interleaved_multiply(const double *a, const double *b, double *c, size_t m, size_t k, size_t n) {
+    std::fill_n(c, m * n * kBatchLanes, 0.0);
+    for (size_t i = 0; i < m; i++) {
+        for (size_t p = 0; p < k; p++) {
+            const double *aip = a + (i * k + p) * kBatchLanes;
+            for (size_t j = 0; j < n; j++) {
+                const double *bpj = b + (p * n + j) * kBatchLanes;
+                double *cij = c + (i * n + j) * kBatchLanes;
+                for (size_t l = 0; l < kBatchLanes; l++) cij[l] += aip[l] * bpj[l];
+            }
+        }
+    }
+}
+
+void check_lengths(std::span<const Matrix> a, std::span<const Matrix> b) {
+    if (a.size() != b.size()) {
+        throw std::invalid_argument("batch: operand spans differ in length");
+    }
+}
+
+}
+
+std::vector<double> batch_det(std::span<const Matrix> matrices, size_t num_of_threads) {
+    double flops = 0;
+    for (const Matrix &m: matrices) {
+        if (m.getRows() != m.getCols()) {
+            throw std::invalid_argument("batch_det: matrix is not square");
+        }
+        flops += WorkEstimate::determinant(m.getRows()).flops;
+    }
+    std::vector<double> dets(matrices.size(), 1.0);
+    if (matrices.empty()) return dets;
+    WorkEstimate work;
+    work.flops = flops;
+    work.bytes = 0;
+    for (const Matrix &m: matrices) work.bytes += 2 * sizeof(double) * static_cast<double>(m.getRows() * m.getCols());
+
+    if (interleavable(matrices)) {
+        const size_t n = matrices.front().getRows();
+        if (n == 0) return dets;
+        run_batch(lane_groups(matrices.size()), work, num_of_threads, [&](size_t begin, size_t end) {
+            std::vector<double> packed(n * n * kBatchLanes);
+            std::array<double, kBatchLanes> det{};
+            for (size_t g = begin; g < end; g++) {
+                const auto group = matrices.subspan(g * kBatchLanes,
+                                                    std::min(kBatchLanes, matrices.size() - g * kBatchLanes));
+                pack(group, packed.data());
+                interleaved_det(packed.data(), n, det.data());
+                std::copy_n(det.begin(), group.size(), dets.begin() + static_cast<ptrdiff_t>(g * kBatchLanes));
+            }
+        });
+    } else {
+        run_batch(matrices.size(), work, num_of_threads, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                if (matrices[i].getRows() != 0) dets[i] = matrices[i].fast_det(matrices[i], 1);
+            }
+        });
+    }
+    return dets;
+}
+
+std::vector<Matrix> batch_multiply(std::span<const Matrix> a, std::span<const Matrix> b, size_t num_of_threads) {
+    check_lengths(a, b);
+    std::vector<Matrix> results(a.size());
+    WorkEstimate work;
+    work.flops = 0;
+    work.bytes = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].getCols() != b[i].getRows()) continue;
+        results[i] = Matrix(a[i].getRows(), b[i].getCols());
+        const WorkEstimate one = WorkEstimate::multiply(a[i].getRows(), b[i].getCols(), a[i].getCols());
+        work.flops += one.flops;
+        work.bytes += one.bytes;
+    }
+    if (a.empty()) return results;
+
+    if (interleavable(a) && interleavable(b) && a.front().getCols() == b.front().getRows()) {
+        const size_t m = a.front().getRows();
+        const size_t k = a.front().getCols();
+        const size_t n = b.front().getCols();
+        run_batch(lane_groups(a.size()), work, num_of_threads, [&](size_t begin, size_t end) {
+            std::vector<double> packed_a(m * k * kBatchLanes), packed_b(k * n * kBatchLanes);
+            std::vector<double> packed_c(m * n * kBatchLanes);
+            for (size_t g = begin; g < end; g++) {
+                const size_t first = g * kBatchLanes;
+                const size_t count = std::min(kBatchLanes, a.size() - first);
+                pack(a.subspan(first, count), packed_a.data());
+                pack(b.subspan(first, count), packed_b.data());
+                interleaved_multiply(packed_a.data(), packed_b.data(), packed_c.data(), m, k, n);
+                for (size_t l = 0; l < count; l++) {
+                    Matrix &c = results[first + l];
+                    for (size_t i = 0; i < m; i++) {
+                        for (size_t j = 0; j < n; j++) c.at(i, j) = packed_c[(i * n + j) * kBatchLanes + l];
+                    }
+                }
+            }
+        });
+    } else {
+        run_batch(a.size(), work, num_of_threads, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                if (a[i].getCols() == b[i].getRows()) a[i].multiply_into(b[i], results[i], 1);
+            }
+        });
+    }
+    return results;
+}
+
+std::vector<Matrix> batch_add(std::span<const Matrix> a, std::span<const Matrix> b, size_t num_of_threads) {
+    check_lengths(a, b);
+    std::vector<Matrix> results(a.size());
+    WorkEstimate work;
+    work.flops = 0;
+    work.bytes = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].getRows() != b[i].getRows() || a[i].getCols() != b[i].getCols()) continue;
+        results[i] = Matrix(a[i].getRows(), a[i].getCols());
+        const WorkEstimate one = WorkEstimate::elementwise(a[i].getRows(), a[i].getCols());
+        work.flops += one.flops;
+        work.bytes += one.bytes;
+    }
+    run_batch(a.size(), work, num_of_threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (results[i].getRows() == a[i].getRows() && results[i].getCols() == a[i].getCols()) {
+                a[i].sum_into(b[i], results[i], 1);
+            }
+        }
+    });
+    return results;
+}
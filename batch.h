@@ -0,0 +1,35 @@
+#pragma once
+
+#include "matrix.h"
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Many independent small problems at once. The fast_* paths split the rows of one matrix, which
+// cannot pay for its synchronization below a few hundred rows; these functions instead give each
+// pool task a range of whole problems, so a batch of thousands of 6x6 determinants scales with
+// the cores. The cost model picks the number of tasks from the total work of the batch.
+//
+// Batches whose matrices all have the same shape and at most kInterleaveMaxSize rows and columns
+// are packed kBatchLanes at a time into an interleaved layout (element (i, j) of the lanes
+// contiguous), so the elimination and multiplication loops run across matrices and vectorize
+// even for 3x3. Other batches are processed matrix by matrix with the serial kernels.
+//
+// Results are allocated on the calling thread, from its matrix_memory_resource().
+inline constexpr size_t kBatchLanes = 8;
+
+inline constexpr size_t kInterleaveMaxSize = 16;
+
+// Determinants with the pivoting and singularity rule of Matrix::fast_det.
+// Throws std::invalid_argument if a matrix is not square.
+[[nodiscard]] std::vector<double> batch_det(std::span<const Matrix> matrices,
+                                            size_t num_of_threads = ThreadPool::instance().concurrency());
+
+// a[i] * b[i]; a pair with mismatched shapes gives an empty matrix, like fast_multiply_with.
+// Throws std::invalid_argument if the spans differ in length.
+[[nodiscard]] std::vector<Matrix> batch_multiply(std::span<const Matrix> a, std::span<const Matrix> b,
+                                                 size_t num_of_threads = ThreadPool::instance().concurrency());
+
+// a[i] + b[i]; rows are already contiguous, so this only spreads the pairs across the pool.
+[[nodiscard]] std::vector<Matrix> batch_add(std::span<const Matrix> a, std::span<const Matrix> b,
+                                            size_t num_of_threads = ThreadPool::instance().concurrency());
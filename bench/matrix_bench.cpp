@@ -0,0 +1,313 @@
+#include "../matrix.h"
+#include "../lu.h"
+#include "../cholesky.h"
+#include "../fixed_matrix.h"
+#include "../batch.h"
+#include "../strassen.h"
+#include "../vector.h"
+#include <benchmark/benchmark.h>
+#include <cstdint>
+
+// Every benchmark takes the thread count as its last argument: 0 leaves the choice to the cost
+// model (default constraints), n > 0 forces n pool tasks like the old results.txt tables did.
+// Throughput is reported as FLOP/s ("flops" counter) and bytes/s, both over wall-clock time.
+//
+//     ./multithread_matrix_bench --benchmark_out=bench.json --benchmark_out_format=json
+//
+// writes a JSON report that can be compared between releases, e.g. with Google Benchmark's
+// tools/compare.py; the bench_json target does the same into the build directory.
+
+namespace {
+
+const std::vector<int64_t> kThreads = {0, 1, 2, 4, 8};
+
+// Well-conditioned input: unit diagonal plus small deterministic off-diagonal values.
+Matrix input(size_t rows, size_t cols, size_t seed) {
+    Matrix m(rows, cols);
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < cols; j++) {
+            const double value = static_cast<double>((i * 7 + j * 13 + seed) % 17) / 17.0;
+            m.at(i, j) = i == j ? 1.0 + value : value / static_cast<double>(std::max(rows, cols));
+        }
+    }
+    return m;
+}
+
+// Forces `threads` pool tasks on m, or keeps the cost model in charge for 0.
+size_t use_threads(Matrix &m, int64_t threads) {
+    m.multithreadingOn();
+    if (threads == 0) return ThreadPool::instance().concurrency();
+    m.setContraints({1, 1, 1});
+    return static_cast<size_t>(threads);
+}
+
+void report(benchmark::State &state, double flops, double bytes) {
+    state.counters["flops"] = benchmark::Counter(flops, benchmark::Counter::kIsIterationInvariantRate);
+    state.SetBytesProcessed(static_cast<int64_t>(bytes) * state.iterations());
+}
+
+template<bool Subtract>
+void BM_Elementwise(benchmark::State &state) {
+    const auto n = static_cast<size_t>(state.range(0));
+    Matrix a = input(n, n, 1);
+    Matrix b = input(n, n, 2);
+    Matrix out(n, n);
+    const size_t threads = use_threads(a, state.range(1));
+    for (auto _: state) {
+        if constexpr (Subtract) {
+            a.subtract_into(b, out, threads);
+        } else {
+            a.sum_into(b, out, threads);
+        }
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    const double elements = static_cast<double>(n * n);
+    report(state, elements, 3 * sizeof(double) * elements);
+}
+
+void BM_Sum(benchmark::State &state) {
+    BM_Elementwise<false>(state);
+}
+
+void BM_Subtract(benchmark::State &state) {
+    BM_Elementwise<true>(state);
+}
+
+void multiply(benchmark::State &state, size_t m, size_t k, size_t n, int64_t threads_arg) {
+    Matrix a = input(m, k, 1);
+    Matrix b = input(k, n, 2);
+    Matrix out(m, n);
+    const size_t threads = use_threads(a, threads_arg);
+    for (auto _: state) {
+        a.multiply_into(b, out, threads);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    const double dm = static_cast<double>(m), dk = static_cast<double>(k), dn = static_cast<double>(n);
+    report(state, 2 * dm * dk * dn, sizeof(double) * (dm * dk + dk * dn + dm * dn));
+}
+
+void BM_Multiply(benchmark::State &state) {
+    const auto n = static_cast<size_t>(state.range(0));
+    multiply(state, n, n, n, state.range(1));
+}
+
+void BM_MultiplyRect(benchmark::State &state) {
+    multiply(state, static_cast<size_t>(state.range(0)), static_cast<size_t>(state.range(1)),
+             static_cast<size_t>(state.range(2)), state.range(3));
+}
+
+void BM_Det(benchmark::State &state) {
+    const auto n = static_cast<size_t>(state.range(0));
+    Matrix a = input(n, n, 3);
+    const size_t threads = use_threads(a, state.range(1));
+    for (auto _: state) {
+        benchmark::DoNotOptimize(a.fast_det(a, threads));
+    }
+    const double dn = static_cast<double>(n);
+    report(state, 2 * dn * dn * dn / 3, sizeof(double) * dn * dn);
+}
+
+void BM_LU(benchmark::State &state) {
+    const auto n = static_cast<size_t>(state.range(0));
+    Matrix a = input(n, n, 4);
+    const size_t threads = use_threads(a, state.range(1));
+    for (auto _: state) {
+        if (state.range(1) == 0) {
+            benchmark::DoNotOptimize(a.lu().det());
+        } else {
+            benchmark::DoNotOptimize(LUDecomposition(a, threads).det());
+        }
+    }
+    const double dn = static_cast<double>(n);
+    report(state, 2 * dn * dn * dn / 3, 2 * sizeof(double) * dn * dn);
+}
+
+// Compare with BM_LU: the same diagonally dominant input, mirrored to be symmetric (and so SPD).
+void BM_Cholesky(benchmark::State &state) {
+    const auto n = static_cast<size_t>(state.range(0));
+    Matrix a = input(n, n, 4);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < i; j++) a.at(j, i) = a.at(i, j);
+    }
+    const size_t threads = use_threads(a, state.range(1));
+    for (auto _: state) {
+        if (state.range(1) == 0) {
+            benchmark::DoNotOptimize(a.cholesky().log_det());
+        } else {
+            benchmark::DoNotOptimize(CholeskyDecomposition(a, threads).log_det());
+        }
+    }
+    const double dn = static_cast<double>(n);
+    report(state, dn * dn * dn / 3, sizeof(double) * dn * dn);
+}
+
+void BM_Solve(benchmark::State &state) {
+    const auto n = static_cast<size_t>(state.range(0));
+    const auto rhs = static_cast<size_t>(state.range(1));
+    Matrix a = input(n, n, 5);
+    const Matrix b = input(n, rhs, 6);
+    const size_t threads = use_threads(a, state.range(2));
+    const LUDecomposition lu = state.range(2) == 0 ? a.lu() : LUDecomposition(a, threads);
+    for (auto _: state) {
+        Matrix x = lu.solve(b);
+        benchmark::DoNotOptimize(x.data());
+    }
+    const double dn = static_cast<double>(n), dr = static_cast<double>(rhs);
+    report(state, 2 * dn * dn * dr, sizeof(double) * (dn * dn + 2 * dn * dr));
+}
+
+void BM_Transpose(benchmark::State &state) {
+    const auto n = static_cast<size_t>(state.range(0));
+    Matrix a = input(n, n, 1);
+    const size_t threads = use_threads(a, state.range(1));
+    for (auto _: state) {
+        a.transpose_inplace(threads);
+        benchmark::DoNotOptimize(a.data());
+        benchmark::ClobberMemory();
+    }
+    const double elements = static_cast<double>(n * n);
+    report(state, 0, 2 * sizeof(double) * elements);
+}
+
+// A^T * A for an n x n/4 A; the flops counter counts only the half that is computed.
+void BM_Gram(benchmark::State &state) {
+    const auto n = static_cast<size_t>(state.range(0));
+    const Matrix a = input(n, n / 4, 1);
+    const size_t threads = state.range(1) == 0 ? ThreadPool::instance().concurrency()
+                                               : static_cast<size_t>(state.range(1));
+    for (auto _: state) {
+        Matrix g = gram(a, true, threads);
+        benchmark::DoNotOptimize(g.data());
+    }
+    const double dn = static_cast<double>(n), dc = static_cast<double>(n / 4);
+    report(state, dc * dc * dn, sizeof(double) * (dn * dc + dc * dc));
+}
+
+template<bool Transposed>
+void BM_GemvKind(benchmark::State &state) {
+    const auto n = static_cast<size_t>(state.range(0));
+    const Matrix a = input(n, n, 1);
+    const Vector x(n, 0.5);
+    const size_t threads = state.range(1) == 0 ? ThreadPool::instance().concurrency()
+                                               : static_cast<size_t>(state.range(1));
+    if (state.range(1) != 0) CostModel::instance().set_thread_override(threads);
+    for (auto _: state) {
+        Vector y = Transposed ? gemv_transposed(a, x, threads) : gemv(a, x, threads);
+        benchmark::DoNotOptimize(y.data());
+    }
+    CostModel::instance().set_thread_override(0);
+    const double dn = static_cast<double>(n);
+    report(state, 2 * dn * dn, sizeof(double) * (dn * dn + 2 * dn));
+}
+
+void BM_Gemv(benchmark::State &state) {
+    BM_GemvKind<false>(state);
+}
+
+void BM_GemvTransposed(benchmark::State &state) {
+    BM_GemvKind<true>(state);
+}
+
+// Compare with BM_Multiply at the same n; threads 0 means every pool thread here.
+void BM_Strassen(benchmark::State &state) {
+    const auto n = static_cast<size_t>(state.range(0));
+    Matrix a = input(n, n, 1);
+    Matrix b = input(n, n, 2);
+    Matrix out(n, n);
+    const StrassenOptions options{
+            .cutoff = static_cast<size_t>(state.range(1)),
+            .num_of_threads = state.range(2) == 0 ? ThreadPool::instance().concurrency()
+                                                  : static_cast<size_t>(state.range(2))};
+    for (auto _: state) {
+        strassen_multiply_into(a, b, out, options);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    // Classical flop count, so the counter is comparable with BM_Multiply.
+    const double dn = static_cast<double>(n);
+    report(state, 2 * dn * dn * dn, 3 * sizeof(double) * dn * dn);
+}
+
+// 4096 independent n x n determinants; threads as above (n > 0 forces that many pool tasks).
+void BM_BatchDet(benchmark::State &state) {
+    const auto n = static_cast<size_t>(state.range(0));
+    std::vector<Matrix> batch;
+    for (size_t s = 0; s < 4096; s++) batch.push_back(input(n, n, s));
+    const size_t threads = state.range(1) == 0 ? ThreadPool::instance().concurrency()
+                                               : static_cast<size_t>(state.range(1));
+    if (state.range(1) != 0) CostModel::instance().set_thread_override(threads);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(batch_det(batch, threads).data());
+    }
+    CostModel::instance().set_thread_override(0);
+    const double dn = static_cast<double>(n);
+    report(state, 4096 * 2 * dn * dn * dn / 3, 4096 * sizeof(double) * dn * dn);
+}
+
+// Small fixed-size matrices; compare with BM_Det/n:6 and BM_Multiply/n:16 for the dynamic path.
+template<size_t N>
+void BM_FixedDet(benchmark::State &state) {
+    const FixedSquareMatrix<N> a(input(N, N, 3));
+    for (auto _: state) {
+        benchmark::DoNotOptimize(a);
+        benchmark::DoNotOptimize(a.det());
+    }
+    report(state, 2.0 * N * N * N / 3, sizeof(double) * N * N);
+}
+
+template<size_t N>
+void BM_FixedMultiply(benchmark::State &state) {
+    const FixedSquareMatrix<N> a(input(N, N, 1));
+    const FixedSquareMatrix<N> b(input(N, N, 2));
+    for (auto _: state) {
+        benchmark::DoNotOptimize(a);
+        benchmark::DoNotOptimize(a * b);
+    }
+    report(state, 2.0 * N * N * N, 3 * sizeof(double) * N * N);
+}
+
+}
+
+BENCHMARK(BM_Sum)->ArgNames({"n", "threads"})->ArgsProduct({{64, 256, 1024, 2048}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Subtract)->ArgNames({"n", "threads"})->ArgsProduct({{64, 256, 1024, 2048}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Multiply)->ArgNames({"n", "threads"})->ArgsProduct({{16, 64, 256, 512, 1024}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMillisecond);
+// Tall-skinny, short-wide and inner-product-heavy shapes.
+BENCHMARK(BM_MultiplyRect)->ArgNames({"m", "k", "n", "threads"})
+        ->ArgsProduct({{2000}, {32}, {2000}, kThreads})
+        ->ArgsProduct({{32}, {2000}, {32}, kThreads})
+        ->ArgsProduct({{4000}, {256}, {64}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Det)->ArgNames({"n", "threads"})->ArgsProduct({{6, 50, 200, 500}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LU)->ArgNames({"n", "threads"})->ArgsProduct({{64, 256, 512, 1024}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Cholesky)->ArgNames({"n", "threads"})->ArgsProduct({{64, 256, 512, 1024}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Solve)->ArgNames({"n", "rhs", "threads"})->ArgsProduct({{256, 1024}, {1, 64, 512}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Gemv)->ArgNames({"n", "threads"})->ArgsProduct({{256, 1024, 4096}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_GemvTransposed)->ArgNames({"n", "threads"})->ArgsProduct({{256, 1024, 4096}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Transpose)->ArgNames({"n", "threads"})->ArgsProduct({{256, 1024, 4096}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Gram)->ArgNames({"n", "threads"})->ArgsProduct({{1024, 4096}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Strassen)->ArgNames({"n", "cutoff", "threads"})->ArgsProduct({{1024, 2048}, {128, 256, 512}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BatchDet)->ArgNames({"n", "threads"})->ArgsProduct({{3, 6, 16, 50}, kThreads})
+        ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FixedDet<3>);
+BENCHMARK(BM_FixedDet<4>);
+BENCHMARK(BM_FixedDet<6>);
+BENCHMARK(BM_FixedDet<8>);
+BENCHMARK(BM_FixedMultiply<3>);
+BENCHMARK(BM_FixedMultiply<4>);
+BENCHMARK(BM_FixedMultiply<8>);
+
+BENCHMARK_MAIN();
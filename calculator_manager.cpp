@@ -1,4 +1,10 @@
 #include "calculator_manager.h"
+#include "gemm.h"
+#include "profiler.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
 
 CalculationManager::CalculationManager(const Matrix &_m1, const Matrix &_m2, size_t _count_of_threads)
         : count_of_threads(_count_of_threads), m1(_m1), m2(_m2) {}
@@ -8,43 +14,37 @@ CalculationManager::CalculationManager(const Matrix &_m1, size_t _count_of_threa
 
 
 void CalculationManager::sub_substr(std::pair<size_t, size_t> &interval, Matrix *result) {
-    for (size_t i = interval.first; i < interval.second; i++) {
-        for (size_t j = 0; j < result->getCols(); j++) {
-            result->m_matrix[i][j] = m1.m_matrix[i][j] - m2.m_matrix[i][j];
-        }
-    }
+    Matrix::evaluate_rows(m1 - m2, *result, interval.first, interval.second);
 }
 
 void CalculationManager::sub_sum(std::pair<size_t, size_t> &interval, Matrix *result) {
-    for (size_t i = interval.first; i < interval.second; i++) {
-        for (size_t j = 0; j < result->getCols(); j++) {
-            result->m_matrix[i][j] = m1.m_matrix[i][j] + m2.m_matrix[i][j];
-        }
-    }
+    Matrix::evaluate_rows(m1 + m2, *result, interval.first, interval.second);
 }
 
 void CalculationManager::sub_multi(std::pair<size_t, size_t> &interval, Matrix *result) {
-    for (size_t i = interval.first; i < interval.second; i++) {
-        for (size_t j = 0; j < result->getCols(); j++) {
-            for (size_t k = 0; k < result->getCols(); k++) {
-                result->m_matrix[i][j] += m1.m_matrix[i][k] * m2.m_matrix[k][j];
-            }
-        }
-    }
+    gemm(interval.second - interval.first, m2.getCols(), m1.getCols(), 1.0,
+         m1.m_matrix.row(interval.first), m1.stride(),
+         m2.data(), m2.stride(),
+         result->m_matrix.row(interval.first), result->stride());
 }
 
-std::vector<std::pair<size_t, size_t>> CalculationManager::make_intervals() const {
+std::vector<std::pair<size_t, size_t>> make_row_intervals(size_t rows, size_t count) {
+    count = std::max<size_t>(count, 1);
     std::vector<std::pair<size_t, size_t>> intervals;
-    size_t distance = m1.getRows() / count_of_threads;
+    size_t distance = rows / count;
     size_t current_row = 0;
-    for (size_t i = 0; i < count_of_threads; i++) {
+    for (size_t i = 0; i < count; i++) {
         intervals.emplace_back(current_row, current_row + distance);
         current_row += distance;
     }
-    intervals[count_of_threads - 1].second = m1.getRows();
+    intervals[count - 1].second = rows;
     return intervals;
 }
 
+std::vector<std::pair<size_t, size_t>> CalculationManager::make_intervals() const {
+    return make_row_intervals(m1.getRows(), count_of_threads);
+}
+
 std::vector<std::pair<size_t, size_t>> CalculationManager::make_intervals_for_det() const {
     std::vector<std::pair<size_t, size_t>> intervals;
     size_t distance = m1.getRows() / count_of_threads;
@@ -61,22 +61,19 @@ std::vector<std::pair<size_t, size_t>> CalculationManager::make_intervals_for_de
 
 
 Matrix CalculationManager::calculate(void (CalculationManager::*f)(std::pair<size_t, size_t> &, Matrix *)) {
-    Matrix result(m1.getRows(), m1.getCols());
-    auto intervals = make_intervals();
-    std::vector<std::future<void>> all_futures(intervals.size() - 1);
-    for (size_t i = 0; i < all_futures.size(); i++) {
-        std::packaged_task<void(std::pair<size_t, size_t> &, Matrix *)> temp_task(
-                [&](std::pair<size_t, size_t> &a, Matrix *b) { return (this->*f)(a, b); });
-        all_futures[i] = std::async(std::launch::async, std::move(temp_task), std::ref(intervals[i]), &result);
-    }
-    (this->*f)(intervals[intervals.size() - 1], &result);
-    for (size_t i = 0; i < intervals.size() - 1; i++) {
-        all_futures[i].get();
-    }
+    Matrix result(m1.getRows(), m2.getCols());
+    calculate(f, result);
     return result;
 
 }
 
+void CalculationManager::calculate(void (CalculationManager::*f)(std::pair<size_t, size_t> &, Matrix *),
+                                   Matrix &result) {
+    auto intervals = make_intervals();
+    MATRIX_PROFILE_SCOPE("calculate", WorkEstimate{}, intervals.size());
+    ThreadPool::instance().parallel_for(intervals.size(), [&](size_t i) { (this->*f)(intervals[i], &result); });
+}
+
 Matrix CalculationManager::multiply() {
     return calculate(&CalculationManager::sub_multi);
 }
@@ -89,12 +86,36 @@ Matrix CalculationManager::subtract() {
     return calculate(&CalculationManager::sub_substr);
 }
 
+void CalculationManager::multiply(Matrix &result) {
+    calculate(&CalculationManager::sub_multi, result);
+}
+
+void CalculationManager::sum(Matrix &result) {
+    calculate(&CalculationManager::sub_sum, result);
+}
+
+void CalculationManager::subtract(Matrix &result) {
+    calculate(&CalculationManager::sub_substr, result);
+}
+
 
 
 
 double Matrix::fast_det(const Matrix &mat, size_t num_of_threads) const{
+    // The working copy never escapes, so it is carved out of the thread's scratch arena.
+    ScratchScope scratch;
+    return fast_det(Matrix(mat), num_of_threads);
+}
+
+double Matrix::fast_det(Matrix &&mat, size_t num_of_threads) const{
+    const WorkEstimate work = WorkEstimate::determinant(mat.getRows());
+    num_of_threads = plan_threads(m_contraints.m_maxRowsDet, work, num_of_threads);
+    MATRIX_PROFILE_SCOPE("fast_det", work, num_of_threads);
+    if (num_of_threads > 1 && mat.getRows() > 2 && ThreadPool::instance().size() > 0) {
+        return pipelined_det(mat, num_of_threads);
+    }
     double det = 0;
-    Matrix _matrix(mat);
+    Matrix &_matrix = mat;
     auto sgn = 1;
     for(size_t i = 0; i < _matrix.getRows() - 1; ++i){
         const auto imax = _matrix.col_max(i);
@@ -107,22 +128,12 @@ double Matrix::fast_det(const Matrix &mat, size_t num_of_threads) const{
             _matrix.swap_rows(i, imax);
         }
 
-        std::vector<std::future<void>> threads;
         double n = static_cast<double>(_matrix.getRows() - i - 1) / static_cast<double>(num_of_threads);
-        for(size_t j = 0; j < num_of_threads; j++) {
+        ThreadPool::instance().parallel_for(num_of_threads, [&](size_t j) {
             size_t begin = std::floor(j * n + 1 + i);
-            size_t end = std::floor((j + 1) * n + 1 + i);
-
-            if(j < num_of_threads - 1) {
-                threads.push_back(std::async(triangulation, std::ref(_matrix), i, begin, end));
-            }
-            else{
-                triangulation(_matrix, i, begin, end);
-            }
-        }
-        for(auto& j: threads){
-            j.get();
-        }
+            size_t end = j + 1 == num_of_threads ? _matrix.getRows() : std::floor((j + 1) * n + 1 + i);
+            triangulation(_matrix, i, begin, end);
+        });
     }
     det = 1;
     for(size_t i = 0; i < _matrix.getRows(); ++i){
@@ -132,43 +143,217 @@ double Matrix::fast_det(const Matrix &mat, size_t num_of_threads) const{
     return det;
 }
 
+namespace {
+
+struct PivotCandidate {
+    double magnitude = -1;
+    size_t row = 0;
+};
+
+// Larger magnitude first, then the lower row, so every member picks the same pivot.
+bool better_pivot(const PivotCandidate &x, const PivotCandidate &y) {
+    return x.magnitude > y.magnitude || (x.magnitude == y.magnitude && x.row < y.row);
+}
+
+template<typename Ready>
+void spin_until(Ready ready) {
+    while (!ready()) std::this_thread::yield();
+}
+
+// Sign of the permutation step -> pivots[step].
+int permutation_sign(const std::vector<size_t> &pivots) {
+    std::vector<char> seen(pivots.size(), 0);
+    int sign = 1;
+    for (size_t start = 0; start < pivots.size(); start++) {
+        size_t length = 0;
+        for (size_t at = start; !seen[at]; at = pivots[at]) {
+            seen[at] = 1;
+            length++;
+        }
+        if (length > 0 && length % 2 == 0) sign = -sign;
+    }
+    return sign;
+}
+
+}
+
+// Elimination with logical pivoting: rows are never swapped, step k just retires the pivot row
+// pivots[k]. Member m of the team owns the rows i with i % team == m for the whole run. In step k
+// it first updates columns k and k + 1 of its rows and publishes its best candidate for the next
+// pivot, and only then the rest of the rows; the next step needs every member's candidate but
+// only the owner of the chosen pivot row to have finished, so the others run ahead instead of
+// joining after every column. The arithmetic per element is that of triangulation.
+double Matrix::pipelined_det(Matrix &mat, size_t num_of_threads) {
+    const size_t n = mat.getRows();
+    const size_t stride = mat.stride();
+    double *const data = mat.data();
+
+    // Members spin on each other, so only tasks already running may join: whoever starts
+    // before the team is sealed is in, later ones return at once. The caller is member 0.
+    constexpr size_t kSealed = static_cast<size_t>(1) << (8 * sizeof(size_t) - 1);
+    std::atomic<size_t> joined{1};
+    std::atomic<size_t> team_size{0};
+
+    std::vector<PivotCandidate> candidates(n * num_of_threads);
+    const auto published = std::make_unique<std::atomic<size_t>[]>(n);
+    const auto progress = std::make_unique<std::atomic<size_t>[]>(num_of_threads);
+    for (size_t k = 0; k < n; k++) published[k] = 0;
+    for (size_t m = 0; m < num_of_threads; m++) progress[m] = 0;
+    std::vector<size_t> pivots(n);
+    std::vector<char> retired(n, 0);
+    std::atomic<bool> singular{false};
+    const SimdKernels &kernels = simd();
+
+    auto member = [&](size_t m) {
+        const size_t team = team_size.load(std::memory_order_acquire);
+        std::vector<double> multipliers(n);
+        auto publish = [&](size_t column) {
+            PivotCandidate best;
+            for (size_t i = m; i < n; i += team) {
+                if (retired[i]) continue;
+                const PivotCandidate candidate{std::abs(data[i * stride + column]), i};
+                if (better_pivot(candidate, best)) best = candidate;
+            }
+            candidates[column * num_of_threads + m] = best;
+            published[column].fetch_add(1, std::memory_order_release);
+        };
+
+        publish(0);
+        for (size_t k = 0; k < n; k++) {
+            spin_until([&] { return published[k].load(std::memory_order_acquire) == team; });
+            PivotCandidate pivot;
+            for (size_t t = 0; t < team; t++) {
+                if (better_pivot(candidates[k * num_of_threads + t], pivot)) pivot = candidates[k * num_of_threads + t];
+            }
+            const size_t p = pivot.row;
+            if (m == 0) pivots[k] = p;
+            if (k + 1 == n) return;
+            if (pivot.magnitude < std::numeric_limits<double>::epsilon()) {
+                if (m == 0) singular = true;
+                return;
+            }
+            if (p % team == m) retired[p] = 1;
+            const size_t owner = p % team;
+            // Columns past k + 1 of the pivot row come from the owner's previous step.
+            spin_until([&] { return progress[owner].load(std::memory_order_acquire) >= k; });
+            const double *pivot_row = data + p * stride;
+            const double pivot_value = pivot_row[k];
+
+            for (size_t i = m; i < n; i += team) {
+                if (retired[i]) continue;
+                double *row = data + i * stride;
+                const double mul = -row[k] / pivot_value;
+                multipliers[i] = mul;
+                row[k] += mul * pivot_row[k];
+                row[k + 1] += mul * pivot_row[k + 1];
+            }
+            publish(k + 1);
+            if (k + 2 < n) {
+                for (size_t i = m; i < n; i += team) {
+                    if (retired[i]) continue;
+                    kernels.axpy(multipliers[i], pivot_row + k + 2, data + i * stride + k + 2, n - k - 2);
+                }
+            }
+            progress[m].store(k + 1, std::memory_order_release);
+        }
+    };
+
+    ThreadPool &pool = ThreadPool::instance();
+    std::vector<std::future<void>> helpers;
+    // A pool without workers would run a helper inline, spinning before the team exists.
+    const size_t helper_count = std::min(num_of_threads - 1, pool.size());
+    for (size_t h = 0; h < helper_count; h++) {
+        helpers.push_back(pool.submit([&] {
+            size_t id = joined.load();
+            do {
+                if (id >= kSealed) return;
+            } while (!joined.compare_exchange_weak(id, id + 1));
+            spin_until([&] { return team_size.load(std::memory_order_acquire) != 0; });
+            member(id);
+        }));
+    }
+    // Idle workers join within microseconds; busy ones are not waited for.
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(200);
+    spin_until([&] { return joined.load() == helper_count + 1 || std::chrono::steady_clock::now() > deadline; });
+    team_size.store(joined.exchange(kSealed), std::memory_order_release);
+    member(0);
+    for (auto &helper: helpers) pool.wait(helper);
+
+    if (singular) return 0;
+    double det = permutation_sign(pivots);
+    for (size_t k = 0; k < n; k++) {
+        det *= data[pivots[k] * stride + k];
+    }
+    return det;
+}
+
 Matrix Matrix::fast_subtract_with(const Matrix &another, size_t num_of_threads) const {
+    Matrix result;
+    subtract_into(another, result, num_of_threads);
+    return result;
+}
+
+Matrix Matrix::fast_sum_with(const Matrix &another, size_t num_of_threads) const {
+    Matrix result;
+    sum_into(another, result, num_of_threads);
+    return result;
+}
+
+Matrix Matrix::fast_multiply_with(const Matrix &another, size_t num_of_threads) const {
+    Matrix result;
+    multiply_into(another, result, num_of_threads);
+    return result;
+}
+
+void Matrix::subtract_into(const Matrix &another, Matrix &out, size_t num_of_threads) const {
     const size_t rows = getRows();
     const size_t cols = getCols();
     if (rows != another.getRows() || cols != another.getCols()) {
-        return {};
+        out = Matrix();
+        return;
     }
-    size_t threads_count = rows / m_contraints.m_maxRowsSum + 1;
-    if (threads_count == 1) return subtract_with(another);
-    if (threads_count > num_of_threads) threads_count = num_of_threads;
+    const WorkEstimate work = WorkEstimate::elementwise(rows, cols);
+    const size_t threads_count = plan_threads(m_contraints.m_maxRowsSum, work, num_of_threads);
+    MATRIX_PROFILE_SCOPE("subtract_into", work, threads_count);
+    out.reshape(rows, cols);
     CalculationManager subtractor(*this, another, threads_count);
-    return subtractor.subtract();
+    subtractor.subtract(out);
 }
 
-Matrix Matrix::fast_sum_with(const Matrix &another, size_t num_of_threads) const {
+void Matrix::sum_into(const Matrix &another, Matrix &out, size_t num_of_threads) const {
     const size_t rows = getRows();
     const size_t cols = getCols();
     if (rows != another.getRows() || cols != another.getCols()) {
-        return {};
+        out = Matrix();
+        return;
     }
-    size_t threads_count = rows / m_contraints.m_maxRowsSum + 1;
-    if (threads_count == 1) return sum_with(another);
-    if (threads_count > num_of_threads) threads_count = num_of_threads;
+    const WorkEstimate work = WorkEstimate::elementwise(rows, cols);
+    const size_t threads_count = plan_threads(m_contraints.m_maxRowsSum, work, num_of_threads);
+    MATRIX_PROFILE_SCOPE("sum_into", work, threads_count);
+    out.reshape(rows, cols);
     CalculationManager adder(*this, another, threads_count);
-    return adder.sum();
+    adder.sum(out);
 }
 
-Matrix Matrix::fast_multiply_with(const Matrix &another, size_t num_of_threads) const {
+void Matrix::multiply_into(const Matrix &another, Matrix &out, size_t num_of_threads) const {
     const size_t rows = getRows();
     const size_t cols = getCols();
     if (cols != another.getRows()) {
-        return {};
+        out = Matrix();
+        return;
     }
-    size_t threads_count = rows / m_contraints.m_maxRowsMult + 1;
-    if (threads_count == 1) return multiply_with(another);
-    if (threads_count > num_of_threads){
-        threads_count = num_of_threads;
+    if (&out == this || &out == &another) {
+        // gemm cannot write over its own operands.
+        Matrix result;
+        multiply_into(another, result, num_of_threads);
+        out = std::move(result);
+        return;
     }
+    const WorkEstimate work = WorkEstimate::multiply(rows, another.getCols(), cols);
+    const size_t threads_count = plan_threads(m_contraints.m_maxRowsMult, work, num_of_threads);
+    MATRIX_PROFILE_SCOPE("multiply_into", work, threads_count);
+    out.reshape(rows, another.getCols());
+    out.fill(0);
     CalculationManager multiplier(*this, another, threads_count);
-    return multiplier.multiply();
+    multiplier.multiply(out);
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include <deque>
 #include <cmath>
 
+// [0, rows) split into `count` consecutive intervals of rows / count rows; the last one takes the remainder.
+[[nodiscard]] std::vector<std::pair<size_t, size_t>> make_row_intervals(size_t rows, size_t count);
 
 class CalculationManager final{
 public:
@@ -19,6 +21,13 @@ public:
     Matrix multiply();
 
     Matrix subtract();
+
+    // Same operations written into a preallocated result of the right shape (zeroed for multiply).
+    void sum(Matrix &result);
+
+    void multiply(Matrix &result);
+
+    void subtract(Matrix &result);
 private:
     size_t count_of_threads;
     const Matrix &m1;
@@ -30,6 +39,8 @@ private:
 
     Matrix calculate(void (CalculationManager::* f)(std::pair<size_t, size_t> &, Matrix *));
 
+    void calculate(void (CalculationManager::* f)(std::pair<size_t, size_t> &, Matrix *), Matrix &result);
+
     void sub_sum(std::pair<size_t, size_t> &interval, Matrix *result);
 
     void sub_multi(std::pair<size_t, size_t> &interval, Matrix *result);
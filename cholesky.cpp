@@ -0,0 +1,331 @@
+#include "cholesky.h"
+#include "gemm.h"
+#include "lu.h"
+#include "simd_kernels.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+size_t packed_index(size_t i, size_t j) {
+    if (i < j) std::swap(i, j);
+    return i * (i + 1) / 2 + j;
+}
+
+// Right-hand sides per thread in CholeskyDecomposition::solve.
+constexpr size_t kSolveColumnChunk = 16;
+
+std::optional<CholeskyDecomposition> try_cholesky(const Matrix &a) {
+    if (!is_symmetric(a)) return std::nullopt;
+    CholeskyDecomposition factors = a.cholesky();
+    if (!factors.positive_definite()) return std::nullopt;
+    return factors;
+}
+
+}
+
+SymmetricMatrix::SymmetricMatrix(size_t n, double value) : m_order(n), m_packed(n * (n + 1) / 2, value) {}
+
+SymmetricMatrix::SymmetricMatrix(const Matrix &mat) : SymmetricMatrix(mat.getRows()) {
+    if (mat.getRows() != mat.getCols()) {
+        throw std::invalid_argument("SymmetricMatrix: matrix must be square");
+    }
+    for (size_t i = 0; i < m_order; i++) {
+        const double *row = mat.data() + i * mat.stride();
+        std::copy(row, row + i + 1, m_packed.begin() + static_cast<std::ptrdiff_t>(packed_index(i, 0)));
+    }
+}
+
+size_t SymmetricMatrix::order() const {
+    return m_order;
+}
+
+double &SymmetricMatrix::at(size_t i, size_t j) {
+    return m_packed[packed_index(i, j)];
+}
+
+const double &SymmetricMatrix::at(size_t i, size_t j) const {
+    return m_packed[packed_index(i, j)];
+}
+
+const double *SymmetricMatrix::row(size_t i) const {
+    return m_packed.data() + packed_index(i, 0);
+}
+
+Matrix SymmetricMatrix::to_matrix() const {
+    Matrix result(m_order, m_order);
+    for (size_t i = 0; i < m_order; i++) {
+        for (size_t j = 0; j <= i; j++) {
+            result.at(i, j) = result.at(j, i) = at(i, j);
+        }
+    }
+    return result;
+}
+
+bool SymmetricMatrix::operator==(const SymmetricMatrix &another) const {
+    return m_order == another.m_order && m_packed == another.m_packed;
+}
+
+bool is_symmetric(const Matrix &mat) {
+    const size_t n = mat.getRows();
+    if (n != mat.getCols()) return false;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (mat.at(i, j) != mat.at(j, i)) return false;
+        }
+    }
+    return true;
+}
+
+CholeskyDecomposition::CholeskyDecomposition(const Matrix &mat, size_t num_of_threads)
+        : CholeskyDecomposition(Matrix(mat), num_of_threads) {}
+
+CholeskyDecomposition::CholeskyDecomposition(Matrix &&mat, size_t num_of_threads)
+        : m_l(std::move(mat)), m_threads(std::max<size_t>(num_of_threads, 1)) {
+    factor();
+}
+
+CholeskyDecomposition::CholeskyDecomposition(const SymmetricMatrix &mat, size_t num_of_threads)
+        : m_l(mat.order(), mat.order()), m_threads(std::max<size_t>(num_of_threads, 1)) {
+    for (size_t i = 0; i < mat.order(); i++) {
+        std::copy(mat.row(i), mat.row(i) + i + 1, m_l.data() + i * m_l.stride());
+    }
+    factor();
+}
+
+void CholeskyDecomposition::factor() {
+    if (m_l.getRows() != m_l.getCols()) {
+        throw std::invalid_argument("CholeskyDecomposition: matrix must be square");
+    }
+    const size_t n = order();
+    // Column sums of |A| from the lower triangle, which stands for the upper one too.
+    std::vector<double> column_sums(n);
+    for (size_t i = 0; i < n; i++) {
+        const double *row = m_l.data() + i * m_l.stride();
+        for (size_t j = 0; j < i; j++) {
+            column_sums[j] += std::abs(row[j]);
+            column_sums[i] += std::abs(row[j]);
+        }
+        column_sums[i] += std::abs(row[i]);
+    }
+    m_norm1 = n == 0 ? 0 : *std::max_element(column_sums.begin(), column_sums.end());
+    for (size_t k0 = 0; k0 < n; k0 += kBlock) {
+        const size_t kb = std::min(kBlock, n - k0);
+        if (!factor_panel(k0, kb)) {
+            m_positive_definite = false;
+            return;
+        }
+        update_trailing(k0, kb);
+    }
+    for (size_t i = 0; i < n; i++) {
+        double *row = m_l.data() + i * m_l.stride();
+        std::fill(row + i + 1, row + n, 0.0);
+    }
+}
+
+bool CholeskyDecomposition::factor_panel(size_t k0, size_t kb) {
+    const size_t n = order();
+    const size_t k1 = k0 + kb;
+    const size_t lda = m_l.stride();
+    double *a = m_l.data();
+    const SimdKernels &kernels = simd();
+    // L(i, j) = (A(i, j) - L(i, k0..j) . L(j, k0..j)) / L(j, j); earlier panels are already
+    // subtracted by update_trailing.
+    for (size_t j = k0; j < k1; j++) {
+        double *row_j = a + j * lda;
+        const double diagonal = row_j[j] - kernels.dot(row_j + k0, row_j + k0, j - k0);
+        if (!(diagonal > 0)) return false;
+        row_j[j] = std::sqrt(diagonal);
+        for (size_t i = j + 1; i < k1; i++) {
+            double *row_i = a + i * lda;
+            row_i[j] = (row_i[j] - kernels.dot(row_i + k0, row_j + k0, j - k0)) / row_j[j];
+        }
+    }
+    // L21 = A21 * L11^-T, i.e. L11 * L21^T = A21^T. Each thread copies its rows of A21 out
+    // transposed, so the substitution runs as axpy over all of them at once, and back.
+    ThreadPool::instance().parallel_ranges(k1, n, m_threads, 64, [&](size_t from, size_t to) {
+        const size_t width = to - from;
+        std::vector<double> panel(kb * width);
+        for (size_t i = from; i < to; i++) {
+            for (size_t j = 0; j < kb; j++) panel[j * width + (i - from)] = a[i * lda + k0 + j];
+        }
+        for (size_t j = 0; j < kb; j++) {
+            const double *row_j = a + (k0 + j) * lda + k0;
+            double *out = panel.data() + j * width;
+            for (size_t p = 0; p < j; p++) {
+                if (row_j[p] != 0) kernels.axpy(-row_j[p], panel.data() + p * width, out, width);
+            }
+            kernels.scale(1 / row_j[j], out, out, width);
+        }
+        for (size_t i = from; i < to; i++) {
+            for (size_t j = 0; j < kb; j++) a[i * lda + k0 + j] = panel[j * width + (i - from)];
+        }
+    });
+    return true;
+}
+
+void CholeskyDecomposition::update_trailing(size_t k0, size_t kb) {
+    const size_t n = order();
+    const size_t c0 = k0 + kb;
+    if (c0 >= n) return;
+    const size_t lda = m_l.stride();
+    double *a = m_l.data();
+    // A22 -= L21 * L21^T on the lower triangle only, one tile row of kBlock rows at a time. The
+    // later tile rows are longer, so the threads take them one by one, as in gram().
+    const size_t tiles = (n - c0 + kBlock - 1) / kBlock;
+    auto tile_row = [&](size_t t) {
+        const size_t i0 = c0 + t * kBlock;
+        const size_t rows = std::min(kBlock, n - i0);
+        gemm(false, true, rows, i0 + rows - c0, kb, -1.0,
+             a + i0 * lda + k0, lda,
+             a + c0 * lda + k0, lda,
+             a + i0 * lda + c0, lda);
+    };
+    if (m_threads <= 1 || tiles == 1) {
+        for (size_t t = 0; t < tiles; t++) tile_row(t);
+    } else {
+        std::atomic<size_t> next{0};
+        ThreadPool::instance().parallel_for(std::min(m_threads, tiles), [&](size_t) {
+            for (size_t t = next.fetch_add(1); t < tiles; t = next.fetch_add(1)) tile_row(t);
+        });
+    }
+}
+
+size_t CholeskyDecomposition::order() const {
+    return m_l.getRows();
+}
+
+bool CholeskyDecomposition::positive_definite() const {
+    return m_positive_definite;
+}
+
+const Matrix &CholeskyDecomposition::lower() const {
+    require_positive_definite("CholeskyDecomposition::lower");
+    return m_l;
+}
+
+void CholeskyDecomposition::require_positive_definite(const char *what) const {
+    if (!m_positive_definite) {
+        throw std::domain_error(std::string(what) + ": matrix is not positive definite");
+    }
+}
+
+double CholeskyDecomposition::det() const {
+    require_positive_definite("CholeskyDecomposition::det");
+    double det = 1;
+    for (size_t i = 0; i < order(); i++) {
+        det *= m_l.at(i, i) * m_l.at(i, i);
+    }
+    return det;
+}
+
+double CholeskyDecomposition::log_det() const {
+    require_positive_definite("CholeskyDecomposition::log_det");
+    double sum = 0;
+    for (size_t i = 0; i < order(); i++) {
+        sum += std::log(m_l.at(i, i));
+    }
+    return 2 * sum;
+}
+
+double CholeskyDecomposition::rcond() const {
+    const size_t n = order();
+    if (!m_positive_definite) return 0;
+    if (n == 0 || m_norm1 == 0) return 1;
+    // A^-1 is symmetric: the same solve serves both steps of the estimator.
+    const auto solve = [this](std::vector<double> &x) { solve_vector(x); };
+    const double estimate = detail::hager_inverse_norm1(n, solve, solve);
+    return 1 / (m_norm1 * estimate);
+}
+
+void CholeskyDecomposition::solve_vector(std::vector<double> &x) const {
+    const size_t n = order();
+    for (size_t i = 0; i < n; i++) {
+        const double *l_row = m_l.data() + i * m_l.stride();
+        double sum = x[i];
+        for (size_t j = 0; j < i; j++) sum -= l_row[j] * x[j];
+        x[i] = sum / l_row[i];
+    }
+    for (size_t i = n; i-- > 0;) {
+        const double *l_row = m_l.data() + i * m_l.stride();
+        x[i] /= l_row[i];
+        for (size_t j = 0; j < i; j++) x[j] -= l_row[j] * x[i];
+    }
+}
+
+Matrix CholeskyDecomposition::solve(const Matrix &b) const {
+    const size_t n = order();
+    if (b.getRows() != n) {
+        throw std::invalid_argument("CholeskyDecomposition::solve: right-hand side has wrong number of rows");
+    }
+    require_positive_definite("CholeskyDecomposition::solve");
+    Matrix x(b);
+    const size_t lda = m_l.stride();
+    const size_t ldx = x.stride();
+    const double *l = m_l.data();
+    double *xs = x.data();
+    ThreadPool::instance().parallel_ranges(0, x.getCols(), m_threads, kSolveColumnChunk, [&](size_t from, size_t to) {
+        const SimdKernels &kernels = simd();
+        // L * Y = B.
+        for (size_t i = 0; i < n; i++) {
+            const double *l_row = l + i * lda;
+            double *x_row = xs + i * ldx;
+            for (size_t j = 0; j < i; j++) {
+                if (l_row[j] != 0) kernels.axpy(-l_row[j], xs + j * ldx + from, x_row + from, to - from);
+            }
+            for (size_t c = from; c < to; c++) x_row[c] /= l_row[i];
+        }
+        // L^T * X = Y: row i of L holds column i of L^T, so each solved row is pushed upwards.
+        for (size_t i = n; i-- > 0;) {
+            const double *l_row = l + i * lda;
+            double *x_row = xs + i * ldx;
+            for (size_t c = from; c < to; c++) x_row[c] /= l_row[i];
+            for (size_t j = 0; j < i; j++) {
+                if (l_row[j] != 0) kernels.axpy(-l_row[j], x_row + from, xs + j * ldx + from, to - from);
+            }
+        }
+    });
+    return x;
+}
+
+Matrix CholeskyDecomposition::inverse() const {
+    return solve(Matrix::createDiagonal(order(), 1));
+}
+
+double spd_det(const Matrix &a) {
+    if (auto factors = try_cholesky(a)) return factors->det();
+    return a.det();
+}
+
+LogDeterminant log_det(const Matrix &a) {
+    if (auto factors = try_cholesky(a)) return {1, factors->log_det()};
+    const LUDecomposition factors = a.lu();
+    LogDeterminant result{1, 0};
+    for (size_t i = 0; i < factors.order(); i++) {
+        const double u = factors.packed().at(i, i);
+        if (u == 0) return {0, -std::numeric_limits<double>::infinity()};
+        if ((u < 0) != (factors.pivots()[i] != i)) result.sign = -result.sign;
+        result.log_abs += std::log(std::abs(u));
+    }
+    return result;
+}
+
+Matrix spd_solve(const Matrix &a, const Matrix &b) {
+    const auto factors = try_cholesky(a);
+    if (!factors) return solve(a, b);
+    if (b.getRows() != factors->order()) {
+        throw std::invalid_argument("spd_solve: right-hand side has wrong number of rows");
+    }
+    const double rcond = factors->rcond();
+    if (rcond < std::numeric_limits<double>::epsilon()) {
+        throw SingularMatrixError("spd_solve: matrix is singular to working precision", rcond);
+    }
+    return factors->solve(b);
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "matrix.h"
+#include <cstddef>
+#include <vector>
+
+// Symmetric matrix in packed storage: only the lower triangle, row by row, n(n + 1) / 2 doubles
+// instead of n^2. at(i, j) and at(j, i) are the same element.
+class SymmetricMatrix final {
+public:
+    SymmetricMatrix() = default;
+
+    explicit SymmetricMatrix(size_t n, double value = 0);
+
+    // The lower triangle of mat; the upper one is not looked at. Throws std::invalid_argument if
+    // mat is not square.
+    explicit SymmetricMatrix(const Matrix &mat);
+
+    [[nodiscard]] size_t order() const;
+
+    double &at(size_t i, size_t j);
+
+    [[nodiscard]] const double &at(size_t i, size_t j) const;
+
+    // Row i of the lower triangle, A(i, 0) ... A(i, i).
+    [[nodiscard]] const double *row(size_t i) const;
+
+    [[nodiscard]] Matrix to_matrix() const;
+
+    bool operator==(const SymmetricMatrix &another) const;
+
+private:
+    size_t m_order = 0;
+    std::vector<double> m_packed;
+};
+
+// True if mat is square and bit-for-bit symmetric, as gram() and SymmetricMatrix::to_matrix() make it.
+[[nodiscard]] bool is_symmetric(const Matrix &mat);
+
+// A = L * L^T of a symmetric positive-definite matrix, half the flops of LUDecomposition and no
+// pivoting. Only the lower triangle of the input is read. Blocked like LUDecomposition: each panel
+// of kBlock columns is factored and the trailing lower triangle is updated by gemm with
+// L21 * L21^T, its rows split between the threads so that each gets the same area of the triangle.
+//
+// A matrix that is not positive definite is detected on the way: the first diagonal element that
+// would be <= 0 (or NaN) stops the factorization, so an indefinite matrix costs only the part
+// factored up to there.
+class CholeskyDecomposition final {
+public:
+    static constexpr size_t kBlock = 64;
+
+    explicit CholeskyDecomposition(const Matrix &mat, size_t num_of_threads = 1);
+
+    // Factorizes in mat's buffer instead of copying it.
+    explicit CholeskyDecomposition(Matrix &&mat, size_t num_of_threads = 1);
+
+    explicit CholeskyDecomposition(const SymmetricMatrix &mat, size_t num_of_threads = 1);
+
+    [[nodiscard]] size_t order() const;
+
+    // False if the matrix turned out not to be positive definite; everything below then throws.
+    [[nodiscard]] bool positive_definite() const;
+
+    // L, with zeros above the diagonal.
+    [[nodiscard]] const Matrix &lower() const;
+
+    [[nodiscard]] double det() const;
+
+    // log(det(A)) = 2 * sum of log(L(i, i)); does not overflow where det() does.
+    [[nodiscard]] double log_det() const;
+
+    // Estimate of 1 / (||A||_1 * ||A^-1||_1), as LUDecomposition::rcond(); each step of the
+    // estimator is a pair of triangular solves with L and L^T. 0 if not positive_definite().
+    [[nodiscard]] double rcond() const;
+
+    // Solves A * X = B by L * Y = B and L^T * X = Y, the columns of B split between the threads.
+    // Throws std::invalid_argument if B has the wrong number of rows.
+    [[nodiscard]] Matrix solve(const Matrix &b) const;
+
+    [[nodiscard]] Matrix inverse() const;
+
+private:
+    Matrix m_l;
+    bool m_positive_definite = true;
+    size_t m_threads = 1;
+    // ||A||_1 of the factored matrix, for rcond().
+    double m_norm1 = 0;
+
+    void factor();
+
+    // In place: x = A^-1 x (A^-1 is symmetric, so this serves the transposed solves as well).
+    void solve_vector(std::vector<double> &x) const;
+
+    // L11 and L21 of the panel [k0, k0 + kb); false if L11 hits a non-positive pivot.
+    bool factor_panel(size_t k0, size_t kb);
+
+    void update_trailing(size_t k0, size_t kb);
+
+    void require_positive_definite(const char *what) const;
+};
+
+// log|det(A)| and the sign of det(A) (0 for a singular matrix, with log_abs = -inf).
+struct LogDeterminant {
+    double sign;
+    double log_abs;
+};
+
+// Determinant, log-determinant and solve that take the Cholesky path when A is symmetric and
+// positive definite and fall back to lu() otherwise; any square A gets the answer det() or
+// solve(A, B) would give. Symmetry is checked first (O(n^2), exact, see is_symmetric); the
+// factorization itself rejects symmetric matrices that are not positive definite. Threads as
+// for lu(): from the cost model when A has multithreading on.
+[[nodiscard]] double spd_det(const Matrix &a);
+
+[[nodiscard]] LogDeterminant log_det(const Matrix &a);
+
+// Throws like solve(A, B): SingularMatrixError when rcond(A) < epsilon on either path.
+[[nodiscard]] Matrix spd_solve(const Matrix &a, const Matrix &b);
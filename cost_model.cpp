@@ -0,0 +1,240 @@
+#include "cost_model.h"
+#include "gemm.h"
+#include "simd_kernels.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Repeats f until at least `budget` has passed and returns the average seconds per call.
+template<typename F>
+double seconds_per_call(F &&f, std::chrono::microseconds budget) {
+    f();
+    size_t calls = 0;
+    const auto start = Clock::now();
+    auto now = start;
+    do {
+        f();
+        calls++;
+        now = Clock::now();
+    } while (now - start < budget);
+    return std::chrono::duration<double>(now - start).count() / static_cast<double>(calls);
+}
+
+HostProfile measure_host() {
+    using namespace std::chrono_literals;
+    HostProfile profile;
+    // A private pool of the shared pool's size: measuring must not run, and wait for, queued
+    // tasks of the shared pool, which may themselves be asking for the profile.
+    ThreadPool pool(ThreadPool::instance().size());
+    const size_t concurrency = pool.concurrency();
+
+    // Compute: a cache-resident gemm, i.e. the best case every operation is compared against.
+    constexpr size_t kOrder = 96;
+    std::vector<double> a(kOrder * kOrder, 1.0), b(kOrder * kOrder, 0.5), c(kOrder * kOrder, 0.0);
+    const double gemm_seconds = seconds_per_call([&] {
+        gemm(kOrder, kOrder, kOrder, 1.0, a.data(), kOrder, b.data(), kOrder, c.data(), kOrder);
+    }, 3ms);
+    profile.flops_per_second = 2.0 * kOrder * kOrder * kOrder / gemm_seconds;
+
+    // Memory: out = x + y over buffers well beyond the last-level cache of a small core.
+    constexpr size_t kLength = size_t{1} << 21;
+    std::vector<double> x(kLength, 1.0), y(kLength, 2.0), out(kLength);
+    const double bytes = 3.0 * sizeof(double) * kLength;
+    const SimdKernels &kernels = simd();
+    profile.bytes_per_second = bytes / seconds_per_call([&] {
+        kernels.add(x.data(), y.data(), out.data(), kLength);
+    }, 4ms);
+    if (concurrency > 1) {
+        const size_t chunk = kLength / concurrency;
+        profile.parallel_bytes_per_second = bytes / seconds_per_call([&] {
+            pool.parallel_for(concurrency, [&](size_t i) {
+                const size_t begin = i * chunk;
+                const size_t end = i + 1 == concurrency ? kLength : begin + chunk;
+                kernels.add(x.data() + begin, y.data() + begin, out.data() + begin, end - begin);
+            });
+        }, 4ms);
+    }
+    profile.parallel_bytes_per_second = std::max(profile.parallel_bytes_per_second, profile.bytes_per_second);
+
+    // Synchronization: an empty parallel_for is pure dispatch + join. Half of it is charged per
+    // barrier and the other half is spread over the participating threads.
+    if (concurrency > 1) {
+        const double join = seconds_per_call([&] {
+            pool.parallel_for(concurrency, [](size_t) {});
+        }, 2ms);
+        profile.sync_seconds = join / 2;
+        profile.per_thread_seconds = join / (2.0 * static_cast<double>(concurrency));
+    }
+    return profile;
+}
+
+double predict(const HostProfile &host, const WorkEstimate &work, size_t threads) {
+    const double t = static_cast<double>(threads);
+    const double bandwidth = std::min(host.bytes_per_second * t, host.parallel_bytes_per_second);
+    double seconds = std::max(work.flops / (host.flops_per_second * t), work.bytes / bandwidth);
+    if (threads > 1) seconds += work.syncs * (host.sync_seconds + t * host.per_thread_seconds);
+    return seconds;
+}
+
+bool calibration_disabled() {
+    const char *env = std::getenv("MATRIX_CALIBRATE");
+    return env != nullptr && std::strcmp(env, "0") == 0;
+}
+
+size_t threads_from_environment() {
+    const char *env = std::getenv("MATRIX_THREADS");
+    if (env == nullptr) return 0;
+    return static_cast<size_t>(std::strtoull(env, nullptr, 10));
+}
+
+}
+
+WorkEstimate WorkEstimate::elementwise(size_t rows, size_t cols, size_t operands) {
+    const double elements = static_cast<double>(rows) * static_cast<double>(cols);
+    WorkEstimate work;
+    work.flops = elements * static_cast<double>(std::max<size_t>(operands, 2) - 1);
+    work.bytes = elements * sizeof(double) * static_cast<double>(operands + 1);
+    work.max_parallelism = rows;
+    return work;
+}
+
+WorkEstimate WorkEstimate::multiply(size_t m, size_t n, size_t k) {
+    const double dm = static_cast<double>(m), dn = static_cast<double>(n), dk = static_cast<double>(k);
+    WorkEstimate work;
+    work.flops = 2 * dm * dn * dk;
+    work.bytes = sizeof(double) * (dm * dk + dk * dn + 2 * dm * dn);
+    work.max_parallelism = m;
+    return work;
+}
+
+WorkEstimate WorkEstimate::determinant(size_t n) {
+    const double dn = static_cast<double>(n);
+    WorkEstimate work;
+    work.flops = 2 * dn * dn * dn / 3;
+    // Every column step streams the trailing submatrix in and out once.
+    work.bytes = 2 * sizeof(double) * dn * dn * dn / 3;
+    // Point-to-point handoffs cost a fraction of a join of the pool.
+    work.syncs = dn / 4;
+    work.max_parallelism = n;
+    return work;
+}
+
+WorkEstimate WorkEstimate::lu(size_t n, size_t block) {
+    const double dn = static_cast<double>(n);
+    const double panels = static_cast<double>((n + block - 1) / std::max<size_t>(block, 1));
+    WorkEstimate work;
+    work.flops = 2 * dn * dn * dn / 3;
+    // The trailing update is a gemm per panel: the trailing matrix is read and written once per panel.
+    work.bytes = 2 * sizeof(double) * dn * dn * panels / 3;
+    // Two barriers per panel for the trailing update plus one per column inside the panels.
+    work.syncs = 2 * panels + dn;
+    work.max_parallelism = n;
+    return work;
+}
+
+WorkEstimate WorkEstimate::cholesky(size_t n, size_t block) {
+    const double dn = static_cast<double>(n);
+    const double panels = static_cast<double>((n + block - 1) / std::max<size_t>(block, 1));
+    WorkEstimate work;
+    work.flops = dn * dn * dn / 3;
+    // Only the lower half of the trailing matrix is read and written per panel.
+    work.bytes = sizeof(double) * dn * dn * panels / 3;
+    // The panel rows and the trailing update: two barriers per panel.
+    work.syncs = 2 * panels;
+    work.max_parallelism = n;
+    return work;
+}
+
+CostModel &CostModel::instance() {
+    static CostModel model;
+    return model;
+}
+
+CostModel::CostModel() : m_calibrated(calibration_disabled()), m_override(threads_from_environment()) {}
+
+size_t CostModel::threads_for(const WorkEstimate &work, size_t max_threads) {
+    max_threads = std::max<size_t>(max_threads, 1);
+    if (const size_t forced = thread_override(); forced != 0) {
+        return std::min(forced, max_threads);
+    }
+    const size_t limit = std::min(max_threads, std::max<size_t>(work.max_parallelism, 1));
+    if (limit == 1) return 1;
+
+    const HostProfile host = profile();
+    const double serial = predict(host, work, 1);
+    size_t best = 1;
+    double best_seconds = serial;
+    for (size_t threads = 2; threads <= limit; threads++) {
+        const double seconds = predict(host, work, threads);
+        if (seconds < best_seconds) {
+            best = threads;
+            best_seconds = seconds;
+        }
+    }
+    // Going parallel must pay off clearly: the estimate is rough and serial code has no jitter.
+    return best_seconds < 0.9 * serial ? best : 1;
+}
+
+double CostModel::predict_seconds(const WorkEstimate &work, size_t threads) {
+    return predict(profile(), work, std::max<size_t>(threads, 1));
+}
+
+void CostModel::set_thread_override(size_t threads) {
+    std::lock_guard lock(m_mutex);
+    m_override = threads;
+}
+
+size_t CostModel::thread_override() const {
+    std::lock_guard lock(m_mutex);
+    return m_override;
+}
+
+void CostModel::set_profile(const HostProfile &profile) {
+    std::lock_guard lock(m_mutex);
+    m_profile = profile;
+    m_calibrated = true;
+}
+
+HostProfile CostModel::profile() {
+    bool measure = false;
+    {
+        std::lock_guard lock(m_mutex);
+        if (!m_calibrated && !m_calibrating) {
+            m_calibrating = true;
+            measure = true;
+        }
+    }
+    if (measure) {
+        HostProfile measured;
+        try {
+            measured = measure_host();
+        } catch (...) {
+            // Let a later call try again rather than keep the defaults for good.
+            std::lock_guard lock(m_mutex);
+            m_calibrating = false;
+            throw;
+        }
+        std::lock_guard lock(m_mutex);
+        m_calibrating = false;
+        // set_profile() may have run while measuring; an explicit profile wins.
+        if (!m_calibrated) {
+            m_profile = measured;
+            m_calibrated = true;
+        }
+    }
+    std::lock_guard lock(m_mutex);
+    return m_profile;
+}
+
+HostProfile CostModel::calibrate() {
+    const HostProfile measured = measure_host();
+    set_profile(measured);
+    return measured;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+
+// Work of one operation as seen by the scheduler.
+struct WorkEstimate {
+    double flops = 0;
+    // Bytes read plus bytes written.
+    double bytes = 0;
+    // Number of join barriers the parallel version needs (1 for a single parallel_for).
+    double syncs = 1;
+    // Upper bound on useful threads, e.g. the number of rows that can be split.
+    size_t max_parallelism = static_cast<size_t>(-1);
+
+    static WorkEstimate elementwise(size_t rows, size_t cols, size_t operands = 2);
+
+    static WorkEstimate multiply(size_t m, size_t n, size_t k);
+
+    // Column-by-column elimination (Matrix::fast_det), pipelined: a handoff per column, not a join.
+    static WorkEstimate determinant(size_t n);
+
+    // Blocked LU (LUDecomposition) with panels of `block` columns.
+    static WorkEstimate lu(size_t n, size_t block);
+
+    // Blocked Cholesky (CholeskyDecomposition): half the flops of lu() and no pivot search.
+    static WorkEstimate cholesky(size_t n, size_t block);
+};
+
+// Single-host speeds the model extrapolates from.
+struct HostProfile {
+    double flops_per_second = 4e9;
+    // Streaming bandwidth of one thread and of all threads together.
+    double bytes_per_second = 8e9;
+    double parallel_bytes_per_second = 16e9;
+    // Cost of one parallel_for join plus the extra cost per participating thread.
+    double sync_seconds = 5e-6;
+    double per_thread_seconds = 2e-6;
+};
+
+// Chooses how many threads an operation should use. The predicted time for t threads is
+//     max(flops / (F * t), bytes / min(B * t, B_all)) + syncs * (sync + t * per_thread)
+// (t = 1 runs inline and pays no synchronization) and the cheapest t wins, so small problems
+// stay serial, bandwidth-bound ones stop where the memory bus saturates and large ones use
+// every thread. The profile is measured once, by a short micro-benchmark on first use, on a
+// private pool; queries made while it runs (from other threads) get the default profile
+// rather than waiting for it.
+//
+// Overrides, strongest first: set_thread_override() or MATRIX_THREADS=n force a thread count;
+// set_profile() replaces the measurement; MATRIX_CALIBRATE=0 skips it and keeps the defaults.
+class CostModel final {
+public:
+    static CostModel &instance();
+
+    [[nodiscard]] size_t threads_for(const WorkEstimate &work, size_t max_threads);
+
+    [[nodiscard]] double predict_seconds(const WorkEstimate &work, size_t threads);
+
+    // 0 removes the override.
+    void set_thread_override(size_t threads);
+
+    [[nodiscard]] size_t thread_override() const;
+
+    void set_profile(const HostProfile &profile);
+
+    [[nodiscard]] HostProfile profile();
+
+    // Measures the host now (the first query does it lazily) and installs the result.
+    HostProfile calibrate();
+
+private:
+    CostModel();
+
+    mutable std::mutex m_mutex;
+    HostProfile m_profile;
+    bool m_calibrated = false;
+    bool m_calibrating = false;
+    size_t m_override = 0;
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "matrix.h"
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+
+// N x M matrix with the extents in the type and the elements in a std::array, for the small
+// (3x3 .. 8x8) matrices that are processed in large numbers. There is no heap allocation, no
+// thread pool and no shape check at run time: the loops have constant trip counts the compiler
+// unrolls, a shape mismatch is a compile error and everything is usable in constant expressions.
+// det() is closed-form up to 4x4 and unrolled Gaussian elimination above.
+template<size_t N, size_t M, typename T = double>
+class FixedMatrix final {
+public:
+    using value_type = T;
+
+    static constexpr size_t rows = N;
+    static constexpr size_t cols = M;
+
+    constexpr FixedMatrix() : m_data{} {}
+
+    constexpr explicit FixedMatrix(T value) : m_data{} {
+        m_data.fill(value);
+    }
+
+    // Row-major elements: FixedMatrix<2, 2>{1, 2, 3, 4}.
+    template<typename... Values>
+    requires (sizeof...(Values) == N * M && N * M > 1)
+    constexpr FixedMatrix(Values... values) : m_data{static_cast<T>(values)...} {}
+
+    // Throws std::invalid_argument unless the dynamic matrix is N x M.
+    explicit FixedMatrix(const Matrix &mat) : m_data{} {
+        if (mat.getRows() != N || mat.getCols() != M) {
+            throw std::invalid_argument("FixedMatrix: dynamic matrix has a different shape");
+        }
+        for (size_t i = 0; i < N; i++) {
+            for (size_t j = 0; j < M; j++) {
+                (*this)(i, j) = static_cast<T>(mat.at(i, j));
+            }
+        }
+    }
+
+    static constexpr FixedMatrix createDiagonal(T value) requires (N == M) {
+        FixedMatrix diagonal;
+        for (size_t i = 0; i < N; i++) diagonal(i, i) = value;
+        return diagonal;
+    }
+
+    [[nodiscard]] Matrix to_matrix() const {
+        Matrix mat(N, M);
+        for (size_t i = 0; i < N; i++) {
+            for (size_t j = 0; j < M; j++) {
+                mat.at(i, j) = static_cast<double>((*this)(i, j));
+            }
+        }
+        return mat;
+    }
+
+    [[nodiscard]] static constexpr size_t getRows() { return N; }
+
+    [[nodiscard]] static constexpr size_t getCols() { return M; }
+
+    constexpr T &operator()(size_t i, size_t j) { return m_data[i * M + j]; }
+
+    constexpr const T &operator()(size_t i, size_t j) const { return m_data[i * M + j]; }
+
+    constexpr T &at(size_t i, size_t j) { return (*this)(i, j); }
+
+    [[nodiscard]] constexpr const T &at(size_t i, size_t j) const { return (*this)(i, j); }
+
+    constexpr T *data() { return m_data.data(); }
+
+    [[nodiscard]] constexpr const T *data() const { return m_data.data(); }
+
+    constexpr bool operator==(const FixedMatrix &another) const = default;
+
+    constexpr FixedMatrix &operator+=(const FixedMatrix &another) {
+        for (size_t k = 0; k < N * M; k++) m_data[k] += another.m_data[k];
+        return *this;
+    }
+
+    constexpr FixedMatrix &operator-=(const FixedMatrix &another) {
+        for (size_t k = 0; k < N * M; k++) m_data[k] -= another.m_data[k];
+        return *this;
+    }
+
+    friend constexpr FixedMatrix operator+(FixedMatrix a, const FixedMatrix &b) { return a += b; }
+
+    friend constexpr FixedMatrix operator-(FixedMatrix a, const FixedMatrix &b) { return a -= b; }
+
+    template<size_t K>
+    friend constexpr FixedMatrix<N, K, T> operator*(const FixedMatrix &a, const FixedMatrix<M, K, T> &b) {
+        FixedMatrix<N, K, T> c;
+        for (size_t i = 0; i < N; i++) {
+            for (size_t k = 0; k < M; k++) {
+                const T aik = a(i, k);
+                for (size_t j = 0; j < K; j++) c(i, j) += aik * b(k, j);
+            }
+        }
+        return c;
+    }
+
+    [[nodiscard]] constexpr FixedMatrix<M, N, T> transposed() const {
+        FixedMatrix<M, N, T> t;
+        for (size_t i = 0; i < N; i++) {
+            for (size_t j = 0; j < M; j++) t(j, i) = (*this)(i, j);
+        }
+        return t;
+    }
+
+    [[nodiscard]] constexpr T det() const requires (N == M) {
+        const FixedMatrix &a = *this;
+        if constexpr (N == 0) {
+            return T{1};
+        } else if constexpr (N == 1) {
+            return a(0, 0);
+        } else if constexpr (N == 2) {
+            return a(0, 0) * a(1, 1) - a(0, 1) * a(1, 0);
+        } else if constexpr (N == 3) {
+            return a(0, 0) * (a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1))
+                 - a(0, 1) * (a(1, 0) * a(2, 2) - a(1, 2) * a(2, 0))
+                 + a(0, 2) * (a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0));
+        } else if constexpr (N == 4) {
+            // Laplace expansion along the first two rows: six pairs of complementary 2x2 minors.
+            const T s0 = a(0, 0) * a(1, 1) - a(1, 0) * a(0, 1);
+            const T s1 = a(0, 0) * a(1, 2) - a(1, 0) * a(0, 2);
+            const T s2 = a(0, 0) * a(1, 3) - a(1, 0) * a(0, 3);
+            const T s3 = a(0, 1) * a(1, 2) - a(1, 1) * a(0, 2);
+            const T s4 = a(0, 1) * a(1, 3) - a(1, 1) * a(0, 3);
+            const T s5 = a(0, 2) * a(1, 3) - a(1, 2) * a(0, 3);
+            const T c5 = a(2, 2) * a(3, 3) - a(3, 2) * a(2, 3);
+            const T c4 = a(2, 1) * a(3, 3) - a(3, 1) * a(2, 3);
+            const T c3 = a(2, 1) * a(3, 2) - a(3, 1) * a(2, 2);
+            const T c2 = a(2, 0) * a(3, 3) - a(3, 0) * a(2, 3);
+            const T c1 = a(2, 0) * a(3, 2) - a(3, 0) * a(2, 2);
+            const T c0 = a(2, 0) * a(3, 1) - a(3, 0) * a(2, 1);
+            return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+        } else {
+            // Partial pivoting on a stack copy, like Matrix::det without the pool.
+            FixedMatrix work = a;
+            T det{1};
+            for (size_t k = 0; k < N; k++) {
+                size_t best = k;
+                for (size_t r = k + 1; r < N; r++) {
+                    if (magnitude(work(r, k)) > magnitude(work(best, k))) best = r;
+                }
+                if (work(best, k) == T{}) return T{};
+                if (best != k) {
+                    for (size_t j = k; j < N; j++) std::swap(work(k, j), work(best, j));
+                    det = -det;
+                }
+                det *= work(k, k);
+                for (size_t i = k + 1; i < N; i++) {
+                    const T factor = work(i, k) / work(k, k);
+                    for (size_t j = k + 1; j < N; j++) work(i, j) -= factor * work(k, j);
+                }
+            }
+            return det;
+        }
+    }
+
+private:
+    std::array<T, N * M> m_data;
+
+    static constexpr T magnitude(T value) { return value < T{} ? -value : value; }
+};
+
+template<size_t N, typename T = double>
+using FixedSquareMatrix = FixedMatrix<N, N, T>;
@@ -0,0 +1,125 @@
+#include "gemm.h"
+#include "simd_kernels.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+constexpr size_t MR = GemmBlocking::MR;
+constexpr size_t NR = GemmBlocking::NR;
+constexpr size_t MC = GemmBlocking::MC;
+constexpr size_t KC = GemmBlocking::KC;
+constexpr size_t NC = GemmBlocking::NC;
+
+// Copies a mc x kc block of A into MR-row slivers: sliver p holds A(p*MR + r, kk) at [kk * MR + r].
+// Rows past mc are zero-filled so the micro-kernel never needs a remainder path.
+// A transposed A is stored k x m, so the MR values of a sliver column are contiguous.
+template<bool Trans>
+void pack_a(size_t mc, size_t kc, const double *a, size_t lda, double *packed) {
+    for (size_t i = 0; i < mc; i += MR) {
+        const size_t rows = std::min(MR, mc - i);
+        for (size_t kk = 0; kk < kc; kk++) {
+            for (size_t r = 0; r < rows; r++) {
+                packed[r] = Trans ? a[kk * lda + i + r] : a[(i + r) * lda + kk];
+            }
+            for (size_t r = rows; r < MR; r++) {
+                packed[r] = 0;
+            }
+            packed += MR;
+        }
+    }
+}
+
+// Copies a kc x nc panel of B into NR-column slivers: sliver q holds B(kk, q*NR + c) at [kk * NR + c].
+// A transposed B is stored n x k and is read down its rows, NR rows at a time.
+template<bool Trans>
+void pack_b(size_t kc, size_t nc, const double *b, size_t ldb, double *packed) {
+    for (size_t j = 0; j < nc; j += NR) {
+        const size_t cols = std::min(NR, nc - j);
+        for (size_t kk = 0; kk < kc; kk++) {
+            for (size_t col = 0; col < cols; col++) {
+                packed[col] = Trans ? b[(j + col) * ldb + kk] : b[kk * ldb + j + col];
+            }
+            for (size_t col = cols; col < NR; col++) {
+                packed[col] = 0;
+            }
+            packed += NR;
+        }
+    }
+}
+
+static_assert(MR == 4 && NR == 8, "SimdKernels::gemm_tile is written for a 4 x 8 register tile");
+
+// MR x NR register tile: acc = sliver(A) * sliver(B), then C += alpha * acc on the valid part.
+void micro_kernel(const SimdKernels &kernels, size_t kc, double alpha, const double *a, const double *b,
+                  double *c, size_t ldc, size_t rows, size_t cols) {
+    alignas(64) double acc[MR][NR] = {};
+    kernels.gemm_tile(kc, a, b, &acc[0][0]);
+    for (size_t r = 0; r < rows; r++) {
+        double *c_row = c + r * ldc;
+        for (size_t col = 0; col < cols; col++) {
+            c_row[col] += alpha * acc[r][col];
+        }
+    }
+}
+
+void macro_kernel(size_t mc, size_t nc, size_t kc, double alpha,
+                  const double *packed_a, const double *packed_b, double *c, size_t ldc) {
+    const SimdKernels &kernels = simd();
+    for (size_t j = 0; j < nc; j += NR) {
+        const size_t cols = std::min(NR, nc - j);
+        const double *b_sliver = packed_b + j * kc;
+        for (size_t i = 0; i < mc; i += MR) {
+            const size_t rows = std::min(MR, mc - i);
+            micro_kernel(kernels, kc, alpha, packed_a + i * kc, b_sliver, c + i * ldc + j, ldc, rows, cols);
+        }
+    }
+}
+
+template<bool TransA, bool TransB>
+void gemm_impl(size_t m, size_t n, size_t k, double alpha,
+               const double *a, size_t lda,
+               const double *b, size_t ldb,
+               double *c, size_t ldc) {
+    // Each calling thread packs into its own buffers, so concurrent calls on disjoint rows of C are safe.
+    thread_local std::vector<double> packed_a;
+    thread_local std::vector<double> packed_b;
+    packed_a.resize(MC * KC);
+    packed_b.resize(KC * ((std::min(NC, n) + NR - 1) / NR * NR));
+
+    for (size_t jc = 0; jc < n; jc += NC) {
+        const size_t nc = std::min(NC, n - jc);
+        for (size_t pc = 0; pc < k; pc += KC) {
+            const size_t kc = std::min(KC, k - pc);
+            pack_b<TransB>(kc, nc, TransB ? b + jc * ldb + pc : b + pc * ldb + jc, ldb, packed_b.data());
+            for (size_t ic = 0; ic < m; ic += MC) {
+                const size_t mc = std::min(MC, m - ic);
+                pack_a<TransA>(mc, kc, TransA ? a + pc * lda + ic : a + ic * lda + pc, lda, packed_a.data());
+                macro_kernel(mc, nc, kc, alpha, packed_a.data(), packed_b.data(), c + ic * ldc + jc, ldc);
+            }
+        }
+    }
+}
+
+}
+
+void gemm(size_t m, size_t n, size_t k, double alpha,
+          const double *a, size_t lda,
+          const double *b, size_t ldb,
+          double *c, size_t ldc) {
+    gemm(false, false, m, n, k, alpha, a, lda, b, ldb, c, ldc);
+}
+
+void gemm(bool trans_a, bool trans_b, size_t m, size_t n, size_t k, double alpha,
+          const double *a, size_t lda,
+          const double *b, size_t ldb,
+          double *c, size_t ldc) {
+    if (m == 0 || n == 0 || k == 0 || alpha == 0) return;
+    if (trans_a) {
+        trans_b ? gemm_impl<true, true>(m, n, k, alpha, a, lda, b, ldb, c, ldc)
+                : gemm_impl<true, false>(m, n, k, alpha, a, lda, b, ldb, c, ldc);
+    } else {
+        trans_b ? gemm_impl<false, true>(m, n, k, alpha, a, lda, b, ldb, c, ldc)
+                : gemm_impl<false, false>(m, n, k, alpha, a, lda, b, ldb, c, ldc);
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+// Blocking parameters of the packed GEMM. A MC x KC block of A stays in L2,
+// a KC x NC panel of B stays in L3 and the MR x NR tile of C lives in registers.
+struct GemmBlocking {
+    static constexpr size_t MR = 4;
+    static constexpr size_t NR = 8;
+    static constexpr size_t MC = 128;
+    static constexpr size_t KC = 256;
+    static constexpr size_t NC = 2048;
+};
+
+// C[m x n] += alpha * A[m x k] * B[k x n].
+// All operands are row-major; lda, ldb and ldc are their leading dimensions (row strides).
+void gemm(size_t m, size_t n, size_t k, double alpha,
+          const double *a, size_t lda,
+          const double *b, size_t ldb,
+          double *c, size_t ldc);
+
+// C[m x n] += alpha * op(A) * op(B), op(X) = X^T when trans_x is set. A transposed A is stored
+// k x m (lda >= m) and is packed straight from its rows, so no transposed copy is ever made.
+void gemm(bool trans_a, bool trans_b, size_t m, size_t n, size_t k, double alpha,
+          const double *a, size_t lda,
+          const double *b, size_t ldb,
+          double *c, size_t ldc);
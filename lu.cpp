@@ -0,0 +1,301 @@
+#include "lu.h"
+#include "gemm.h"
+#include "simd_kernels.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+SingularMatrixError::SingularMatrixError(const std::string &what, double rcond)
+        : std::domain_error(what), m_rcond(rcond) {}
+
+double SingularMatrixError::rcond() const {
+    return m_rcond;
+}
+
+LUDecomposition::LUDecomposition(const Matrix &mat, size_t num_of_threads)
+        : LUDecomposition(Matrix(mat), num_of_threads) {}
+
+LUDecomposition::LUDecomposition(Matrix &&mat, size_t num_of_threads)
+        : m_lu(std::move(mat)), m_threads(std::max<size_t>(num_of_threads, 1)) {
+    factor();
+}
+
+void LUDecomposition::factor() {
+    if (m_lu.getRows() != m_lu.getCols()) {
+        throw std::invalid_argument("LUDecomposition: matrix must be square");
+    }
+    const size_t n = order();
+    std::vector<double> column_sums(n);
+    for (size_t i = 0; i < n; i++) {
+        const double *row = m_lu.m_matrix.row(i);
+        for (size_t j = 0; j < n; j++) column_sums[j] += std::abs(row[j]);
+    }
+    m_norm1 = n == 0 ? 0 : *std::max_element(column_sums.begin(), column_sums.end());
+    m_pivots.resize(n);
+    for (size_t k0 = 0; k0 < n; k0 += kBlock) {
+        const size_t kb = std::min(kBlock, n - k0);
+        factor_panel(k0, kb);
+        update_trailing(k0, kb);
+    }
+}
+
+void LUDecomposition::factor_panel(size_t k0, size_t kb) {
+    const size_t n = order();
+    const size_t panel_end = k0 + kb;
+    for (size_t j = k0; j < panel_end; j++) {
+        const size_t pivot_row = m_lu.col_max(j);
+        m_pivots[j] = pivot_row;
+        if (pivot_row != j) {
+            m_lu.swap_rows(j, pivot_row);
+            m_sign = -m_sign;
+        }
+        const double pivot = m_lu.at(j, j);
+        if (pivot == 0) {
+            m_singular = true;
+            continue;
+        }
+        const double *u_row = m_lu.m_matrix.row(j);
+        ThreadPool::instance().parallel_ranges(j + 1, n, m_threads, 256, [&](size_t from, size_t to) {
+            const SimdKernels &kernels = simd();
+            for (size_t i = from; i < to; i++) {
+                double *row = m_lu.m_matrix.row(i);
+                const double l = row[j] /= pivot;
+                kernels.axpy(-l, u_row + j + 1, row + j + 1, panel_end - j - 1);
+            }
+        });
+    }
+}
+
+void LUDecomposition::update_trailing(size_t k0, size_t kb) {
+    const size_t n = order();
+    const size_t c0 = k0 + kb;
+    if (c0 >= n) return;
+    const size_t lda = m_lu.stride();
+
+    // U12 = L11^-1 * A12, row by row inside the panel rows.
+    ThreadPool::instance().parallel_ranges(c0, n, m_threads, 256, [&](size_t from, size_t to) {
+        const SimdKernels &kernels = simd();
+        for (size_t i = k0 + 1; i < c0; i++) {
+            double *row = m_lu.m_matrix.row(i);
+            for (size_t j = k0; j < i; j++) {
+                const double l = row[j];
+                if (l == 0) continue;
+                kernels.axpy(-l, m_lu.m_matrix.row(j) + from, row + from, to - from);
+            }
+        }
+    });
+
+    // A22 -= L21 * U12.
+    double *a = m_lu.data();
+    ThreadPool::instance().parallel_ranges(c0, n, m_threads, GemmBlocking::MR * 8, [&](size_t from, size_t to) {
+        gemm(to - from, n - c0, kb, -1.0,
+             a + from * lda + k0, lda,
+             a + k0 * lda + c0, lda,
+             a + from * lda + c0, lda);
+    });
+}
+
+size_t LUDecomposition::order() const {
+    return m_lu.getRows();
+}
+
+const Matrix &LUDecomposition::packed() const {
+    return m_lu;
+}
+
+const std::vector<size_t> &LUDecomposition::pivots() const {
+    return m_pivots;
+}
+
+bool LUDecomposition::singular() const {
+    return m_singular;
+}
+
+double LUDecomposition::det() const {
+    double det = m_sign;
+    for (size_t i = 0; i < order(); i++) {
+        det *= m_lu.at(i, i);
+    }
+    return det;
+}
+
+size_t LUDecomposition::rank() const {
+    const size_t n = order();
+    double max = 0;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i; j < n; j++) {
+            max = std::max(max, std::abs(m_lu.at(i, j)));
+        }
+    }
+    const double tolerance = static_cast<double>(n) * std::numeric_limits<double>::epsilon() * max;
+    bool full = true;
+    for (size_t i = 0; i < n && full; i++) {
+        full = std::abs(m_lu.at(i, i)) > tolerance;
+    }
+    if (full) return n;
+
+    // U has negligible pivots: reduce it to row echelon form and count the remaining pivots.
+    ScratchScope scratch;
+    Matrix u(n, n);
+    for (size_t i = 0; i < n; i++) {
+        std::copy(m_lu.m_matrix.row(i) + i, m_lu.m_matrix.row(i) + n, u.m_matrix.row(i) + i);
+    }
+    size_t rank = 0;
+    for (size_t col = 0; col < n && rank < n; col++) {
+        size_t best = rank;
+        for (size_t i = rank + 1; i < n; i++) {
+            if (std::abs(u.at(i, col)) > std::abs(u.at(best, col))) best = i;
+        }
+        if (std::abs(u.at(best, col)) <= tolerance) continue;
+        u.swap_rows(rank, best);
+        Matrix::triangulation(u, rank, rank + 1, n);
+        rank++;
+    }
+    return rank;
+}
+
+double LUDecomposition::rcond() const {
+    const size_t n = order();
+    if (m_singular) return 0;
+    if (n == 0 || m_norm1 == 0) return 1;
+    const double estimate = detail::hager_inverse_norm1(
+            n, [this](std::vector<double> &x) { solve_vector(x, false); },
+            [this](std::vector<double> &x) { solve_vector(x, true); });
+    return 1 / (m_norm1 * estimate);
+}
+
+void LUDecomposition::solve_vector(std::vector<double> &x, bool transposed) const {
+    const size_t n = order();
+    if (!transposed) {
+        for (size_t i = 0; i < n; i++) std::swap(x[i], x[m_pivots[i]]);
+        for (size_t i = 0; i < n; i++) {
+            const double *l_row = m_lu.m_matrix.row(i);
+            double sum = x[i];
+            for (size_t j = 0; j < i; j++) sum -= l_row[j] * x[j];
+            x[i] = sum;
+        }
+        for (size_t i = n; i-- > 0;) {
+            const double *u_row = m_lu.m_matrix.row(i);
+            double sum = x[i];
+            for (size_t j = i + 1; j < n; j++) sum -= u_row[j] * x[j];
+            x[i] = sum / u_row[i];
+        }
+        return;
+    }
+    // A^T = U^T * L^T * P: solve with U^T, then L^T, then undo the row swaps in reverse order.
+    for (size_t i = 0; i < n; i++) {
+        const double *u_row = m_lu.m_matrix.row(i);
+        x[i] /= u_row[i];
+        for (size_t j = i + 1; j < n; j++) x[j] -= u_row[j] * x[i];
+    }
+    for (size_t i = n; i-- > 0;) {
+        const double *l_row = m_lu.m_matrix.row(i);
+        for (size_t j = 0; j < i; j++) x[j] -= l_row[j] * x[i];
+    }
+    for (size_t i = n; i-- > 0;) std::swap(x[i], x[m_pivots[i]]);
+}
+
+Matrix LUDecomposition::solve(const Matrix &b) const {
+    const size_t n = order();
+    if (b.getRows() != n) {
+        throw std::invalid_argument("LUDecomposition::solve: right-hand side has wrong number of rows");
+    }
+    if (m_singular) {
+        throw SingularMatrixError("LUDecomposition::solve: matrix is singular", 0);
+    }
+    Matrix x(b);
+    for (size_t i = 0; i < n; i++) {
+        x.swap_rows(i, m_pivots[i]);
+    }
+    if (x.getCols() >= m_threads * kSolveColumnChunk) {
+        substitute_columns(x);
+    } else {
+        substitute_rows(x);
+    }
+    return x;
+}
+
+void LUDecomposition::substitute_columns(Matrix &x) const {
+    const size_t n = order();
+    // Columns of X are independent, so each worker substitutes on its own column range.
+    ThreadPool::instance().parallel_ranges(0, x.getCols(), m_threads, kSolveColumnChunk, [&](size_t from, size_t to) {
+        const SimdKernels &kernels = simd();
+        for (size_t i = 0; i < n; i++) {
+            const double *l_row = m_lu.m_matrix.row(i);
+            double *x_row = x.m_matrix.row(i);
+            for (size_t j = 0; j < i; j++) {
+                const double l = l_row[j];
+                if (l == 0) continue;
+                kernels.axpy(-l, x.m_matrix.row(j) + from, x_row + from, to - from);
+            }
+        }
+        for (size_t i = n; i-- > 0;) {
+            const double *u_row = m_lu.m_matrix.row(i);
+            double *x_row = x.m_matrix.row(i);
+            for (size_t j = i + 1; j < n; j++) {
+                const double u = u_row[j];
+                if (u == 0) continue;
+                kernels.axpy(-u, x.m_matrix.row(j) + from, x_row + from, to - from);
+            }
+            const double diagonal = u_row[i];
+            for (size_t c = from; c < to; c++) {
+                x_row[c] /= diagonal;
+            }
+        }
+    });
+}
+
+void LUDecomposition::substitute_rows(Matrix &x) const {
+    const size_t n = order();
+    const size_t width = x.getCols();
+    const SimdKernels &kernels = simd();
+    // Rows [k0, k1) of X depend on rows [k0, k1) of X only through the block's L (or U).
+    auto eliminate = [&](size_t i, size_t k0, size_t k1) {
+        const double *a_row = m_lu.m_matrix.row(i);
+        double *x_row = x.m_matrix.row(i);
+        for (size_t j = k0; j < k1; j++) {
+            if (a_row[j] != 0) kernels.axpy(-a_row[j], x.m_matrix.row(j), x_row, width);
+        }
+    };
+
+    // Forward: substitute the diagonal block serially, then update every row below it in parallel.
+    for (size_t k0 = 0; k0 < n; k0 += kBlock) {
+        const size_t k1 = std::min(n, k0 + kBlock);
+        for (size_t i = k0 + 1; i < k1; i++) eliminate(i, k0, i);
+        ThreadPool::instance().parallel_ranges(k1, n, m_threads, 256, [&](size_t from, size_t to) {
+            for (size_t i = from; i < to; i++) eliminate(i, k0, k1);
+        });
+    }
+    // Backward, block by block from the bottom, updating the rows above.
+    for (size_t k1 = n; k1 > 0;) {
+        const size_t k0 = k1 > kBlock ? k1 - kBlock : 0;
+        for (size_t i = k1; i-- > k0;) {
+            eliminate(i, i + 1, k1);
+            const double diagonal = m_lu.at(i, i);
+            double *x_row = x.m_matrix.row(i);
+            for (size_t c = 0; c < width; c++) x_row[c] /= diagonal;
+        }
+        ThreadPool::instance().parallel_ranges(0, k0, m_threads, 256, [&](size_t from, size_t to) {
+            for (size_t i = from; i < to; i++) eliminate(i, k0, k1);
+        });
+        k1 = k0;
+    }
+}
+
+Matrix LUDecomposition::inverse() const {
+    return solve(Matrix::createDiagonal(order(), 1));
+}
+
+Matrix solve(const Matrix &a, const Matrix &b) {
+    const LUDecomposition factors = a.lu();
+    if (b.getRows() != factors.order()) {
+        throw std::invalid_argument("solve: right-hand side has wrong number of rows");
+    }
+    const double rcond = factors.rcond();
+    if (rcond < std::numeric_limits<double>::epsilon()) {
+        throw SingularMatrixError("solve: matrix is singular to working precision", rcond);
+    }
+    return factors.solve(b);
+}
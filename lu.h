@@ -0,0 +1,132 @@
+#pragma once
+
+#include "matrix.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Thrown by solve and inverse when the matrix is singular (rcond() == 0) or so badly conditioned
+// that the result would carry no correct digits. A std::domain_error, like before it existed.
+class SingularMatrixError final : public std::domain_error {
+public:
+    SingularMatrixError(const std::string &what, double rcond);
+
+    // Estimated reciprocal condition number of the offending matrix.
+    [[nodiscard]] double rcond() const;
+
+private:
+    double m_rcond;
+};
+
+// P * A = L * U of a square matrix, computed once and reused for det, solve, inverse and rank.
+// L (unit lower, diagonal implied) and U share one packed matrix; pivots()[i] is the row that
+// was swapped with row i at step i. Built with a blocked right-looking algorithm: each panel of
+// kBlock columns is factored with partial pivoting and the trailing matrix is updated by gemm.
+class LUDecomposition final {
+public:
+    static constexpr size_t kBlock = 64;
+
+    // Right-hand sides per thread below which solve() parallelizes over rows instead of columns.
+    static constexpr size_t kSolveColumnChunk = 64;
+
+    explicit LUDecomposition(const Matrix &mat, size_t num_of_threads = 1);
+
+    // Factorizes in mat's buffer instead of copying it.
+    explicit LUDecomposition(Matrix &&mat, size_t num_of_threads = 1);
+
+    [[nodiscard]] size_t order() const;
+
+    [[nodiscard]] const Matrix &packed() const;
+
+    [[nodiscard]] const std::vector<size_t> &pivots() const;
+
+    // True if some pivot was exactly zero; solve and inverse throw for such matrices.
+    [[nodiscard]] bool singular() const;
+
+    [[nodiscard]] double det() const;
+
+    // Numerical rank: rank(A) == rank(U) because L is unit lower triangular.
+    [[nodiscard]] size_t rank() const;
+
+    // Estimate of 1 / (||A||_1 * ||A^-1||_1) by Hager's method (a few solves, O(n^2)); 0 if
+    // singular(). Values near machine epsilon mean the solution has lost all its digits.
+    [[nodiscard]] double rcond() const;
+
+    // Solves A * X = B for every column of B. Throws SingularMatrixError if singular().
+    // Wide B is split by columns across the threads; narrow B (a few vectors) is substituted
+    // in row blocks whose updates of the remaining rows run in parallel.
+    [[nodiscard]] Matrix solve(const Matrix &b) const;
+
+    [[nodiscard]] Matrix inverse() const;
+
+private:
+    Matrix m_lu;
+    std::vector<size_t> m_pivots;
+    int m_sign = 1;
+    bool m_singular = false;
+    size_t m_threads = 1;
+    // ||A||_1 of the factored matrix, for rcond().
+    double m_norm1 = 0;
+
+    void factor();
+
+    // In place: x = A^-1 x, or x = A^-T x if transposed.
+    void solve_vector(std::vector<double> &x, bool transposed) const;
+
+    void substitute_columns(Matrix &x) const;
+
+    void substitute_rows(Matrix &x) const;
+
+    void factor_panel(size_t k0, size_t kb);
+
+    void update_trailing(size_t k0, size_t kb);
+};
+
+namespace detail {
+
+// Estimate of ||A^-1||_1 for the rcond() of a factorization: Hager's estimator as refined by
+// Higham, ascending ||A^-1 x||_1 over the unit 1-norm ball. solve(x) and solve_transposed(x)
+// overwrite x with A^-1 x and A^-T x. Infinity if the solves overflow, so that 1 / (||A||_1 * it)
+// is 0.
+template<typename Solve, typename SolveTransposed>
+double hager_inverse_norm1(size_t n, Solve &&solve, SolveTransposed &&solve_transposed) {
+    std::vector<double> x(n, 1.0 / static_cast<double>(n));
+    std::vector<double> z(n);
+    double estimate = 0;
+    size_t last = n;
+    for (size_t iteration = 0; iteration < 5; iteration++) {
+        solve(x);
+        estimate = 0;
+        for (size_t i = 0; i < n; i++) estimate += std::abs(x[i]);
+        for (size_t i = 0; i < n; i++) z[i] = x[i] >= 0 ? 1.0 : -1.0;
+        solve_transposed(z);
+        size_t best = 0;
+        for (size_t i = 1; i < n; i++) {
+            if (std::abs(z[i]) > std::abs(z[best])) best = i;
+        }
+        if (best == last) break;
+        last = best;
+        std::fill(x.begin(), x.end(), 0.0);
+        x[best] = 1;
+    }
+    // Alternating-sign vector, which catches the matrices that fool the ascent.
+    for (size_t i = 0; i < n; i++) {
+        const double ramp = n > 1 ? 1 + static_cast<double>(i) / static_cast<double>(n - 1) : 1;
+        x[i] = i % 2 == 0 ? ramp : -ramp;
+    }
+    solve(x);
+    double alternative = 0;
+    for (size_t i = 0; i < n; i++) alternative += std::abs(x[i]);
+    estimate = std::max(estimate, 2 * alternative / (3 * static_cast<double>(n)));
+    return std::isfinite(estimate) ? estimate : std::numeric_limits<double>::infinity();
+}
+
+}
+
+// X with A * X = B. Throws SingularMatrixError if A is singular or rcond(A) < epsilon,
+// std::invalid_argument for non-square A or a B with the wrong number of rows.
+[[nodiscard]] Matrix solve(const Matrix &a, const Matrix &b);
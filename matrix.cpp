@@ -1,6 +1,14 @@
 #include  "matrix.h"
-#include <thread>
-#include <future>
+#include "gemm.h"
+#include "thread_pool.h"
+#include "lu.h"
+#include "cholesky.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
 
 
 size_t Matrix::size() const
@@ -8,25 +16,18 @@ size_t Matrix::size() const
     return getCols() * getRows();
 }
 
-Matrix::Matrix(size_t rank) 
-{
-    m_matrix.resize(rank);
-    for (size_t i = 0; i < rank; i++) {
-        m_matrix[i].resize(rank);
-    }
-}
+Matrix::Matrix(size_t rank, std::pmr::memory_resource *resource) : m_matrix(rank, rank, resource) {}
 
-Matrix::Matrix(size_t nRows, size_t nCols, double value)
+Matrix::Matrix(size_t nRows, size_t nCols, double value, std::pmr::memory_resource *resource)
+        : m_matrix(nRows, nCols, resource)
 {
-    m_matrix.resize(nRows);
-    for (size_t i = 0; i < nRows; i++) {
-        m_matrix[i].resize(nCols);
-        for (size_t j = 0; j < nCols; j++) {
-            m_matrix[i][j] = value;
-        }
-    }
+    if (value != 0) fill(value);
 }
 
+Matrix::Matrix(const Matrix &another, std::pmr::memory_resource *resource)
+        : m_multithread(another.m_multithread), m_contraints(another.m_contraints),
+          m_matrix(another.m_matrix, resource) {}
+
 void Matrix::multithreadingOn() {
     m_multithread = true;
 }
@@ -35,37 +36,88 @@ void Matrix::multithreadingOff() {
     m_multithread = false;
 }
 
-Matrix operator+(const Matrix &first, const Matrix &second) {
+Matrix operator*(const Matrix &first, const Matrix &second) {
     return first.m_multithread or second.m_multithread ?
-           first.fast_sum_with(second, std::thread::hardware_concurrency()) : first.sum_with(second);
+           first.fast_multiply_with(second, ThreadPool::instance().concurrency()) : first.multiply_with(second);
 }
 
-Matrix operator*(const Matrix &first, const Matrix &second) {
-    return first.m_multithread or second.m_multithread ?
-           first.fast_multiply_with(second, std::thread::hardware_concurrency()) : first.multiply_with(second);
+
+double Matrix::det() const & {
+    return lu().det();
 }
 
+double Matrix::det() && {
+    return std::move(*this).lu().det();
+}
 
-Matrix operator-(const Matrix &first, const Matrix &second) {
-    return first.m_multithread or second.m_multithread ?
-           first.fast_subtract_with(second, std::thread::hardware_concurrency()) : first.subtract_with(second);
+LUDecomposition Matrix::lu() const & {
+    if (!m_multithread) return LUDecomposition(*this, 1);
+    const size_t n = getRows();
+    return LUDecomposition(*this, plan_threads(m_contraints.m_maxRowsDet,
+                                               WorkEstimate::lu(n, LUDecomposition::kBlock),
+                                               ThreadPool::instance().concurrency()));
 }
 
-double Matrix::det() const {
-    if(m_multithread){
-//        double det = 1;
-//        fast_det(*this, std::thread::hardware_concurrency(), det);
-        return fast_det(*this, std::thread::hardware_concurrency());
+LUDecomposition Matrix::lu() && {
+    const size_t n = getRows();
+    const size_t threads = !m_multithread ? 1 : plan_threads(m_contraints.m_maxRowsDet,
+                                                             WorkEstimate::lu(n, LUDecomposition::kBlock),
+                                                             ThreadPool::instance().concurrency());
+    return LUDecomposition(std::move(*this), threads);
+}
+
+CholeskyDecomposition Matrix::cholesky() const & {
+    if (!m_multithread) return CholeskyDecomposition(*this, 1);
+    return CholeskyDecomposition(*this, plan_threads(m_contraints.m_maxRowsDet,
+                                                     WorkEstimate::cholesky(getRows(), CholeskyDecomposition::kBlock),
+                                                     ThreadPool::instance().concurrency()));
+}
+
+CholeskyDecomposition Matrix::cholesky() && {
+    const size_t threads = !m_multithread ? 1 : plan_threads(m_contraints.m_maxRowsDet,
+                                                             WorkEstimate::cholesky(getRows(), CholeskyDecomposition::kBlock),
+                                                             ThreadPool::instance().concurrency());
+    return CholeskyDecomposition(std::move(*this), threads);
+}
+
+Matrix Matrix::inverse() const {
+    const LUDecomposition factors = lu();
+    const double rcond = factors.rcond();
+    if (rcond < std::numeric_limits<double>::epsilon()) {
+        throw SingularMatrixError("Matrix::inverse: matrix is singular to working precision", rcond);
     }
-    else{
-        return fast_det(*this, 1);
+    return factors.inverse();
+}
+
+void Matrix::reshape(size_t nRows, size_t nCols) {
+    if (getRows() != nRows || getCols() != nCols) {
+        m_matrix = MatrixStorage<double>::uninitialized(nRows, nCols, m_matrix.resource());
     }
 }
 
+void Matrix::reshape_untouched(size_t nRows, size_t nCols) {
+    if (getRows() != nRows || getCols() != nCols) {
+        m_matrix = MatrixStorage<double>::untouched(nRows, nCols, m_matrix.resource());
+    }
+}
+
+bool Matrix::add_inplace(const Matrix &another) {
+    if (getRows() != another.getRows() || getCols() != another.getCols()) return false;
+    *this += another;
+    return true;
+}
+
+bool Matrix::sub_inplace(const Matrix &another) {
+    if (getRows() != another.getRows() || getCols() != another.getCols()) return false;
+    *this -= another;
+    return true;
+}
+
 bool Matrix::operator==(const Matrix &another) const {
     if (getRows() != another.getRows() || getCols() != another.getCols()) return false;
     for (size_t i = 0; i < getRows(); i++) {
-        if (m_matrix[i] != another.m_matrix[i]) return false;
+        const double *lhs = m_matrix.row(i);
+        if (!std::equal(lhs, lhs + getCols(), another.m_matrix.row(i))) return false;
     }
     return true;
 }
@@ -79,7 +131,7 @@ Matrix Matrix::createDiagonal(size_t rank, double value) {
     auto diagonal = Matrix(rank, rank);
 
     for (size_t i = 0; i < rank; i++) {
-        diagonal.m_matrix[i][i] = value;
+        diagonal.m_matrix(i, i) = value;
     }
 
     return diagonal;
@@ -88,104 +140,138 @@ Matrix Matrix::createDiagonal(size_t rank, double value) {
 
 void Matrix::fill(double value) {
     for (size_t i = 0; i < getRows(); i++) {
-        for (size_t j = 0; j < getCols(); j++) {
-            m_matrix[i][j] = value;
-        }
+        std::fill_n(m_matrix.row(i), getCols(), value);
     }
 }
 
 size_t Matrix::getCols() const{
-    return m_matrix[0].size();
+    return m_matrix.cols();
 }
 
 size_t Matrix::getRows() const {
-    return m_matrix.size();
+    return m_matrix.rows();
 }
 
 Matrix Matrix::sum_with(const Matrix &another) const {
-    const size_t rows = getRows();
-    const size_t cols = getCols();
-    if (rows != another.getRows() || cols != another.getCols()) {
-        return {};
-    }
-    Matrix sum(rows, cols);
-    for (size_t i = 0; i < rows; i++) {
-        for (size_t j = 0; j < cols; j++) {
-            sum.m_matrix[i][j] = m_matrix[i][j] + another.m_matrix[i][j];
-        }
-    }
+    Matrix sum;
+    evaluate(*this + another, sum, 1);
     return sum;
 }
 
 Matrix Matrix::subtract_with(const Matrix &another) const {
-    const size_t rows = getRows();
-    const size_t cols = getCols();
-    if (rows != another.getRows() or cols != another.getCols()) {
-        return {};
-    }
-    Matrix subtract(rows, cols);
-    for (size_t i = 0; i < rows; i++) {
-        for (size_t j = 0; j < cols; j++) {
-            subtract.m_matrix[i][j] = m_matrix[i][j] - another.m_matrix[i][j];
-        }
-    }
+    Matrix subtract;
+    evaluate(*this - another, subtract, 1);
     return subtract;
 }
 
+Matrix &Matrix::operator*=(double alpha) {
+    evaluate(alpha * *this, *this, detail::expression_threads(alpha * *this));
+    return *this;
+}
+
 Matrix Matrix::multiply_with(const Matrix &another) const {
     const size_t rows = getRows();
     const size_t cols = getCols();
-    Matrix result(rows, another.getCols());
-    for (size_t i = 0; i < result.getRows(); i++) {
-        for (size_t j = 0; j < result.getCols(); j++) {
-            for (size_t k = 0; k < result.getCols(); k++) {
-                result.m_matrix[i][j] += m_matrix[i][k] * another.m_matrix[k][j];
-            }
-        }
+    if (cols != another.getRows()) {
+        return {};
     }
+    Matrix result(rows, another.getCols());
+    gemm(rows, another.getCols(), cols, 1.0,
+         data(), stride(), another.data(), another.stride(), result.data(), result.stride());
     return result;
 }
 
 
 Matrix Matrix::minor(const Matrix &mat, size_t col_index) {
-    auto col_idx = static_cast<long>(col_index);
-    Matrix sub_mat(mat.getRows() - 1);
-    for (size_t i = 1; i < mat.getCols(); i++) {
-        const std::vector<double> &temp_row = mat.m_matrix[i];
-        std::copy(temp_row.begin(), temp_row.begin() + col_idx, sub_mat.m_matrix[i - 1].begin());
-        std::copy(temp_row.begin() + col_idx + 1, temp_row.end(), sub_mat.m_matrix[i - 1].begin() + col_idx);
-    }
+    Matrix sub_mat;
+    minor_into(mat, col_index, sub_mat);
     return sub_mat;
 }
 
-size_t Matrix::col_max(const size_t column) const{
-    double max = std::abs(m_matrix[column][column]);
-    auto max_pos = column;
-    for (auto i = column + 1; i < getRows(); ++i) {
-        double element = std::abs(m_matrix[i][column]);
-        if (element > max) {
-            max = element;
-            max_pos = i;
-        }
+void Matrix::minor_into(const Matrix &mat, size_t col_index, Matrix &sub_mat) {
+    sub_mat.reshape(mat.getRows() - 1, mat.getCols() - 1);
+    for (size_t i = 1; i < mat.getRows(); i++) {
+        const double *temp_row = mat.m_matrix.row(i);
+        double *sub_row = sub_mat.m_matrix.row(i - 1);
+        std::copy_n(temp_row, col_index, sub_row);
+        std::copy(temp_row + col_index + 1, temp_row + mat.getCols(), sub_row + col_index);
     }
-    return max_pos;
+}
+
+size_t Matrix::col_max(const size_t column) const{
+    return column + simd().iamax(m_matrix.row(column) + column, getRows() - column, stride());
 }
 
 double& Matrix::at(size_t i, size_t j) {
-    return m_matrix[i][j];
+    return m_matrix(i, j);
+}
+
+const double& Matrix::at(size_t i, size_t j) const {
+    return m_matrix(i, j);
+}
+
+double *Matrix::data() {
+    return m_matrix.data();
+}
+
+const double *Matrix::data() const {
+    return m_matrix.data();
+}
+
+size_t Matrix::stride() const {
+    return m_matrix.stride();
+}
+
+std::pmr::memory_resource *Matrix::resource() const {
+    return m_matrix.resource();
+}
+
+Matrix Matrix::view_of(double *data, size_t nRows, size_t nCols, std::shared_ptr<void> keepalive) {
+    if (keepalive == nullptr) {
+        throw std::invalid_argument("Matrix::view_of: keepalive must not be null");
+    }
+    if (reinterpret_cast<uintptr_t>(data) % kMatrixAlignment != 0) {
+        throw std::invalid_argument("Matrix::view_of: data is not aligned to kMatrixAlignment");
+    }
+    Matrix view;
+    view.m_matrix = MatrixStorage<double>::view(data, nRows, nCols, std::move(keepalive));
+    return view;
+}
+
+bool Matrix::is_view() const {
+    return m_matrix.is_view();
+}
+
+RowView<double> Matrix::row(size_t i) {
+    return m_matrix.row_view(i);
+}
+
+RowView<const double> Matrix::row(size_t i) const {
+    return m_matrix.row_view(i);
+}
+
+ColView<double> Matrix::col(size_t j) {
+    return m_matrix.col_view(j);
+}
+
+ColView<const double> Matrix::col(size_t j) const {
+    return m_matrix.col_view(j);
 }
 
 void Matrix::swap_rows(const size_t i, const size_t j) {
-    std::swap(m_matrix[i], m_matrix[j]);
+    m_matrix.swap_rows(i, j);
 }
 
 void Matrix::triangulation(Matrix& mat, const size_t current, const size_t begin, const size_t end)
 {
+    const double *pivot_row = mat.m_matrix.row(current);
+    const double pivot = pivot_row[current];
+    const size_t cols = mat.getCols();
+    const SimdKernels &kernels = simd();
     for (auto j = begin; j < end; ++j) {
-        const auto mul = - mat.at(j, current) / mat.at(current, current);
-        for (auto k = current; k < mat.getRows(); ++k) {
-            mat.at(j, k) += mat.at(current, k) * mul;
-        }
+        double *row = mat.m_matrix.row(j);
+        const auto mul = - row[current] / pivot;
+        kernels.axpy(mul, pivot_row + current, row + current, cols - current);
     }
 }
 
@@ -194,8 +280,151 @@ void Matrix::setContraints(const Matrix::MultithreadMatrixContraints& constraint
     m_contraints = constraints;
 }
 
+size_t Matrix::plan_threads(size_t rows_per_thread, const WorkEstimate &work, size_t num_of_threads) const {
+    num_of_threads = std::max<size_t>(num_of_threads, 1);
+    if (rows_per_thread != 0) {
+        return std::min(getRows() / rows_per_thread + 1, num_of_threads);
+    }
+    return CostModel::instance().threads_for(work, num_of_threads);
+}
 
+Matrix Matrix::transposed(size_t num_of_threads) const {
+    const size_t rows = getRows();
+    const size_t cols = getCols();
+    Matrix result;
+    result.reshape(cols, rows);
+    const size_t tiles = (cols + kTransposeTile - 1) / kTransposeTile;
+    const size_t threads = CostModel::instance().threads_for(WorkEstimate::elementwise(rows, cols, 1),
+                                                             std::max<size_t>(num_of_threads, 1));
+    // Tile row t of the result holds source columns [t * kTransposeTile, ...).
+    ThreadPool::instance().parallel_ranges(0, tiles, threads, 1, [&](size_t from, size_t to) {
+        for (size_t t = from; t < to; t++) {
+            const size_t j0 = t * kTransposeTile;
+            const size_t j1 = std::min(cols, j0 + kTransposeTile);
+            for (size_t i0 = 0; i0 < rows; i0 += kTransposeTile) {
+                const size_t i1 = std::min(rows, i0 + kTransposeTile);
+                for (size_t j = j0; j < j1; j++) {
+                    double *out = result.m_matrix.row(j);
+                    for (size_t i = i0; i < i1; i++) {
+                        out[i] = m_matrix(i, j);
+                    }
+                }
+            }
+        }
+    });
+    return result;
+}
 
+void Matrix::transpose_inplace(size_t num_of_threads) {
+    const size_t n = getRows();
+    if (n != getCols()) {
+        *this = transposed(num_of_threads);
+        return;
+    }
+    const size_t tiles = (n + kTransposeTile - 1) / kTransposeTile;
+    const size_t threads = CostModel::instance().threads_for(WorkEstimate::elementwise(n, n, 1),
+                                                             std::max<size_t>(num_of_threads, 1));
+    // Tile row t swaps its tiles right of the diagonal with their mirrors below it; every pair
+    // is touched by exactly one tile row, so the rows need no synchronization.
+    ThreadPool::instance().parallel_ranges(0, tiles, threads, 1, [&](size_t from, size_t to) {
+        for (size_t t = from; t < to; t++) {
+            const size_t i0 = t * kTransposeTile;
+            const size_t i1 = std::min(n, i0 + kTransposeTile);
+            for (size_t i = i0; i < i1; i++) {
+                for (size_t j = i + 1; j < i1; j++) {
+                    std::swap(m_matrix(i, j), m_matrix(j, i));
+                }
+            }
+            // Off-diagonal pairs go through a tile buffer, so both tiles are walked row by row.
+            alignas(64) double buffer[kTransposeTile][kTransposeTile];
+            for (size_t j0 = i1; j0 < n; j0 += kTransposeTile) {
+                const size_t j1 = std::min(n, j0 + kTransposeTile);
+                for (size_t i = i0; i < i1; i++) {
+                    std::copy(m_matrix.row(i) + j0, m_matrix.row(i) + j1, buffer[i - i0]);
+                }
+                for (size_t j = j0; j < j1; j++) {
+                    const double *lower = m_matrix.row(j);
+                    for (size_t i = i0; i < i1; i++) {
+                        m_matrix(i, j) = lower[i];
+                    }
+                }
+                for (size_t j = j0; j < j1; j++) {
+                    double *lower = m_matrix.row(j);
+                    for (size_t i = i0; i < i1; i++) {
+                        lower[i] = buffer[i - i0][j - j0];
+                    }
+                }
+            }
+        }
+    });
+}
 
+Matrix multiply(const Matrix &a, const Matrix &b, bool transA, bool transB) {
+    Matrix result;
+    multiply_into(a, b, result, transA, transB, ThreadPool::instance().concurrency());
+    return result;
+}
 
+void multiply_into(const Matrix &a, const Matrix &b, Matrix &out, bool transA, bool transB, size_t num_of_threads) {
+    const size_t m = transA ? a.getCols() : a.getRows();
+    const size_t k = transA ? a.getRows() : a.getCols();
+    const size_t n = transB ? b.getRows() : b.getCols();
+    if (k != (transB ? b.getCols() : b.getRows())) {
+        out = Matrix();
+        return;
+    }
+    if (&out == &a || &out == &b) {
+        Matrix result;
+        multiply_into(a, b, result, transA, transB, num_of_threads);
+        out = std::move(result);
+        return;
+    }
+    if (out.getRows() != m || out.getCols() != n) {
+        out = Matrix(m, n, 0, out.resource());
+    } else {
+        out.fill(0);
+    }
+    const size_t threads = CostModel::instance().threads_for(WorkEstimate::multiply(m, n, k),
+                                                             std::max<size_t>(num_of_threads, 1));
+    const size_t lda = a.stride(), ldb = b.stride(), ldc = out.stride();
+    ThreadPool::instance().parallel_ranges(0, m, threads, GemmBlocking::MR * 8, [&](size_t from, size_t to) {
+        // Rows [from, to) of op(A) start at column `from` of a transposed A.
+        const double *a_rows = transA ? a.data() + from : a.data() + from * lda;
+        gemm(transA, transB, to - from, n, k, 1.0, a_rows, lda, b.data(), ldb, out.data() + from * ldc, ldc);
+    });
+}
 
+Matrix gram(const Matrix &a, bool transA, size_t num_of_threads) {
+    const size_t n = transA ? a.getCols() : a.getRows();
+    const size_t k = transA ? a.getRows() : a.getCols();
+    Matrix result(n, n);
+    const size_t lda = a.stride(), ldc = result.stride();
+    WorkEstimate work = WorkEstimate::multiply(n, n, k);
+    work.flops /= 2;
+    const size_t tiles = (n + kGramTile - 1) / kGramTile;
+    work.max_parallelism = tiles;
+    const size_t threads = CostModel::instance().threads_for(work, std::max<size_t>(num_of_threads, 1));
+    // Tile row t computes C[t, t..] = op(A)[t rows] * op(A)^T[t.. columns]; the later rows are
+    // shorter, so the threads take them one by one to stay balanced.
+    auto tile_row = [&](size_t t) {
+        const size_t i0 = t * kGramTile;
+        const size_t rows = std::min(kGramTile, n - i0);
+        const double *lhs = transA ? a.data() + i0 : a.data() + i0 * lda;
+        const double *rhs = transA ? a.data() + i0 : a.data() + i0 * lda;
+        gemm(transA, !transA, rows, n - i0, k, 1.0, lhs, lda, rhs, lda, result.data() + i0 * ldc + i0, ldc);
+    };
+    if (threads <= 1) {
+        for (size_t t = 0; t < tiles; t++) tile_row(t);
+    } else {
+        std::atomic<size_t> next{0};
+        ThreadPool::instance().parallel_for(threads, [&](size_t) {
+            for (size_t t = next.fetch_add(1); t < tiles; t = next.fetch_add(1)) tile_row(t);
+        });
+    }
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < i; j++) {
+            result.at(i, j) = result.at(j, i);
+        }
+    }
+    return result;
+}
@@ -1,22 +1,62 @@
 #pragma once
 
+#include  <cstddef>
 #include  <vector>
+#include  "matrix_storage.h"
+#include  "matrix_expr.h"
+#include  "thread_pool.h"
+#include  "simd_kernels.h"
+#include  "cost_model.h"
+
+class LUDecomposition;
+
+class CholeskyDecomposition;
 
 class Matrix final {
 
+    // Fixed rows-per-thread thresholds. 0 (the default) lets CostModel pick the thread count.
     struct MultithreadMatrixContraints {
-        size_t m_maxRowsSum = 300;
-        size_t m_maxRowsMult = 200;
-        size_t m_maxRowsDet = 2;
-        size_t m_maxRowsPerThread = 100;
+        size_t m_maxRowsSum = 0;
+        size_t m_maxRowsMult = 0;
+        size_t m_maxRowsDet = 0;
+        size_t m_maxRowsPerThread = 0;
     };
 
 public:
     Matrix() = default;
 
-    explicit Matrix(size_t rank);
+    // resource: where the buffer comes from; nullptr means the thread's matrix_memory_resource()
+    // (the heap, or the arena of an enclosing ScratchScope).
+    explicit Matrix(size_t rank, std::pmr::memory_resource *resource = nullptr);
+
+    Matrix(size_t nRows, size_t nCols, double value=0, std::pmr::memory_resource *resource = nullptr);
+
+    Matrix(const Matrix &another) = default;
+
+    Matrix(const Matrix &another, std::pmr::memory_resource *resource);
+
+    Matrix(Matrix &&another) noexcept = default;
+
+    // Copies into the existing buffer when the shapes match.
+    Matrix &operator=(const Matrix &another) = default;
+
+    Matrix &operator=(Matrix &&another) noexcept = default;
+
+    // Evaluates a lazy element-wise expression (A + B - 2 * C, ...) in one fused pass.
+    template<MatrixExpression E>
+    Matrix(const E &expr);
+
+    // Reuses the current buffer when the shape already matches.
+    template<MatrixExpression E>
+    Matrix &operator=(const E &expr);
+
+    template<MatrixOperand E>
+    Matrix &operator+=(const E &expr);
 
-    Matrix(size_t nRows, size_t nCols, double value=0);
+    template<MatrixOperand E>
+    Matrix &operator-=(const E &expr);
+
+    Matrix &operator*=(double alpha);
 
     void multithreadingOn();
 
@@ -30,36 +70,106 @@ public:
 
     [[nodiscard]] size_t getRows() const;
 
-    [[nodiscard]] double det() const;
+    [[nodiscard]] double det() const &;
+
+    // No-copy mode: eliminates in this matrix's own buffer, e.g. std::move(m).det().
+    [[nodiscard]] double det() &&;
+
+    // Factorizes once; det, solve, inverse and rank of the result reuse the same factors.
+    [[nodiscard]] LUDecomposition lu() const &;
 
-    friend Matrix operator+(const Matrix &first, const Matrix &second);
+    [[nodiscard]] LUDecomposition lu() &&;
 
-    friend Matrix operator-(const Matrix &first, const Matrix &second);
+    // L * L^T of a symmetric positive-definite matrix (lower triangle read), for det and solve at
+    // half the cost of lu(); check positive_definite() of the result.
+    [[nodiscard]] CholeskyDecomposition cholesky() const &;
+
+    [[nodiscard]] CholeskyDecomposition cholesky() &&;
+
+    // A^-1 through lu(); throws SingularMatrixError like solve(A, B).
+    [[nodiscard]] Matrix inverse() const;
 
     friend Matrix operator*(const Matrix &first, const Matrix &second);
 
     double fast_det(const Matrix &mat, size_t num_of_threads) const;
 
+    // Same as above, but triangulates mat in place instead of copying it first.
+    double fast_det(Matrix &&mat, size_t num_of_threads) const;
+
     [[nodiscard]] Matrix fast_subtract_with(const Matrix &another, size_t num_of_threads) const;
 
     [[nodiscard]] Matrix fast_sum_with(const Matrix &another, size_t num_of_threads) const;
 
     [[nodiscard]] Matrix fast_multiply_with(const Matrix &another, size_t num_of_threads) const;
 
+    // The *_into variants write into out and reuse its buffer when it already has the result's shape.
+    // On a shape mismatch out becomes empty, like the returned {} of the fast_* functions.
+    void sum_into(const Matrix &another, Matrix &out, size_t num_of_threads) const;
+
+    void subtract_into(const Matrix &another, Matrix &out, size_t num_of_threads) const;
+
+    void multiply_into(const Matrix &another, Matrix &out, size_t num_of_threads) const;
+
+    // Copies kTransposeTile x kTransposeTile tiles, so both matrices are read and written whole
+    // cache lines at a time; the tile rows are split across num_of_threads.
+    [[nodiscard]] Matrix transposed(size_t num_of_threads = 1) const;
+
+    // A square matrix swaps the tiles mirrored across the diagonal in its own buffer; any other
+    // shape is transposed into a new buffer from the same resource.
+    void transpose_inplace(size_t num_of_threads = 1);
+
+    // Element-wise update without a temporary; returns false and leaves the matrix untouched on a shape mismatch.
+    bool add_inplace(const Matrix &another);
+
+    bool sub_inplace(const Matrix &another);
+
     bool operator==(const Matrix &another) const;
 
     bool operator!=(const Matrix &another) const;
 
     double &at(size_t i, size_t j);
 
+    [[nodiscard]] const double &at(size_t i, size_t j) const;
+
+    double *data();
+
+    [[nodiscard]] const double *data() const;
+
+    [[nodiscard]] size_t stride() const;
+
+    [[nodiscard]] std::pmr::memory_resource *resource() const;
+
+    // Matrix over memory it does not own: data holds rows x cols with the padded stride
+    // (MatrixStorage<double>::padded_stride(cols)), zeroed padding and kMatrixAlignment alignment,
+    // and stays valid while keepalive (non-null) has owners. Copies of a view own their buffer.
+    // Throws std::invalid_argument if data or keepalive do not meet these requirements.
+    static Matrix view_of(double *data, size_t nRows, size_t nCols, std::shared_ptr<void> keepalive);
+
+    [[nodiscard]] bool is_view() const;
+
+    RowView<double> row(size_t i);
+
+    [[nodiscard]] RowView<const double> row(size_t i) const;
+
+    ColView<double> col(size_t j);
+
+    [[nodiscard]] ColView<const double> col(size_t j) const;
+
     void setContraints(const MultithreadMatrixContraints&);
 
+    // Writes expr into out (resized if needed), splitting the rows between num_of_threads pool tasks.
+    template<MatrixExpression E>
+    static void evaluate(const E &expr, Matrix &out, size_t num_of_threads);
+
+    template<MatrixExpression E>
+    static void evaluate_rows(const E &expr, Matrix &out, size_t begin, size_t end);
+
 private:
     bool m_multithread = false;
 
     MultithreadMatrixContraints m_contraints;
 
-    std::vector<std::vector<double>> m_matrix;
+    MatrixStorage<double> m_matrix;
 
     size_t size() const;
 
@@ -71,11 +181,136 @@ private:
 
     static Matrix minor(const Matrix &mat, size_t col_index);
 
+    static void minor_into(const Matrix &mat, size_t col_index, Matrix &out);
+
+    // Gives the matrix the requested shape, keeping the buffer (and its contents) if it already has it.
+    void reshape(size_t nRows, size_t nCols);
+
+    // Same, but a new buffer is not written at all, padding included (MatrixStorage::untouched).
+    void reshape_untouched(size_t nRows, size_t nCols);
+
     size_t col_max(const size_t column) const;
 
     static void triangulation(Matrix &mat, const size_t current, const size_t begin, const size_t end);
 
+    // fast_det's elimination on num_of_threads > 1 threads, without a join per column.
+    static double pipelined_det(Matrix &mat, size_t num_of_threads);
+
     void swap_rows(const size_t i, const size_t j);
 
+    // Thread count for an operation on this matrix: one thread per rows_per_thread rows when that
+    // threshold is set, otherwise the cost model's choice; never more than num_of_threads.
+    size_t plan_threads(size_t rows_per_thread, const WorkEstimate &work, size_t num_of_threads) const;
+
     friend class CalculationManager;
-};
\ No newline at end of file
+
+    friend class LUDecomposition;
+
+    friend class MatrixLeaf;
+
+    friend void numa_sum_into(const Matrix &a, const Matrix &b, Matrix &out);
+
+    friend void numa_subtract_into(const Matrix &a, const Matrix &b, Matrix &out);
+};
+
+inline MatrixLeaf::MatrixLeaf(const Matrix &mat)
+        : m_data(mat.data()), m_stride(mat.stride()), m_rows(mat.getRows()), m_cols(mat.getCols()),
+          m_parallel_rows(!mat.m_multithread ? 0 :
+                          mat.m_contraints.m_maxRowsSum != 0 ? mat.m_contraints.m_maxRowsSum : kAutoParallelRows) {}
+
+static_assert(std::is_nothrow_move_constructible_v<Matrix> && std::is_nothrow_move_assignable_v<Matrix>);
+
+inline constexpr size_t kTransposeTile = 32;
+
+inline constexpr size_t kGramTile = 64;
+
+// op(A) * op(B), op(X) = X^T if transX. gemm packs the transposed operands straight from their
+// rows, so A^T * B costs the same as A * B and no transposed copy is made. The thread count
+// comes from the cost model; a shape mismatch gives an empty matrix.
+[[nodiscard]] Matrix multiply(const Matrix &a, const Matrix &b, bool transA = false, bool transB = false);
+
+void multiply_into(const Matrix &a, const Matrix &b, Matrix &out, bool transA, bool transB, size_t num_of_threads);
+
+// Gram matrix A^T * A (or A * A^T if transA is false). Only the tiles on and above the diagonal
+// are multiplied and the rest is mirrored, which halves the flops of multiply(A, A, true).
+[[nodiscard]] Matrix gram(const Matrix &a, bool transA = true,
+                          size_t num_of_threads = ThreadPool::instance().concurrency());
+
+template<MatrixExpression E>
+void Matrix::evaluate_rows(const E &expr, Matrix &out, size_t begin, size_t end) {
+    using Leaf = MatrixLeaf;
+    const size_t cols = expr.cols();
+    const SimdKernels &kernels = simd();
+    for (size_t i = begin; i < end; i++) {
+        double *row = out.m_matrix.row(i);
+        // The common shapes go to the dispatched SIMD kernels, everything else is fused generically.
+        if constexpr (std::is_same_v<E, BinaryExpr<PlusOp, Leaf, Leaf>>) {
+            kernels.add(expr.lhs().row(i), expr.rhs().row(i), row, cols);
+        } else if constexpr (std::is_same_v<E, BinaryExpr<MinusOp, Leaf, Leaf>>) {
+            kernels.sub(expr.lhs().row(i), expr.rhs().row(i), row, cols);
+        } else if constexpr (std::is_same_v<E, BinaryExpr<PlusOp, Leaf, ScaledExpr<Leaf>>>) {
+            kernels.add_scaled(expr.lhs().row(i), expr.rhs().alpha(), expr.rhs().expr().row(i), row, cols);
+        } else if constexpr (std::is_same_v<E, BinaryExpr<MinusOp, Leaf, ScaledExpr<Leaf>>>) {
+            kernels.add_scaled(expr.lhs().row(i), -expr.rhs().alpha(), expr.rhs().expr().row(i), row, cols);
+        } else if constexpr (std::is_same_v<E, ScaledExpr<Leaf>>) {
+            kernels.scale(expr.alpha(), expr.expr().row(i), row, cols);
+        } else {
+            const auto in = expr.row(i);
+            for (size_t j = 0; j < cols; j++) {
+                row[j] = in[j];
+            }
+        }
+    }
+}
+
+template<MatrixExpression E>
+void Matrix::evaluate(const E &expr, Matrix &out, size_t num_of_threads) {
+    const size_t rows = expr.rows();
+    out.reshape(rows, expr.cols());
+    const size_t threads_count = std::max<size_t>(1, std::min(num_of_threads, rows));
+    if (threads_count == 1) {
+        evaluate_rows(expr, out, 0, rows);
+        return;
+    }
+    const size_t distance = rows / threads_count;
+    ThreadPool::instance().parallel_for(threads_count, [&](size_t i) {
+        const size_t end = i + 1 == threads_count ? rows : (i + 1) * distance;
+        evaluate_rows(expr, out, i * distance, end);
+    });
+}
+
+namespace detail {
+
+template<MatrixExpression E>
+size_t expression_threads(const E &expr) {
+    const size_t per_thread = expr.parallel_rows();
+    if (per_thread == 0) return 1;
+    const size_t concurrency = ThreadPool::instance().concurrency();
+    if (per_thread == kAutoParallelRows) {
+        return CostModel::instance().threads_for(WorkEstimate::elementwise(expr.rows(), expr.cols()), concurrency);
+    }
+    return std::min(expr.rows() / per_thread + 1, concurrency);
+}
+
+}
+
+template<MatrixExpression E>
+Matrix::Matrix(const E &expr) {
+    evaluate(expr, *this, detail::expression_threads(expr));
+}
+
+template<MatrixExpression E>
+Matrix &Matrix::operator=(const E &expr) {
+    evaluate(expr, *this, detail::expression_threads(expr));
+    return *this;
+}
+
+template<MatrixOperand E>
+Matrix &Matrix::operator+=(const E &expr) {
+    return *this = *this + expr;
+}
+
+template<MatrixOperand E>
+Matrix &Matrix::operator-=(const E &expr) {
+    return *this = *this - expr;
+}
\ No newline at end of file
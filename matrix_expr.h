@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <type_traits>
+
+class Matrix;
+
+// Lazy element-wise expressions. `A + B - C`, `2 * A` and friends only build a small tree of
+// row accessors; nothing is computed until the tree is assigned to a Matrix, which then walks
+// every row once (see Matrix::evaluate). Operands are referenced, not copied: keep the matrices
+// alive until the expression is assigned and do not store expressions built from temporaries.
+//
+// Every node exposes rows(), cols(), parallel_rows() and row(i), where row(i)[j] is element (i, j).
+// A node whose operands have different shapes reports 0 x 0, so assigning it yields an empty
+// Matrix, the same result the eager operators used to return on a shape mismatch.
+// parallel_rows() is the smallest per-thread row count of the multithreaded operands, or 0 if
+// none of them has multithreading on; kAutoParallelRows means the cost model decides.
+
+inline constexpr size_t kAutoParallelRows = static_cast<size_t>(-1);
+
+class MatrixLeaf final {
+public:
+    explicit MatrixLeaf(const Matrix &mat);
+
+    [[nodiscard]] size_t rows() const { return m_rows; }
+
+    [[nodiscard]] size_t cols() const { return m_cols; }
+
+    [[nodiscard]] size_t parallel_rows() const { return m_parallel_rows; }
+
+    [[nodiscard]] const double *row(size_t i) const { return m_data + i * m_stride; }
+
+private:
+    const double *m_data;
+    size_t m_stride;
+    size_t m_rows;
+    size_t m_cols;
+    size_t m_parallel_rows;
+};
+
+template<typename T>
+concept MatrixExpression = requires(const T &e, size_t i) {
+    { e.rows() } -> std::convertible_to<size_t>;
+    { e.cols() } -> std::convertible_to<size_t>;
+    { e.parallel_rows() } -> std::convertible_to<size_t>;
+    { e.row(i)[i] } -> std::convertible_to<double>;
+};
+
+template<typename T>
+concept MatrixOperand = MatrixExpression<T> || std::same_as<T, Matrix>;
+
+template<typename T>
+using expr_node_t = std::conditional_t<std::is_same_v<T, Matrix>, MatrixLeaf, T>;
+
+inline size_t combine_parallel_rows(size_t lhs, size_t rhs) {
+    if (lhs == 0) return rhs;
+    if (rhs == 0) return lhs;
+    return std::min(lhs, rhs);
+}
+
+struct PlusOp {
+    static double apply(double lhs, double rhs) { return lhs + rhs; }
+};
+
+struct MinusOp {
+    static double apply(double lhs, double rhs) { return lhs - rhs; }
+};
+
+template<typename Op, typename L, typename R>
+class BinaryExpr final {
+public:
+    BinaryExpr(const L &lhs, const R &rhs)
+            : m_lhs(lhs), m_rhs(rhs),
+              m_match(lhs.rows() == rhs.rows() && lhs.cols() == rhs.cols()) {}
+
+    [[nodiscard]] size_t rows() const { return m_match ? m_lhs.rows() : 0; }
+
+    [[nodiscard]] size_t cols() const { return m_match ? m_lhs.cols() : 0; }
+
+    [[nodiscard]] size_t parallel_rows() const {
+        return combine_parallel_rows(m_lhs.parallel_rows(), m_rhs.parallel_rows());
+    }
+
+    [[nodiscard]] auto row(size_t i) const {
+        return RowAccessor<decltype(m_lhs.row(i)), decltype(m_rhs.row(i))>{m_lhs.row(i), m_rhs.row(i)};
+    }
+
+    [[nodiscard]] const L &lhs() const { return m_lhs; }
+
+    [[nodiscard]] const R &rhs() const { return m_rhs; }
+
+private:
+    template<typename LR, typename RR>
+    struct RowAccessor {
+        LR lhs;
+        RR rhs;
+
+        double operator[](size_t j) const { return Op::apply(lhs[j], rhs[j]); }
+    };
+
+    L m_lhs;
+    R m_rhs;
+    bool m_match;
+};
+
+template<typename E>
+class ScaledExpr final {
+public:
+    ScaledExpr(double alpha, const E &expr) : m_alpha(alpha), m_expr(expr) {}
+
+    [[nodiscard]] size_t rows() const { return m_expr.rows(); }
+
+    [[nodiscard]] size_t cols() const { return m_expr.cols(); }
+
+    [[nodiscard]] size_t parallel_rows() const { return m_expr.parallel_rows(); }
+
+    [[nodiscard]] auto row(size_t i) const {
+        return RowAccessor<decltype(m_expr.row(i))>{m_alpha, m_expr.row(i)};
+    }
+
+    [[nodiscard]] double alpha() const { return m_alpha; }
+
+    [[nodiscard]] const E &expr() const { return m_expr; }
+
+private:
+    template<typename ER>
+    struct RowAccessor {
+        double alpha;
+        ER expr;
+
+        double operator[](size_t j) const { return alpha * expr[j]; }
+    };
+
+    double m_alpha;
+    E m_expr;
+};
+
+template<MatrixOperand T>
+expr_node_t<T> as_expr(const T &operand) {
+    return expr_node_t<T>(operand);
+}
+
+template<MatrixOperand L, MatrixOperand R>
+auto operator+(const L &lhs, const R &rhs) {
+    return BinaryExpr<PlusOp, expr_node_t<L>, expr_node_t<R>>(as_expr(lhs), as_expr(rhs));
+}
+
+template<MatrixOperand L, MatrixOperand R>
+auto operator-(const L &lhs, const R &rhs) {
+    return BinaryExpr<MinusOp, expr_node_t<L>, expr_node_t<R>>(as_expr(lhs), as_expr(rhs));
+}
+
+template<MatrixOperand T>
+auto operator*(double alpha, const T &operand) {
+    return ScaledExpr<expr_node_t<T>>(alpha, as_expr(operand));
+}
+
+template<MatrixOperand T>
+auto operator*(const T &operand, double alpha) {
+    return ScaledExpr<expr_node_t<T>>(alpha, as_expr(operand));
+}
+
+template<MatrixOperand T>
+auto operator-(const T &operand) {
+    return ScaledExpr<expr_node_t<T>>(-1.0, as_expr(operand));
+}
@@ -0,0 +1,399 @@
+#include "matrix_file.h"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint8_t kHostEndianness = std::endian::native == std::endian::little ?
+                                    MatrixFileHeader::kLittleEndian : MatrixFileHeader::kBigEndian;
+
+constexpr size_t kDataOffset = sizeof(MatrixFileHeader);
+
+static_assert(kDataOffset % kMatrixAlignment == 0);
+
+[[noreturn]] void throw_errno(const std::string &what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Owns a file descriptor for the duration of one call.
+class FileHandle final {
+public:
+    FileHandle(const std::string &path, int flags, mode_t mode = 0) : m_fd(::open(path.c_str(), flags, mode)) {
+        if (m_fd < 0) throw_errno("cannot open " + path);
+    }
+
+    FileHandle(const FileHandle &) = delete;
+
+    FileHandle &operator=(const FileHandle &) = delete;
+
+    ~FileHandle() {
+        if (m_fd >= 0) ::close(m_fd);
+    }
+
+    [[nodiscard]] int get() const { return m_fd; }
+
+    int release() { return std::exchange(m_fd, -1); }
+
+private:
+    int m_fd;
+};
+
+void read_exact(int fd, void *data, size_t bytes, off_t offset) {
+    auto *out = static_cast<char *>(data);
+    while (bytes > 0) {
+        const ssize_t done = ::pread(fd, out, bytes, offset);
+        if (done < 0 && errno == EINTR) continue;
+        if (done < 0) throw_errno("matrix file read failed");
+        if (done == 0) throw std::runtime_error("matrix file is truncated");
+        out += done;
+        bytes -= static_cast<size_t>(done);
+        offset += done;
+    }
+}
+
+void swap_bytes(uint64_t &value) { value = __builtin_bswap64(value); }
+
+void swap_bytes(uint32_t &value) { value = __builtin_bswap32(value); }
+
+void swap_bytes(uint16_t &value) { value = __builtin_bswap16(value); }
+
+void swap_elements(double *data, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        auto bits = std::bit_cast<uint64_t>(data[i]);
+        swap_bytes(bits);
+        data[i] = std::bit_cast<double>(bits);
+    }
+}
+
+// Rows read whole from a file bring its padding along; writers zero it, but a reader cannot rely
+// on that and MatrixStorage requires it.
+void zero_padding(double *data, size_t rows, size_t cols, size_t ld) {
+    if (ld == cols) return;
+    for (size_t i = 0; i < rows; i++) {
+        std::fill(data + i * ld + cols, data + (i + 1) * ld, 0.0);
+    }
+}
+
+bool padding_is_zero(const double *data, size_t rows, size_t cols, size_t ld) {
+    for (size_t i = 0; i < rows && ld != cols; i++) {
+        const double *row = data + i * ld;
+        if (!std::all_of(row + cols, row + ld, [](double value) { return value == 0.0; })) return false;
+    }
+    return true;
+}
+
+MatrixFileHeader make_header(size_t rows, size_t cols) {
+    MatrixFileHeader header{};
+    std::memcpy(header.magic, MatrixFileHeader::kMagic, sizeof(header.magic));
+    header.version = MatrixFileHeader::kVersion;
+    header.header_size = sizeof(MatrixFileHeader);
+    header.dtype = MatrixFileHeader::kFloat64;
+    header.endianness = kHostEndianness;
+    header.alignment = kMatrixAlignment;
+    header.rows = rows;
+    header.cols = cols;
+    header.stride = MatrixStorage<double>::padded_stride(cols);
+    header.data_offset = kDataOffset;
+    return header;
+}
+
+// Reads and validates the header, converting it to host byte order. Sets `foreign` if the elements
+// are stored in the other byte order.
+MatrixFileHeader read_header(int fd, bool &foreign) {
+    MatrixFileHeader header{};
+    read_exact(fd, &header, sizeof(header), 0);
+    if (std::memcmp(header.magic, MatrixFileHeader::kMagic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("not a matrix file (bad magic)");
+    }
+    if (header.endianness != MatrixFileHeader::kLittleEndian && header.endianness != MatrixFileHeader::kBigEndian) {
+        throw std::runtime_error("matrix file has an unknown byte order");
+    }
+    foreign = header.endianness != kHostEndianness;
+    if (foreign) {
+        swap_bytes(header.version);
+        swap_bytes(header.header_size);
+        swap_bytes(header.reserved0);
+        swap_bytes(header.alignment);
+        swap_bytes(header.rows);
+        swap_bytes(header.cols);
+        swap_bytes(header.stride);
+        swap_bytes(header.data_offset);
+    }
+    if (header.version != MatrixFileHeader::kVersion) {
+        throw std::runtime_error("unsupported matrix file version " + std::to_string(header.version));
+    }
+    if (header.dtype != MatrixFileHeader::kFloat64) {
+        throw std::runtime_error("unsupported matrix element type");
+    }
+    if (header.header_size < sizeof(MatrixFileHeader) || header.data_offset < header.header_size ||
+        header.stride < header.cols) {
+        throw std::runtime_error("malformed matrix file header");
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) throw_errno("cannot stat matrix file");
+    if (header.stride != 0 && header.rows > (UINT64_MAX - header.data_offset) / sizeof(double) / header.stride) {
+        throw std::runtime_error("malformed matrix file header");
+    }
+    const uint64_t bytes = header.rows * header.stride * sizeof(double);
+    if (static_cast<uint64_t>(st.st_size) < header.data_offset + bytes) {
+        throw std::runtime_error("matrix file is truncated");
+    }
+    return header;
+}
+
+void write_exact(int fd, const void *data, size_t bytes, off_t offset) {
+    const auto *in = static_cast<const char *>(data);
+    while (bytes > 0) {
+        const ssize_t done = ::pwrite(fd, in, bytes, offset);
+        if (done < 0 && errno == EINTR) continue;
+        if (done < 0) throw_errno("matrix file write failed");
+        in += done;
+        bytes -= static_cast<size_t>(done);
+        offset += done;
+    }
+}
+
+Matrix read_elements(int fd, const MatrixFileHeader &header, bool foreign) {
+    const auto rows = static_cast<size_t>(header.rows);
+    const auto cols = static_cast<size_t>(header.cols);
+    Matrix mat(rows, cols);
+    if (rows == 0 || cols == 0) return mat;
+    if (header.stride == mat.stride()) {
+        read_exact(fd, mat.data(), rows * mat.stride() * sizeof(double), static_cast<off_t>(header.data_offset));
+        zero_padding(mat.data(), rows, cols, mat.stride());
+    } else {
+        for (size_t i = 0; i < rows; i++) {
+            const auto offset = header.data_offset + i * header.stride * sizeof(double);
+            read_exact(fd, mat.row(i).data(), cols * sizeof(double), static_cast<off_t>(offset));
+        }
+    }
+    if (foreign) {
+        for (size_t i = 0; i < rows; i++) {
+            swap_elements(mat.row(i).data(), cols);
+        }
+    }
+    return mat;
+}
+
+}
+
+void save_matrix(const Matrix &mat, const std::string &path) {
+    MatrixFileWriter writer(path, mat.getRows(), mat.getCols());
+    writer.write_rows(mat);
+    writer.close();
+}
+
+Matrix load_matrix(const std::string &path) {
+    FileHandle file(path, O_RDONLY | O_CLOEXEC);
+    bool foreign = false;
+    const MatrixFileHeader header = read_header(file.get(), foreign);
+    return read_elements(file.get(), header, foreign);
+}
+
+Matrix map_matrix(const std::string &path) {
+    FileHandle file(path, O_RDONLY | O_CLOEXEC);
+    bool foreign = false;
+    const MatrixFileHeader header = read_header(file.get(), foreign);
+    const auto rows = static_cast<size_t>(header.rows);
+    const auto cols = static_cast<size_t>(header.cols);
+    if (foreign || header.stride != MatrixStorage<double>::padded_stride(cols) ||
+        header.data_offset % kMatrixAlignment != 0) {
+        return read_elements(file.get(), header, foreign);
+    }
+    if (rows == 0 || cols == 0) return Matrix(rows, cols);
+
+    const size_t length = header.data_offset + rows * header.stride * sizeof(double);
+    void *base = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, file.get(), 0);
+    if (base == MAP_FAILED) throw_errno("cannot map " + path);
+    // The mapping outlives the descriptor; it is unmapped when the last view of it goes away.
+    std::shared_ptr<void> mapping(base, [length](void *p) { ::munmap(p, length); });
+    auto *data = reinterpret_cast<double *>(static_cast<char *>(base) + header.data_offset);
+    // Zeroing padding in place would copy every page; a file that needs it is loaded instead.
+    if (!padding_is_zero(data, rows, cols, header.stride)) return read_elements(file.get(), header, foreign);
+    return Matrix::view_of(data, rows, cols, std::move(mapping));
+}
+
+MatrixFile::MatrixFile(const std::string &path, bool writable) {
+    FileHandle file(path, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    m_header = read_header(file.get(), m_foreign);
+    m_writable = writable;
+    m_fd = file.release();
+}
+
+MatrixFile MatrixFile::create(const std::string &path, size_t rows, size_t cols) {
+    FileHandle file(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    MatrixFile created;
+    created.m_header = make_header(rows, cols);
+    write_exact(file.get(), &created.m_header, sizeof(created.m_header), 0);
+    // The elements stay a hole in the file until written, so creating is O(1) and reads give zeros.
+    const auto size = static_cast<off_t>(created.offset(rows, 0));
+    if (::ftruncate(file.get(), size) != 0) throw_errno("cannot resize " + path);
+    created.m_writable = true;
+    created.m_fd = file.release();
+    return created;
+}
+
+MatrixFile::MatrixFile(MatrixFile &&other) noexcept
+        : m_fd(std::exchange(other.m_fd, -1)), m_writable(other.m_writable), m_foreign(other.m_foreign),
+          m_header(other.m_header) {}
+
+MatrixFile &MatrixFile::operator=(MatrixFile &&other) noexcept {
+    if (this != &other) {
+        if (m_fd >= 0) ::close(m_fd);
+        m_fd = std::exchange(other.m_fd, -1);
+        m_writable = other.m_writable;
+        m_foreign = other.m_foreign;
+        m_header = other.m_header;
+    }
+    return *this;
+}
+
+MatrixFile::~MatrixFile() {
+    if (m_fd >= 0) ::close(m_fd);
+}
+
+size_t MatrixFile::rows() const {
+    return static_cast<size_t>(m_header.rows);
+}
+
+size_t MatrixFile::cols() const {
+    return static_cast<size_t>(m_header.cols);
+}
+
+uint64_t MatrixFile::offset(size_t row, size_t col) const {
+    return m_header.data_offset + (row * m_header.stride + col) * sizeof(double);
+}
+
+void MatrixFile::check_block(size_t row, size_t col, size_t nRows, size_t nCols) const {
+    if (row > rows() || nRows > rows() - row || col > cols() || nCols > cols() - col) {
+        throw std::out_of_range("MatrixFile: block is outside the matrix");
+    }
+}
+
+void MatrixFile::read_block(size_t row, size_t col, size_t nRows, size_t nCols, double *data, size_t ld) const {
+    check_block(row, col, nRows, nCols);
+    if (nRows == 0 || nCols == 0) return;
+    if (col == 0 && nCols == cols() && ld == m_header.stride) {
+        read_exact(m_fd, data, nRows * ld * sizeof(double), static_cast<off_t>(offset(row, 0)));
+        zero_padding(data, nRows, nCols, ld);
+    } else {
+        for (size_t i = 0; i < nRows; i++) {
+            read_exact(m_fd, data + i * ld, nCols * sizeof(double), static_cast<off_t>(offset(row + i, col)));
+        }
+    }
+    if (m_foreign) {
+        for (size_t i = 0; i < nRows; i++) {
+            swap_elements(data + i * ld, nCols);
+        }
+    }
+}
+
+void MatrixFile::write_block(size_t row, size_t col, size_t nRows, size_t nCols, const double *data, size_t ld) {
+    if (!m_writable || m_foreign) {
+        throw std::logic_error("MatrixFile: file is not writable in the native byte order");
+    }
+    check_block(row, col, nRows, nCols);
+    if (nRows == 0 || nCols == 0) return;
+    if (col == 0 && nCols == cols() && ld == m_header.stride) {
+        write_exact(m_fd, data, nRows * ld * sizeof(double), static_cast<off_t>(offset(row, 0)));
+        return;
+    }
+    for (size_t i = 0; i < nRows; i++) {
+        write_exact(m_fd, data + i * ld, nCols * sizeof(double), static_cast<off_t>(offset(row + i, col)));
+    }
+}
+
+void MatrixFile::read_block(size_t row, size_t col, Matrix &block) const {
+    read_block(row, col, block.getRows(), block.getCols(), block.data(), block.stride());
+}
+
+void MatrixFile::write_block(size_t row, size_t col, const Matrix &block) {
+    write_block(row, col, block.getRows(), block.getCols(), block.data(), block.stride());
+}
+
+MatrixFileWriter::MatrixFileWriter(const std::string &path, size_t rows, size_t cols)
+        : m_rows(rows), m_cols(cols), m_stride(MatrixStorage<double>::padded_stride(cols)) {
+    FileHandle file(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    m_fd = file.get();
+    const MatrixFileHeader header = make_header(rows, cols);
+    write_bytes(&header, sizeof(header));
+    m_fd = file.release();
+}
+
+MatrixFileWriter::~MatrixFileWriter() {
+    if (m_fd >= 0) ::close(m_fd);
+}
+
+void MatrixFileWriter::write_bytes(const void *data, size_t bytes) {
+    const auto *in = static_cast<const char *>(data);
+    while (bytes > 0) {
+        const ssize_t done = ::write(m_fd, in, bytes);
+        if (done < 0 && errno == EINTR) continue;
+        if (done < 0) throw_errno("matrix file write failed");
+        in += done;
+        bytes -= static_cast<size_t>(done);
+    }
+}
+
+void MatrixFileWriter::write_row(const double *row) {
+    if (m_fd < 0 || m_written == m_rows) {
+        throw std::logic_error("MatrixFileWriter: no more rows expected");
+    }
+    static constexpr double kZeros[kMatrixAlignment / sizeof(double)] = {};
+    const size_t padding = (m_stride - m_cols) * sizeof(double);
+    iovec parts[2] = {{const_cast<double *>(row), m_cols * sizeof(double)},
+                      {const_cast<double *>(kZeros), padding}};
+    ssize_t done;
+    do {
+        done = ::writev(m_fd, parts, padding != 0 ? 2 : 1);
+    } while (done < 0 && errno == EINTR);
+    if (done < 0) throw_errno("matrix file write failed");
+    // Finish a short write piece by piece.
+    auto written = static_cast<size_t>(done);
+    for (const iovec &part: parts) {
+        const size_t skip = std::min(written, part.iov_len);
+        write_bytes(static_cast<const char *>(part.iov_base) + skip, part.iov_len - skip);
+        written -= skip;
+    }
+    m_written++;
+}
+
+void MatrixFileWriter::write_rows(const Matrix &block) {
+    if (block.getCols() != m_cols) {
+        throw std::invalid_argument("MatrixFileWriter::write_rows: block has the wrong number of columns");
+    }
+    if (m_fd < 0 || block.getRows() > m_rows - m_written) {
+        throw std::logic_error("MatrixFileWriter: more rows than announced");
+    }
+    // In-memory rows already have the file layout, padding included: one write for the whole block.
+    write_bytes(block.data(), block.getRows() * block.stride() * sizeof(double));
+    m_written += block.getRows();
+}
+
+size_t MatrixFileWriter::rows_written() const {
+    return m_written;
+}
+
+size_t MatrixFileWriter::cols() const {
+    return m_cols;
+}
+
+void MatrixFileWriter::close() {
+    if (m_fd < 0) return;
+    const int fd = std::exchange(m_fd, -1);
+    if (::close(fd) != 0) throw_errno("matrix file close failed");
+    if (m_written != m_rows) {
+        throw std::runtime_error("MatrixFileWriter: " + std::to_string(m_written) + " of " +
+                                 std::to_string(m_rows) + " rows written");
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "matrix.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Binary matrix file, version 1. A 64-byte header is followed by the elements exactly as they
+// sit in memory: rows of `stride` elements (MatrixStorage padded stride, zero padding), starting
+// at data_offset, which is a multiple of `alignment`. Header fields and elements are stored in
+// the writer's byte order, recorded in `endianness`; readers on the other byte order swap them.
+struct MatrixFileHeader {
+    static constexpr char kMagic[8] = {'P', 'P', 'M', 'A', 'T', 'R', 'I', 'X'};
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint8_t kFloat64 = 1;
+    static constexpr uint8_t kLittleEndian = 1;
+    static constexpr uint8_t kBigEndian = 2;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint8_t dtype;
+    uint8_t endianness;
+    uint16_t reserved0;
+    uint32_t alignment;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t stride;
+    uint64_t data_offset;
+    uint64_t reserved1;
+};
+
+static_assert(sizeof(MatrixFileHeader) == 64);
+
+// Writes mat in a single pass straight from its buffer.
+void save_matrix(const Matrix &mat, const std::string &path);
+
+// Reads the whole file into an owning Matrix allocated from the current matrix_memory_resource().
+[[nodiscard]] Matrix load_matrix(const std::string &path);
+
+// Maps the file (MAP_PRIVATE) and returns a view over the mapped elements without copying them:
+// pages are read on first touch and shared with every other process mapping the same file. The
+// view is writable rather than read-only, because Matrix has no read-only form: writes through it
+// go to private copy-on-write pages and never reach the file. Copy or move assigning another matrix
+// to the view gives it an owning buffer. When cols is not a multiple of 8 the row padding is checked, which reads
+// the last cache line of every row; otherwise opening is O(1) in the file size. Files in the
+// other byte order or with non-zero padding cannot be viewed and are loaded instead.
+// All readers throw std::system_error on I/O failures and std::runtime_error on malformed files.
+[[nodiscard]] Matrix map_matrix(const std::string &path);
+
+// Random access to rectangular blocks of a matrix file, for matrices that do not fit in memory.
+// Blocks are moved with positioned reads/writes, so one MatrixFile can serve several threads.
+class MatrixFile final {
+public:
+    // Opens an existing file; `writable` also allows write_block (native byte order only).
+    explicit MatrixFile(const std::string &path, bool writable = false);
+
+    // Creates (or truncates) a rows x cols file of zeros without writing the elements.
+    static MatrixFile create(const std::string &path, size_t rows, size_t cols);
+
+    MatrixFile(MatrixFile &&other) noexcept;
+
+    MatrixFile &operator=(MatrixFile &&other) noexcept;
+
+    ~MatrixFile();
+
+    [[nodiscard]] size_t rows() const;
+
+    [[nodiscard]] size_t cols() const;
+
+    // Copies the nRows x nCols tile whose top-left element is (row, col) to data (leading dimension ld).
+    // Throws std::out_of_range if the tile does not fit in the matrix.
+    void read_block(size_t row, size_t col, size_t nRows, size_t nCols, double *data, size_t ld) const;
+
+    void write_block(size_t row, size_t col, size_t nRows, size_t nCols, const double *data, size_t ld);
+
+    // Whole-Matrix forms: the tile has block's shape.
+    void read_block(size_t row, size_t col, Matrix &block) const;
+
+    void write_block(size_t row, size_t col, const Matrix &block);
+
+private:
+    MatrixFile() = default;
+
+    int m_fd = -1;
+    bool m_writable = false;
+    bool m_foreign = false;
+    MatrixFileHeader m_header{};
+
+    void check_block(size_t row, size_t col, size_t nRows, size_t nCols) const;
+
+    [[nodiscard]] uint64_t offset(size_t row, size_t col) const;
+};
+
+// Streams a rows x cols matrix to disk row by row (or block by block), so results can be written
+// as they are produced without assembling the whole matrix first.
+class MatrixFileWriter final {
+public:
+    MatrixFileWriter(const std::string &path, size_t rows, size_t cols);
+
+    MatrixFileWriter(const MatrixFileWriter &) = delete;
+
+    MatrixFileWriter &operator=(const MatrixFileWriter &) = delete;
+
+    // Closes the file; an incomplete matrix is left truncated (close() reports it).
+    ~MatrixFileWriter();
+
+    // Appends one row of cols() elements.
+    void write_row(const double *row);
+
+    // Appends every row of block, which must have cols() columns.
+    void write_rows(const Matrix &block);
+
+    [[nodiscard]] size_t rows_written() const;
+
+    [[nodiscard]] size_t cols() const;
+
+    // Throws std::runtime_error if fewer rows than announced were written.
+    void close();
+
+private:
+    int m_fd = -1;
+    size_t m_rows;
+    size_t m_cols;
+    size_t m_stride;
+    size_t m_written = 0;
+
+    void write_bytes(const void *data, size_t bytes);
+};
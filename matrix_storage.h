@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include "memory_arena.h"
+
+// Every row starts on a cache line boundary (also wide enough for AVX-512 loads).
+inline constexpr size_t kMatrixAlignment = 64;
+
+template<typename T>
+class RowView final {
+public:
+    RowView(T *data, size_t size) : m_data(data), m_size(size) {}
+
+    T &operator[](size_t j) const { return m_data[j]; }
+
+    [[nodiscard]] size_t size() const { return m_size; }
+
+    T *data() const { return m_data; }
+
+    T *begin() const { return m_data; }
+
+    T *end() const { return m_data + m_size; }
+
+private:
+    T *m_data;
+    size_t m_size;
+};
+
+template<typename T>
+class ColView final {
+public:
+    ColView(T *data, size_t size, size_t stride) : m_data(data), m_size(size), m_stride(stride) {}
+
+    T &operator[](size_t i) const { return m_data[i * m_stride]; }
+
+    [[nodiscard]] size_t size() const { return m_size; }
+
+    [[nodiscard]] size_t stride() const { return m_stride; }
+
+private:
+    T *m_data;
+    size_t m_size;
+    size_t m_stride;
+};
+
+// Single aligned row-major buffer. Rows are padded up to kMatrixAlignment bytes,
+// so element (i, j) lives at data()[i * stride() + j]; padding is kept zeroed.
+// The buffer comes from a std::pmr::memory_resource: the one passed in, otherwise the thread's
+// current matrix_memory_resource(). Like pmr containers, a storage keeps its resource for life:
+// copies and moves between different resources copy the elements instead of adopting the buffer.
+// A view (see view()) borrows memory it does not own, e.g. a mapped file, and only holds a keepalive
+// for it; copies of a view, and a view assigned to, are ordinary owning storages.
+template<typename T>
+class MatrixStorage final {
+public:
+    MatrixStorage() = default;
+
+    explicit MatrixStorage(std::pmr::memory_resource *resource)
+            : m_resource(resource != nullptr ? resource : matrix_memory_resource()) {}
+
+    MatrixStorage(size_t rows, size_t cols, std::pmr::memory_resource *resource = nullptr)
+            : m_rows(rows), m_cols(cols), m_stride(padded_stride(cols)),
+              m_resource(resource != nullptr ? resource : matrix_memory_resource()) {
+        m_data = allocate(m_rows * m_stride);
+        std::fill_n(m_data, m_rows * m_stride, T{});
+    }
+
+    // Leaves the elements uninitialized (padding is still zeroed); for buffers that are overwritten at once.
+    static MatrixStorage uninitialized(size_t rows, size_t cols, std::pmr::memory_resource *resource = nullptr) {
+        MatrixStorage storage = untouched(rows, cols, resource);
+        if (storage.m_stride != cols) {
+            for (size_t i = 0; i < rows; i++) {
+                std::fill(storage.row(i) + cols, storage.row(i) + storage.m_stride, T{});
+            }
+        }
+        return storage;
+    }
+
+    // Writes nothing at all, padding included: whoever fills the rows must zero their padding too.
+    // Lets the threads that work on the rows be the first to touch their pages (NUMA first touch).
+    static MatrixStorage untouched(size_t rows, size_t cols, std::pmr::memory_resource *resource = nullptr) {
+        MatrixStorage storage(resource);
+        storage.m_rows = rows;
+        storage.m_cols = cols;
+        storage.m_stride = padded_stride(cols);
+        storage.m_data = storage.allocate(rows * storage.m_stride);
+        return storage;
+    }
+
+    // Borrows data (rows x cols with the padded stride, padding zeroed) until the last copy of
+    // keepalive is gone. Buffers allocated later on behalf of the view come from `resource`.
+    static MatrixStorage view(T *data, size_t rows, size_t cols, std::shared_ptr<void> keepalive,
+                              std::pmr::memory_resource *resource = nullptr) {
+        MatrixStorage storage(resource);
+        storage.m_data = data;
+        storage.m_rows = rows;
+        storage.m_cols = cols;
+        storage.m_stride = padded_stride(cols);
+        storage.m_keepalive = std::move(keepalive);
+        return storage;
+    }
+
+    MatrixStorage(const MatrixStorage &other, std::pmr::memory_resource *resource = nullptr)
+            : m_rows(other.m_rows), m_cols(other.m_cols), m_stride(other.m_stride),
+              m_resource(resource != nullptr ? resource : matrix_memory_resource()) {
+        m_data = allocate(m_rows * m_stride);
+        std::copy_n(other.m_data, m_rows * m_stride, m_data);
+    }
+
+    MatrixStorage(MatrixStorage &&other) noexcept
+            : m_data(std::exchange(other.m_data, nullptr)),
+              m_rows(std::exchange(other.m_rows, 0)),
+              m_cols(std::exchange(other.m_cols, 0)),
+              m_stride(std::exchange(other.m_stride, 0)),
+              m_resource(other.m_resource),
+              m_keepalive(std::move(other.m_keepalive)) {}
+
+    MatrixStorage &operator=(const MatrixStorage &other) {
+        if (this != &other && !is_view() && m_rows == other.m_rows && m_stride == other.m_stride) {
+            m_cols = other.m_cols;
+            std::copy_n(other.m_data, m_rows * m_stride, m_data);
+        } else if (this != &other) {
+            MatrixStorage copy(other, m_resource);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    // Only adopts the buffer if it comes from an equal resource (or is a view, which no resource
+    // frees); otherwise this is a copy. Allocation failure in that fallback terminates, as for any
+    // noexcept move.
+    MatrixStorage &operator=(MatrixStorage &&other) noexcept {
+        if (other.is_view() || m_resource == other.m_resource || m_resource->is_equal(*other.m_resource)) {
+            MatrixStorage moved(std::move(other));
+            swap(moved);
+        } else {
+            *this = static_cast<const MatrixStorage &>(other);
+        }
+        return *this;
+    }
+
+    ~MatrixStorage() {
+        if (!is_view()) deallocate(m_data);
+    }
+
+    void swap(MatrixStorage &other) noexcept {
+        std::swap(m_data, other.m_data);
+        std::swap(m_rows, other.m_rows);
+        std::swap(m_cols, other.m_cols);
+        std::swap(m_stride, other.m_stride);
+        std::swap(m_resource, other.m_resource);
+        m_keepalive.swap(other.m_keepalive);
+    }
+
+    [[nodiscard]] std::pmr::memory_resource *resource() const { return m_resource; }
+
+    [[nodiscard]] bool is_view() const { return m_keepalive != nullptr; }
+
+    [[nodiscard]] size_t rows() const { return m_rows; }
+
+    [[nodiscard]] size_t cols() const { return m_cols; }
+
+    // Leading dimension: distance in elements between the starts of two consecutive rows.
+    [[nodiscard]] size_t stride() const { return m_stride; }
+
+    T *data() { return m_data; }
+
+    const T *data() const { return m_data; }
+
+    T *row(size_t i) { return m_data + i * m_stride; }
+
+    const T *row(size_t i) const { return m_data + i * m_stride; }
+
+    T &operator()(size_t i, size_t j) { return m_data[i * m_stride + j]; }
+
+    const T &operator()(size_t i, size_t j) const { return m_data[i * m_stride + j]; }
+
+    RowView<T> row_view(size_t i) { return {row(i), m_cols}; }
+
+    RowView<const T> row_view(size_t i) const { return {row(i), m_cols}; }
+
+    ColView<T> col_view(size_t j) { return {m_data + j, m_rows, m_stride}; }
+
+    ColView<const T> col_view(size_t j) const { return {m_data + j, m_rows, m_stride}; }
+
+    void swap_rows(size_t i, size_t j) {
+        if (i != j) std::swap_ranges(row(i), row(i) + m_cols, row(j));
+    }
+
+    static size_t padded_stride(size_t cols) {
+        constexpr size_t per_line = kMatrixAlignment / sizeof(T) > 0 ? kMatrixAlignment / sizeof(T) : 1;
+        return (cols + per_line - 1) / per_line * per_line;
+    }
+
+private:
+    T *m_data = nullptr;
+    size_t m_rows = 0;
+    size_t m_cols = 0;
+    size_t m_stride = 0;
+    std::pmr::memory_resource *m_resource = matrix_memory_resource();
+    std::shared_ptr<void> m_keepalive;
+
+    T *allocate(size_t count) {
+        if (count == 0) return nullptr;
+        return static_cast<T *>(m_resource->allocate(count * sizeof(T), kMatrixAlignment));
+    }
+
+    void deallocate(T *data) {
+        if (data) m_resource->deallocate(data, m_rows * m_stride * sizeof(T), kMatrixAlignment);
+    }
+};
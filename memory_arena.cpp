@@ -0,0 +1,107 @@
+#include "memory_arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+namespace {
+
+thread_local std::pmr::memory_resource *t_resource = nullptr;
+
+}
+
+std::pmr::memory_resource *matrix_memory_resource() {
+    return t_resource != nullptr ? t_resource : std::pmr::new_delete_resource();
+}
+
+std::pmr::memory_resource *set_matrix_memory_resource(std::pmr::memory_resource *resource) {
+    return std::exchange(t_resource, resource);
+}
+
+std::pmr::memory_resource *matrix_pool_resource() {
+    static std::pmr::synchronized_pool_resource pool(
+            std::pmr::pool_options{0, size_t{1} << 26}, std::pmr::new_delete_resource());
+    return &pool;
+}
+
+BumpArena::BumpArena(size_t chunk_size, std::pmr::memory_resource *upstream)
+        : m_chunk_size(std::max<size_t>(chunk_size, kChunkAlignment)), m_upstream(upstream) {}
+
+BumpArena::~BumpArena() {
+    for (auto &chunk: m_chunks) {
+        m_upstream->deallocate(chunk.data, chunk.size, kChunkAlignment);
+    }
+}
+
+BumpArena::Mark BumpArena::mark() const {
+    return {m_current, m_offset};
+}
+
+void BumpArena::rewind(Mark mark) {
+    m_current = mark.chunk;
+    m_offset = mark.offset;
+}
+
+void BumpArena::reset() {
+    rewind({0, 0});
+}
+
+void BumpArena::trim() {
+    const size_t keep = m_offset == 0 ? m_current : m_current + 1;
+    for (size_t i = keep; i < m_chunks.size(); i++) {
+        m_upstream->deallocate(m_chunks[i].data, m_chunks[i].size, kChunkAlignment);
+    }
+    m_chunks.resize(std::min(keep, m_chunks.size()));
+    if (m_chunks.empty()) {
+        m_current = 0;
+        m_offset = 0;
+    }
+}
+
+size_t BumpArena::used() const {
+    size_t used = m_offset;
+    for (size_t i = 0; i < m_current && i < m_chunks.size(); i++) {
+        used += m_chunks[i].size;
+    }
+    return used;
+}
+
+size_t BumpArena::capacity() const {
+    size_t capacity = 0;
+    for (const auto &chunk: m_chunks) {
+        capacity += chunk.size;
+    }
+    return capacity;
+}
+
+void *BumpArena::do_allocate(size_t bytes, size_t alignment) {
+    for (; m_current < m_chunks.size(); m_current++, m_offset = 0) {
+        const Chunk &chunk = m_chunks[m_current];
+        const auto base = reinterpret_cast<uintptr_t>(chunk.data);
+        const uintptr_t aligned = (base + m_offset + alignment - 1) & ~(uintptr_t{alignment} - 1);
+        if (aligned + bytes <= base + chunk.size) {
+            m_offset = aligned + bytes - base;
+            return reinterpret_cast<void *>(aligned);
+        }
+    }
+    // Geometric growth keeps the number of chunks logarithmic in the peak scratch size.
+    size_t size = m_chunks.empty() ? m_chunk_size : m_chunks.back().size * 2;
+    size = std::max(size, bytes + std::max(alignment, kChunkAlignment));
+    auto *data = static_cast<std::byte *>(m_upstream->allocate(size, kChunkAlignment));
+    m_chunks.push_back({data, size});
+    m_current = m_chunks.size() - 1;
+    m_offset = 0;
+    return do_allocate(bytes, alignment);
+}
+
+BumpArena &BumpArena::thread_local_arena() {
+    thread_local BumpArena arena;
+    return arena;
+}
+
+ScratchScope::ScratchScope(BumpArena &arena)
+        : m_arena(arena), m_mark(arena.mark()), m_previous(set_matrix_memory_resource(&arena)) {}
+
+ScratchScope::~ScratchScope() {
+    set_matrix_memory_resource(m_previous);
+    m_arena.rewind(m_mark);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Resource that new Matrix buffers created on this thread come from. Defaults to the aligned heap
+// (std::pmr::new_delete_resource()); set_matrix_memory_resource(nullptr) restores that default.
+// Returns the previously installed resource.
+std::pmr::memory_resource *matrix_memory_resource();
+
+std::pmr::memory_resource *set_matrix_memory_resource(std::pmr::memory_resource *resource);
+
+// Process-wide size-class pool: freed buffers are kept per size class and handed out again,
+// which suits long-lived code that keeps allocating the same shapes from many threads.
+std::pmr::memory_resource *matrix_pool_resource();
+
+// Bump allocator over a list of chunks taken from `upstream`. Allocation is a pointer bump,
+// deallocation is a no-op, and everything allocated after a mark() is released at once by
+// rewind(mark) in O(1). Chunks are kept for reuse until trim() or destruction.
+// Not thread-safe: use one arena per thread (see thread_local_arena()).
+class BumpArena final : public std::pmr::memory_resource {
+public:
+    struct Mark {
+        size_t chunk;
+        size_t offset;
+    };
+
+    explicit BumpArena(size_t chunk_size = size_t{1} << 20,
+                       std::pmr::memory_resource *upstream = std::pmr::new_delete_resource());
+
+    BumpArena(const BumpArena &) = delete;
+
+    BumpArena &operator=(const BumpArena &) = delete;
+
+    ~BumpArena() override;
+
+    [[nodiscard]] Mark mark() const;
+
+    void rewind(Mark mark);
+
+    void reset();
+
+    // Returns the chunks that are not in use to the upstream resource.
+    void trim();
+
+    // Bytes currently handed out (including alignment padding).
+    [[nodiscard]] size_t used() const;
+
+    [[nodiscard]] size_t capacity() const;
+
+    static BumpArena &thread_local_arena();
+
+private:
+    struct Chunk {
+        std::byte *data;
+        size_t size;
+    };
+
+    static constexpr size_t kChunkAlignment = 64;
+
+    std::vector<Chunk> m_chunks;
+    size_t m_current = 0;
+    size_t m_offset = 0;
+    size_t m_chunk_size;
+    std::pmr::memory_resource *m_upstream;
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+
+    void do_deallocate(void *, size_t, size_t) override {}
+
+    [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// While alive, every Matrix buffer allocated on this thread comes from `arena` (the thread-local
+// arena by default); the destructor frees all of them at once and restores the previous resource.
+// Scopes nest. Matrices created inside must not be used after the scope ends - copy or move-assign
+// them into a Matrix created outside (it keeps its own resource) to keep a result.
+class ScratchScope final {
+public:
+    explicit ScratchScope(BumpArena &arena = BumpArena::thread_local_arena());
+
+    ScratchScope(const ScratchScope &) = delete;
+
+    ScratchScope &operator=(const ScratchScope &) = delete;
+
+    ~ScratchScope();
+
+private:
+    BumpArena &m_arena;
+    BumpArena::Mark m_mark;
+    std::pmr::memory_resource *m_previous;
+};
@@ -0,0 +1,219 @@
+#include "numa.h"
+#include "calculator_manager.h"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <linux/mempolicy.h>
+#include <new>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}.
+std::vector<size_t> parse_cpu_list(const std::string &list) {
+    std::vector<size_t> cpus;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range == "\n") continue;
+        const size_t dash = range.find('-');
+        const size_t first = std::stoul(range.substr(0, dash));
+        const size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+        for (size_t cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<NumaNode> detect_nodes() {
+    std::vector<NumaNode> nodes;
+    std::error_code error;
+    for (const auto &entry: std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+        const std::string name = entry.path().filename().string();
+        if (name.rfind("node", 0) != 0 || name.size() == 4 ||
+            !std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            continue;
+        }
+        std::ifstream file(entry.path() / "cpulist");
+        std::string list;
+        if (!std::getline(file, list)) continue;
+        NumaNode node{std::stoul(name.substr(4)), parse_cpu_list(list)};
+        if (!node.cpus.empty()) nodes.push_back(std::move(node));
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const NumaNode &x, const NumaNode &y) { return x.id < y.id; });
+    if (nodes.empty()) {
+        NumaNode all{0, {}};
+        const size_t hardware = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+        for (size_t cpu = 0; cpu < hardware; cpu++) all.cpus.push_back(cpu);
+        nodes.push_back(std::move(all));
+    }
+    return nodes;
+}
+
+// mbind(2) through the raw system call, so no libnuma is needed at link time.
+bool bind_memory(void *address, size_t bytes, int mode, const std::vector<size_t> &nodes, unsigned flags) {
+    constexpr size_t kBits = 8 * sizeof(unsigned long);
+    size_t max_node = 0;
+    for (size_t node: nodes) max_node = std::max(max_node, node);
+    std::vector<unsigned long> mask(max_node / kBits + 1, 0);
+    for (size_t node: nodes) mask[node / kBits] |= 1UL << (node % kBits);
+    return syscall(SYS_mbind, address, bytes, mode, mask.data(), mask.size() * kBits + 1, flags) == 0;
+}
+
+std::vector<size_t> all_node_ids(const NumaTopology &topology) {
+    std::vector<size_t> ids;
+    for (const NumaNode &node: topology.nodes()) ids.push_back(node.id);
+    return ids;
+}
+
+size_t page_size() {
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+// out must already have the shape; a fresh out may be untouched, so every row's padding is zeroed
+// by the thread writing the row and its pages are first touched on the row's node.
+template<typename Kernel>
+void numa_elementwise(const Matrix &a, const Matrix &b, Matrix &out, Kernel kernel) {
+    const size_t rows = a.getRows();
+    const size_t cols = a.getCols();
+    NumaExecutor &executor = NumaExecutor::instance();
+    executor.for_each_node(rows, [&](size_t node, size_t begin, size_t end) {
+        ThreadPool &pool = executor.pool(node);
+        const size_t threads = CostModel::instance().threads_for(WorkEstimate::elementwise(end - begin, cols),
+                                                                 std::max<size_t>(pool.size(), 1));
+        pool.parallel_ranges(begin, end, threads, 1, [&](size_t from, size_t to) {
+            for (size_t i = from; i < to; i++) {
+                double *row = out.data() + i * out.stride();
+                kernel(a.data() + i * a.stride(), b.data() + i * b.stride(), row, cols);
+                std::fill(row + cols, row + out.stride(), 0.0);
+            }
+        });
+    });
+}
+
+bool same_shape(const Matrix &a, const Matrix &b) {
+    return a.getRows() == b.getRows() && a.getCols() == b.getCols();
+}
+
+}
+
+const NumaTopology &NumaTopology::instance() {
+    static const NumaTopology topology(detect_nodes());
+    return topology;
+}
+
+NumaTopology::NumaTopology(std::vector<NumaNode> nodes) : m_nodes(std::move(nodes)) {}
+
+const std::vector<NumaNode> &NumaTopology::nodes() const {
+    return m_nodes;
+}
+
+size_t NumaTopology::node_count() const {
+    return m_nodes.size();
+}
+
+bool pin_workers_round_robin(ThreadPool &pool, const NumaTopology &topology) {
+    bool pinned = topology.node_count() > 0;
+    for (size_t w = 0; pinned && w < pool.size(); w++) {
+        pinned = pool.set_worker_affinity(w, topology.nodes()[w % topology.node_count()].cpus);
+    }
+    return pinned;
+}
+
+NumaMemoryResource::NumaMemoryResource(Policy policy, std::vector<size_t> nodes)
+        : m_policy(policy), m_nodes(nodes.empty() ? all_node_ids(NumaTopology::instance()) : std::move(nodes)) {}
+
+void *NumaMemoryResource::do_allocate(size_t bytes, size_t alignment) {
+    if (alignment > page_size()) throw std::bad_alloc();
+    const size_t length = std::max<size_t>(bytes, 1);
+    void *memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) throw std::bad_alloc();
+    // The pages do not exist yet, so the policy decides where the first touch puts them.
+    bind_memory(memory, length, m_policy == Policy::Interleave ? MPOL_INTERLEAVE : MPOL_BIND, m_nodes, 0);
+    return memory;
+}
+
+void NumaMemoryResource::do_deallocate(void *p, size_t bytes, size_t) {
+    munmap(p, std::max<size_t>(bytes, 1));
+}
+
+bool place_rows_by_node(Matrix &m, const NumaTopology &topology) {
+    if (m.getRows() == 0 || topology.node_count() < 2) return true;
+    // A policy stays on the address range after the buffer is freed; only NumaMemoryResource
+    // mappings go away with their buffer.
+    if (dynamic_cast<NumaMemoryResource *>(m.resource()) == nullptr) return false;
+    const size_t page = page_size();
+    const size_t row_bytes = m.stride() * sizeof(double);
+    const auto base = reinterpret_cast<uintptr_t>(m.data());
+    const auto intervals = make_row_intervals(m.getRows(), topology.node_count());
+    bool placed = true;
+    for (size_t node = 0; node < intervals.size(); node++) {
+        // Only the pages entirely inside the node's rows move.
+        const uintptr_t first = (base + intervals[node].first * row_bytes + page - 1) / page * page;
+        const uintptr_t last = (base + intervals[node].second * row_bytes) / page * page;
+        if (last <= first) continue;
+        placed &= bind_memory(reinterpret_cast<void *>(first), last - first, MPOL_BIND,
+                              {topology.nodes()[node].id}, MPOL_MF_MOVE);
+    }
+    return placed;
+}
+
+NumaExecutor &NumaExecutor::instance() {
+    static NumaExecutor executor(NumaTopology::instance());
+    return executor;
+}
+
+NumaExecutor::NumaExecutor(const NumaTopology &topology) {
+    for (const NumaNode &node: topology.nodes()) {
+        auto pool = std::make_unique<ThreadPool>(node.cpus.size());
+        for (size_t w = 0; w < pool->size(); w++) pool->set_worker_affinity(w, node.cpus);
+        m_pools.push_back(std::move(pool));
+    }
+}
+
+size_t NumaExecutor::node_count() const {
+    return m_pools.size();
+}
+
+ThreadPool &NumaExecutor::pool(size_t node) {
+    return *m_pools.at(node);
+}
+
+void NumaExecutor::for_each_node(size_t rows, const std::function<void(size_t, size_t, size_t)> &body) {
+    const auto intervals = make_row_intervals(rows, node_count());
+    std::vector<std::future<void>> done;
+    for (size_t node = 0; node < intervals.size(); node++) {
+        if (intervals[node].first == intervals[node].second) continue;
+        done.push_back(m_pools[node]->submit([&body, &intervals, node] {
+            body(node, intervals[node].first, intervals[node].second);
+        }));
+    }
+    // Plain get(): the caller must not pick up another node's tasks.
+    for (auto &future: done) future.wait();
+    for (auto &future: done) future.get();
+}
+
+void numa_sum_into(const Matrix &a, const Matrix &b, Matrix &out) {
+    if (!same_shape(a, b)) {
+        out = Matrix();
+        return;
+    }
+    if (&out != &a && &out != &b) out.reshape_untouched(a.getRows(), a.getCols());
+    numa_elementwise(a, b, out, simd().add);
+}
+
+void numa_subtract_into(const Matrix &a, const Matrix &b, Matrix &out) {
+    if (!same_shape(a, b)) {
+        out = Matrix();
+        return;
+    }
+    if (&out != &a && &out != &b) out.reshape_untouched(a.getRows(), a.getCols());
+    numa_elementwise(a, b, out, simd().sub);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "matrix.h"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// NUMA support for multi-socket hosts. Everything here is opt-in: the default pool, allocator and
+// fast_* paths do not change. On a single-node host (or without /sys) the topology is one node
+// holding every CPU and all of this degrades to ordinary parallel code.
+//
+// The pieces fit the row partitioning of CalculationManager: make_row_intervals(rows, nodes)
+// assigns every node a contiguous range of rows, place_rows_by_node() moves the pages of those
+// rows to that node, and NumaExecutor runs each node's range on threads pinned to that node, so
+// bandwidth-bound operations draw on every memory controller instead of one.
+
+struct NumaNode {
+    size_t id;
+    std::vector<size_t> cpus;
+};
+
+class NumaTopology final {
+public:
+    // Read once from /sys/devices/system/node; nodes without CPUs are skipped.
+    static const NumaTopology &instance();
+
+    explicit NumaTopology(std::vector<NumaNode> nodes);
+
+    [[nodiscard]] const std::vector<NumaNode> &nodes() const;
+
+    [[nodiscard]] size_t node_count() const;
+
+private:
+    std::vector<NumaNode> m_nodes;
+};
+
+// Pins worker w of the pool to the CPUs of node w % node_count(), spreading the workers over the
+// sockets. Returns false if some worker could not be pinned.
+bool pin_workers_round_robin(ThreadPool &pool, const NumaTopology &topology = NumaTopology::instance());
+
+// Page-granular resource (mmap) whose buffers get a NUMA memory policy before they are touched:
+//  - Interleave spreads the pages round-robin over the nodes, for data every thread reads;
+//  - Bind keeps them on the given nodes.
+// An empty node list means all nodes. The policy is advisory: if the kernel refuses it (no NUMA
+// support, containers without the permission) the memory is still returned, with the default
+// first-touch placement.
+class NumaMemoryResource final : public std::pmr::memory_resource {
+public:
+    enum class Policy {
+        Interleave,
+        Bind,
+    };
+
+    explicit NumaMemoryResource(Policy policy, std::vector<size_t> nodes = {});
+
+private:
+    Policy m_policy;
+    std::vector<size_t> m_nodes;
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+
+    [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// Migrates the pages of every node's make_row_intervals(rows, nodes) range of m to that node.
+// Pages straddling two ranges stay where they are. Only buffers of a NumaMemoryResource are
+// moved: the policy outlives the buffer on the address range, and other resources reuse it for
+// unrelated allocations. Returns false for other buffers or if the kernel refused.
+bool place_rows_by_node(Matrix &m, const NumaTopology &topology = NumaTopology::instance());
+
+// One thread pool per node, its workers pinned to that node's CPUs (one worker per CPU).
+class NumaExecutor final {
+public:
+    // Built lazily from NumaTopology::instance().
+    static NumaExecutor &instance();
+
+    explicit NumaExecutor(const NumaTopology &topology);
+
+    [[nodiscard]] size_t node_count() const;
+
+    [[nodiscard]] ThreadPool &pool(size_t node);
+
+    // body(node, begin, end) for the make_row_intervals(rows, node_count()) ranges, each one
+    // started on its node's pool; returns when all finished and rethrows the first exception.
+    void for_each_node(size_t rows, const std::function<void(size_t, size_t, size_t)> &body);
+
+private:
+    std::vector<std::unique_ptr<ThreadPool>> m_pools;
+};
+
+// out = a + b (a - b) with every node's rows computed by that node's threads. A freshly allocated
+// out is not written before that, so its rows are first touched, and placed, by their node's
+// threads; a and b should be placed the same way (place_rows_by_node) or interleaved. Shape mismatches make out empty, like sum_into.
+void numa_sum_into(const Matrix &a, const Matrix &b, Matrix &out);
+
+void numa_subtract_into(const Matrix &a, const Matrix &b, Matrix &out);
@@ -0,0 +1,311 @@
+#include "out_of_core.h"
+#include "gemm.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <future>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+// Tiles are sized in whole cache lines of doubles so that they carry no row padding.
+constexpr size_t kLine = kMatrixAlignment / sizeof(double);
+
+size_t round_down_to_line(size_t count) {
+    return count / kLine * kLine;
+}
+
+size_t tile_bytes(size_t rows, size_t cols) {
+    return rows * MatrixStorage<double>::padded_stride(cols) * sizeof(double);
+}
+
+size_t ceil_div(size_t a, size_t b) {
+    return (a + b - 1) / b;
+}
+
+// Runs process(s, slots[s % 2]) for every step while a pool task fills the other slot with
+// load(s + 1, ...), so reading the next tiles overlaps the work on the current ones.
+template<typename Slot, typename Load, typename Process>
+void double_buffered(size_t steps, std::array<Slot, 2> &slots, Load &&load, Process &&process) {
+    if (steps == 0) return;
+    ThreadPool &pool = ThreadPool::instance();
+    load(0, slots[0]);
+    for (size_t s = 0; s < steps; s++) {
+        std::future<void> next;
+        if (s + 1 < steps) {
+            next = pool.submit([&load, &slots, s] { load(s + 1, slots[(s + 1) % 2]); });
+        }
+        try {
+            process(s, slots[s % 2]);
+        } catch (...) {
+            // The prefetch still writes into a slot: let it finish before the slots go away.
+            if (next.valid()) {
+                try {
+                    pool.wait(next);
+                } catch (...) {}
+            }
+            throw;
+        }
+        if (next.valid()) pool.wait(next);
+    }
+}
+
+// C[m x n] += alpha * A * B, split by rows across the pool when the cost model says it pays off.
+void parallel_gemm(size_t m, size_t n, size_t k, double alpha, const double *a, size_t lda,
+                   const double *b, size_t ldb, double *c, size_t ldc, size_t num_of_threads) {
+    const size_t parts = CostModel::instance().threads_for(WorkEstimate::multiply(m, n, k), num_of_threads);
+    ThreadPool::instance().parallel_ranges(0, m, parts, GemmBlocking::MR, [&](size_t from, size_t to) {
+        gemm(to - from, n, k, alpha, a + from * lda, lda, b, ldb, c + from * ldc, ldc);
+    });
+}
+
+// Working file of det(), deleted with the guard.
+class ScratchFile final {
+public:
+    explicit ScratchFile(const std::string &dir) {
+        static std::atomic<size_t> counter{0};
+        const std::filesystem::path base = dir.empty() ? std::filesystem::temp_directory_path()
+                                                       : std::filesystem::path(dir);
+        m_path = (base / ("parprog_ooc_" + std::to_string(::getpid()) + "_" +
+                          std::to_string(counter++) + ".mat")).string();
+    }
+
+    ScratchFile(const ScratchFile &) = delete;
+
+    ScratchFile &operator=(const ScratchFile &) = delete;
+
+    ~ScratchFile() {
+        std::error_code ignored;
+        std::filesystem::remove(m_path, ignored);
+    }
+
+    [[nodiscard]] const std::string &path() const { return m_path; }
+
+private:
+    std::string m_path;
+};
+
+}
+
+OutOfCoreEngine::OutOfCoreEngine(size_t memory_budget, size_t num_of_threads, std::string scratch_dir)
+        : m_budget(memory_budget), m_threads(std::max<size_t>(num_of_threads, 1)),
+          m_scratch_dir(std::move(scratch_dir)) {}
+
+size_t OutOfCoreEngine::memory_budget() const {
+    return m_budget;
+}
+
+size_t OutOfCoreEngine::peak_bytes() const {
+    return m_peak;
+}
+
+void OutOfCoreEngine::add(const std::string &a, const std::string &b, const std::string &out) {
+    elementwise(a, b, out, false);
+}
+
+void OutOfCoreEngine::subtract(const std::string &a, const std::string &b, const std::string &out) {
+    elementwise(a, b, out, true);
+}
+
+void OutOfCoreEngine::elementwise(const std::string &a, const std::string &b, const std::string &out, bool subtract) {
+    const MatrixFile file_a(a);
+    const MatrixFile file_b(b);
+    const size_t rows = file_a.rows();
+    const size_t cols = file_a.cols();
+    if (file_b.rows() != rows || file_b.cols() != cols) {
+        throw std::invalid_argument("OutOfCoreEngine: operands have different shapes");
+    }
+    if (std::filesystem::exists(out) && (std::filesystem::equivalent(out, a) || std::filesystem::equivalent(out, b))) {
+        throw std::invalid_argument("OutOfCoreEngine: the result cannot overwrite an operand");
+    }
+    MatrixFile result = MatrixFile::create(out, rows, cols);
+    m_peak = 0;
+    if (rows == 0 || cols == 0) return;
+
+    // Two tiles per operand; the sum overwrites the tile of a.
+    const size_t elements = m_budget / (4 * sizeof(double));
+    const size_t width = cols <= elements ? cols : round_down_to_line(elements);
+    const size_t tile_rows = width == 0 ? 0 : std::min(rows, elements / MatrixStorage<double>::padded_stride(width));
+    if (tile_rows == 0) {
+        throw std::length_error("OutOfCoreEngine: memory budget is too small for one row tile");
+    }
+    struct Slot {
+        Matrix a, b;
+    };
+    std::array<Slot, 2> slots{Slot{Matrix(tile_rows, width), Matrix(tile_rows, width)},
+                              Slot{Matrix(tile_rows, width), Matrix(tile_rows, width)}};
+    m_peak = 4 * tile_bytes(tile_rows, width);
+
+    const size_t tiles_across = ceil_div(cols, width);
+    const auto origin = [&](size_t step) {
+        const size_t r0 = step / tiles_across * tile_rows;
+        const size_t c0 = step % tiles_across * width;
+        return std::array<size_t, 4>{r0, c0, std::min(tile_rows, rows - r0), std::min(width, cols - c0)};
+    };
+    double_buffered(ceil_div(rows, tile_rows) * tiles_across, slots,
+                    [&](size_t step, Slot &slot) {
+                        const auto [r0, c0, h, w] = origin(step);
+                        file_a.read_block(r0, c0, h, w, slot.a.data(), slot.a.stride());
+                        file_b.read_block(r0, c0, h, w, slot.b.data(), slot.b.stride());
+                    },
+                    [&](size_t step, Slot &slot) {
+                        const auto [r0, c0, h, w] = origin(step);
+                        const size_t parts = CostModel::instance().threads_for(WorkEstimate::elementwise(h, w), m_threads);
+                        ThreadPool::instance().parallel_ranges(0, h, parts, 1, [&](size_t from, size_t to) {
+                            const SimdKernels &kernels = simd();
+                            for (size_t i = from; i < to; i++) {
+                                double *row = slot.a.row(i).data();
+                                if (subtract) {
+                                    kernels.sub(row, slot.b.row(i).data(), row, w);
+                                } else {
+                                    kernels.add(row, slot.b.row(i).data(), row, w);
+                                }
+                            }
+                        });
+                        result.write_block(r0, c0, h, w, slot.a.data(), slot.a.stride());
+                    });
+}
+
+void OutOfCoreEngine::multiply(const std::string &a, const std::string &b, const std::string &out) {
+    const MatrixFile file_a(a);
+    const MatrixFile file_b(b);
+    const size_t m = file_a.rows();
+    const size_t k = file_a.cols();
+    const size_t n = file_b.cols();
+    if (file_b.rows() != k) {
+        throw std::invalid_argument("OutOfCoreEngine: inner dimensions do not match");
+    }
+    if (std::filesystem::exists(out) && (std::filesystem::equivalent(out, a) || std::filesystem::equivalent(out, b))) {
+        throw std::invalid_argument("OutOfCoreEngine: the result cannot overwrite an operand");
+    }
+    MatrixFile result = MatrixFile::create(out, m, n);
+    m_peak = 0;
+    // A fresh file already reads as zeros, which is the product when k == 0.
+    if (m == 0 || n == 0 || k == 0) return;
+
+    // Five t x t tiles: two of a, two of b (double buffering) and the accumulator.
+    const auto side = static_cast<size_t>(std::sqrt(static_cast<double>(m_budget) / (5 * sizeof(double))));
+    const size_t t = round_down_to_line(side);
+    if (t == 0) {
+        throw std::length_error("OutOfCoreEngine: memory budget is too small for multiplication tiles");
+    }
+    const size_t mt = std::min(t, m);
+    const size_t kt = std::min(t, k);
+    const size_t nt = std::min(t, n);
+    struct Slot {
+        Matrix a, b;
+    };
+    std::array<Slot, 2> slots{Slot{Matrix(mt, kt), Matrix(kt, nt)}, Slot{Matrix(mt, kt), Matrix(kt, nt)}};
+    Matrix c(mt, nt);
+    m_peak = 2 * (tile_bytes(mt, kt) + tile_bytes(kt, nt)) + tile_bytes(mt, nt);
+
+    const size_t tiles_n = ceil_div(n, nt);
+    const size_t tiles_k = ceil_div(k, kt);
+    // Step order: for every tile of the result, all of its k tiles.
+    const auto origin = [&](size_t step) {
+        const size_t i0 = step / (tiles_n * tiles_k) * mt;
+        const size_t j0 = step / tiles_k % tiles_n * nt;
+        const size_t l0 = step % tiles_k * kt;
+        return std::array<size_t, 6>{i0, j0, l0, std::min(mt, m - i0), std::min(nt, n - j0), std::min(kt, k - l0)};
+    };
+    double_buffered(ceil_div(m, mt) * tiles_n * tiles_k, slots,
+                    [&](size_t step, Slot &slot) {
+                        const auto [i0, j0, l0, h, w, d] = origin(step);
+                        file_a.read_block(i0, l0, h, d, slot.a.data(), slot.a.stride());
+                        file_b.read_block(l0, j0, d, w, slot.b.data(), slot.b.stride());
+                    },
+                    [&](size_t step, Slot &slot) {
+                        const auto [i0, j0, l0, h, w, d] = origin(step);
+                        if (l0 == 0) c.fill(0);
+                        parallel_gemm(h, w, d, 1.0, slot.a.data(), slot.a.stride(), slot.b.data(), slot.b.stride(),
+                                      c.data(), c.stride(), m_threads);
+                        if (l0 + d == k) result.write_block(i0, j0, h, w, c.data(), c.stride());
+                    });
+}
+
+double OutOfCoreEngine::det(const std::string &a) {
+    const MatrixFile source(a);
+    const size_t n = source.rows();
+    if (source.cols() != n) {
+        throw std::invalid_argument("OutOfCoreEngine::det: matrix must be square");
+    }
+    m_peak = 0;
+    if (n == 0) return 1;
+
+    // The panel and two trailing strips, each n rows by w columns. Full width only if the padded
+    // tiles fit; otherwise whole cache lines, whose tiles carry no padding.
+    const size_t columns = m_budget / (3 * n * sizeof(double));
+    const size_t w = 3 * tile_bytes(n, n) <= m_budget ? n : round_down_to_line(columns);
+    if (w == 0) {
+        throw std::length_error("OutOfCoreEngine::det: memory budget is too small for an n-row panel");
+    }
+    ScratchFile scratch(m_scratch_dir);
+    MatrixFile work = MatrixFile::create(scratch.path(), n, n);
+    Matrix panel(n, w);
+    std::array<Matrix, 2> strips{Matrix(n, w), Matrix(n, w)};
+    m_peak = 3 * tile_bytes(n, w);
+
+    const SimdKernels &kernels = simd();
+    std::vector<size_t> pivots(w);
+    const MatrixFile *src = &source;
+    double det = 1;
+    for (size_t p0 = 0; p0 < n; p0 += w) {
+        const size_t pw = std::min(w, n - p0);
+        const size_t h = n - p0;
+        const size_t pld = panel.stride();
+        src->read_block(p0, p0, h, pw, panel.data(), pld);
+
+        // Unblocked partial-pivoting LU of the h x pw panel.
+        for (size_t j = 0; j < pw; j++) {
+            double *pivot_row = panel.data() + j * pld;
+            const size_t r = j + kernels.iamax(pivot_row + j, h - j, pld);
+            pivots[j] = r;
+            if (r != j) {
+                std::swap_ranges(pivot_row, pivot_row + pw, panel.data() + r * pld);
+                det = -det;
+            }
+            const double pivot = pivot_row[j];
+            if (pivot == 0) return 0;
+            det *= pivot;
+            const size_t parts = CostModel::instance().threads_for(WorkEstimate::elementwise(h - j, pw - j), m_threads);
+            ThreadPool::instance().parallel_ranges(j + 1, h, parts, 256, [&](size_t from, size_t to) {
+                for (size_t i = from; i < to; i++) {
+                    double *row = panel.data() + i * pld;
+                    const double l = row[j] /= pivot;
+                    kernels.axpy(-l, pivot_row + j + 1, row + j + 1, pw - j - 1);
+                }
+            });
+        }
+
+        // Trailing strips: swap, U12 = L11^-1 * A12, A22 -= L21 * U12, write A22 back.
+        const size_t c0 = p0 + pw;
+        double_buffered(ceil_div(n - c0, w), strips,
+                        [&](size_t s, Matrix &strip) {
+                            const size_t c = c0 + s * w;
+                            src->read_block(p0, c, h, std::min(w, n - c), strip.data(), strip.stride());
+                        },
+                        [&](size_t s, Matrix &strip) {
+                            const size_t c = c0 + s * w;
+                            const size_t cw = std::min(w, n - c);
+                            const size_t sld = strip.stride();
+                            double *top = strip.data();
+                            for (size_t j = 0; j < pw; j++) {
+                                if (pivots[j] != j) std::swap_ranges(top + j * sld, top + j * sld + cw, top + pivots[j] * sld);
+                            }
+                            for (size_t i = 1; i < pw; i++) {
+                                for (size_t j = 0; j < i; j++) {
+                                    const double l = panel.data()[i * pld + j];
+                                    if (l != 0) kernels.axpy(-l, top + j * sld, top + i * sld, cw);
+                                }
+                            }
+                            parallel_gemm(h - pw, cw, pw, -1.0, panel.data() + pw * pld, pld, top, sld,
+                                          top + pw * sld, sld, m_threads);
+                            work.write_block(c0, c, h - pw, cw, top + pw * sld, sld);
+                        });
+        src = &work;
+    }
+    return det;
+}
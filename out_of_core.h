@@ -0,0 +1,45 @@
+#pragma once
+
+#include "matrix.h"
+#include "matrix_file.h"
+#include <cstddef>
+#include <string>
+
+// Operations on matrix files (see matrix_file.h) that may be larger than memory. Operands are
+// streamed through tiles that together never exceed memory_budget bytes; while one tile is being
+// computed, the next one is read by a pool task (double buffering), so I/O overlaps computation.
+// Results are written tile by tile. Shape mismatches throw std::invalid_argument and a budget too
+// small for the minimal tiles throws std::length_error.
+class OutOfCoreEngine final {
+public:
+    // scratch_dir holds the temporary working file of det(); empty means the system temp directory.
+    explicit OutOfCoreEngine(size_t memory_budget,
+                             size_t num_of_threads = ThreadPool::instance().concurrency(),
+                             std::string scratch_dir = {});
+
+    // out = a + b, out = a - b.
+    void add(const std::string &a, const std::string &b, const std::string &out);
+
+    void subtract(const std::string &a, const std::string &b, const std::string &out);
+
+    // out = a * b with square-ish tiles: five of them (two of a, two of b, one of out) fit the budget.
+    void multiply(const std::string &a, const std::string &b, const std::string &out);
+
+    // Determinant by a right-looking LU on column panels: a panel is factored in memory, then the
+    // trailing matrix is streamed strip by strip from a scratch file, updated and written back.
+    // Only the pivots are kept, so three n-row strips must fit the budget.
+    double det(const std::string &a);
+
+    [[nodiscard]] size_t memory_budget() const;
+
+    // Tile memory held by the last operation.
+    [[nodiscard]] size_t peak_bytes() const;
+
+private:
+    size_t m_budget;
+    size_t m_threads;
+    std::string m_scratch_dir;
+    size_t m_peak = 0;
+
+    void elementwise(const std::string &a, const std::string &b, const std::string &out, bool subtract);
+};
@@ -0,0 +1,142 @@
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+namespace {
+
+int64_t steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Pool tasks the calling thread is inside of.
+thread_local size_t t_task_depth = 0;
+
+double to_us(uint64_t ns) {
+    return static_cast<double>(ns) / 1000.0;
+}
+
+}
+
+Profiler &Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+void Profiler::start() {
+    std::lock_guard lock(m_mutex);
+    m_events.clear();
+    m_origin = steady_ns();
+    m_stopped_at = 0;
+    m_recording = true;
+}
+
+void Profiler::stop() {
+    m_stopped_at = now_ns();
+    m_recording = false;
+}
+
+uint64_t Profiler::now_ns() const {
+    return static_cast<uint64_t>(std::max<int64_t>(steady_ns() - m_origin.load(std::memory_order_relaxed), 0));
+}
+
+uint64_t Profiler::window_ns() const {
+    return recording() ? now_ns() : m_stopped_at.load();
+}
+
+void Profiler::record(const ProfileEvent &event) {
+    std::lock_guard lock(m_mutex);
+    m_events.push_back(event);
+}
+
+std::vector<ProfileEvent> Profiler::events() const {
+    std::lock_guard lock(m_mutex);
+    return m_events;
+}
+
+std::vector<ThreadUtilization> Profiler::utilization() const {
+    const uint64_t window = window_ns();
+    std::map<size_t, ThreadUtilization> threads;
+    for (const ProfileEvent &event: events()) {
+        if (event.threads != 0 || event.nested) continue;
+        ThreadUtilization &entry = threads.try_emplace(event.thread, ThreadUtilization{event.thread, 0, 0, 0})
+                .first->second;
+        entry.busy_ns += event.duration_ns;
+        entry.tasks++;
+    }
+    std::vector<ThreadUtilization> result;
+    for (auto &[thread, entry]: threads) {
+        entry.idle_ns = window > entry.busy_ns ? window - entry.busy_ns : 0;
+        result.push_back(entry);
+    }
+    return result;
+}
+
+void Profiler::write_json(std::ostream &out) const {
+    const std::vector<ProfileEvent> recorded = events();
+    out << "{\"duration_us\": " << to_us(window_ns()) << ", \"operations\": [";
+    for (size_t i = 0; i < recorded.size(); i++) {
+        const ProfileEvent &event = recorded[i];
+        out << (i == 0 ? "" : ", ") << "{\"name\": \"" << event.name << "\", \"thread\": " << event.thread
+            << ", \"start_us\": " << to_us(event.start_ns) << ", \"duration_us\": " << to_us(event.duration_ns)
+            << ", \"threads\": " << event.threads << ", \"flops\": " << event.flops
+            << ", \"bytes\": " << event.bytes << "}";
+    }
+    out << "], \"threads\": [";
+    const std::vector<ThreadUtilization> threads = utilization();
+    for (size_t i = 0; i < threads.size(); i++) {
+        out << (i == 0 ? "" : ", ") << "{\"thread\": " << threads[i].thread
+            << ", \"busy_us\": " << to_us(threads[i].busy_ns) << ", \"idle_us\": " << to_us(threads[i].idle_ns)
+            << ", \"tasks\": " << threads[i].tasks << "}";
+    }
+    out << "]}\n";
+}
+
+void Profiler::write_chrome_trace(std::ostream &out) const {
+    const std::vector<ProfileEvent> recorded = events();
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    for (size_t i = 0; i < recorded.size(); i++) {
+        const ProfileEvent &event = recorded[i];
+        out << (i == 0 ? "" : ",\n") << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1"
+            << ", \"tid\": " << event.thread << ", \"ts\": " << to_us(event.start_ns)
+            << ", \"dur\": " << to_us(event.duration_ns) << ", \"args\": {\"threads\": " << event.threads
+            << ", \"flops\": " << event.flops << ", \"bytes\": " << event.bytes << "}}";
+    }
+    out << "]}\n";
+}
+
+size_t Profiler::thread_index() {
+    static std::atomic<size_t> next{0};
+    thread_local const size_t index = next.fetch_add(1);
+    return index;
+}
+
+ProfileScope::ProfileScope(const char *name, const WorkEstimate &work, size_t threads)
+        : m_name(name), m_start(0), m_threads(threads), m_flops(work.flops), m_bytes(work.bytes),
+          m_active(Profiler::instance().recording()) {
+    if (m_active) m_start = Profiler::instance().now_ns();
+}
+
+ProfileScope::~ProfileScope() {
+    if (!m_active) return;
+    Profiler &profiler = Profiler::instance();
+    const uint64_t end = profiler.now_ns();
+    const uint64_t duration = end > m_start ? end - m_start : 0;
+    profiler.record({m_name, Profiler::thread_index(), m_start, duration, m_threads, m_flops, m_bytes, false});
+}
+
+ProfileTask::ProfileTask()
+        : m_start(0), m_active(Profiler::instance().recording()), m_nested(t_task_depth > 0) {
+    t_task_depth++;
+    if (m_active) m_start = Profiler::instance().now_ns();
+}
+
+ProfileTask::~ProfileTask() {
+    t_task_depth--;
+    if (!m_active) return;
+    Profiler &profiler = Profiler::instance();
+    const uint64_t end = profiler.now_ns();
+    const uint64_t duration = end > m_start ? end - m_start : 0;
+    profiler.record({"task", Profiler::thread_index(), m_start, duration, 0, 0, 0, m_nested});
+}
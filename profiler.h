@@ -0,0 +1,139 @@
+#pragma once
+
+#include "cost_model.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Hot-path instrumentation. Configuring with -DMATRIX_INSTRUMENTATION=ON compiles hooks into the
+// fast_* paths, CalculationManager::calculate and the ThreadPool; without it the
+// MATRIX_PROFILE_* macros expand to nothing and none of this costs a cycle. Even when compiled
+// in, the hooks only record between Profiler::start() and stop():
+//
+//     Profiler::instance().start();
+//     a.fast_multiply_with(b);
+//     Profiler::instance().stop();
+//     Profiler::instance().write_chrome_trace(file);   // chrome://tracing or ui.perfetto.dev
+//
+// Operations record their wall time, the thread count they chose and the flops / bytes of their
+// WorkEstimate; every pool task (each make_intervals range, for instance) records its own span,
+// which is what shows an uneven split between the workers.
+
+struct ProfileEvent {
+    // A string literal: names are written out as they are, without escaping.
+    const char *name;
+    // Profiler::thread_index() of the thread that ran it.
+    size_t thread;
+    // Nanoseconds since Profiler::start().
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    // Threads the operation chose; 0 for pool tasks.
+    size_t threads;
+    double flops;
+    double bytes;
+    // A pool task run while its thread was waiting inside another task; not counted as busy time.
+    bool nested;
+};
+
+struct ThreadUtilization {
+    size_t thread;
+    // Time in (outermost) pool tasks; idle_ns is the rest of the recording window.
+    uint64_t busy_ns;
+    uint64_t idle_ns;
+    size_t tasks;
+};
+
+class Profiler final {
+public:
+    static Profiler &instance();
+
+    // Drops the previous recording and starts a new one.
+    void start();
+
+    void stop();
+
+    [[nodiscard]] bool recording() const {
+        return m_recording.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t now_ns() const;
+
+    void record(const ProfileEvent &event);
+
+    [[nodiscard]] std::vector<ProfileEvent> events() const;
+
+    // One entry per thread that ran a pool task, ordered by thread index.
+    [[nodiscard]] std::vector<ThreadUtilization> utilization() const;
+
+    // {"duration_us": ..., "operations": [...], "threads": [...]}: the events (pool tasks
+    // included) and utilization().
+    void write_json(std::ostream &out) const;
+
+    // Trace Event Format: one complete ("X") event per recorded event, a track per thread.
+    void write_chrome_trace(std::ostream &out) const;
+
+    // Small dense id of the calling thread, assigned on first use.
+    static size_t thread_index();
+
+private:
+    std::atomic<bool> m_recording{false};
+    std::atomic<int64_t> m_origin{0};
+    std::atomic<uint64_t> m_stopped_at{0};
+    mutable std::mutex m_mutex;
+    std::vector<ProfileEvent> m_events;
+
+    Profiler() = default;
+
+    [[nodiscard]] uint64_t window_ns() const;
+};
+
+// Records one operation from construction to destruction, if the profiler is recording then.
+class ProfileScope final {
+public:
+    ProfileScope(const char *name, const WorkEstimate &work, size_t threads);
+
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope &) = delete;
+
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *m_name;
+    uint64_t m_start;
+    size_t m_threads;
+    double m_flops;
+    double m_bytes;
+    bool m_active;
+};
+
+// Records one pool task; see ProfileEvent::nested.
+class ProfileTask final {
+public:
+    ProfileTask();
+
+    ~ProfileTask();
+
+    ProfileTask(const ProfileTask &) = delete;
+
+    ProfileTask &operator=(const ProfileTask &) = delete;
+
+private:
+    uint64_t m_start;
+    bool m_active;
+    bool m_nested;
+};
+
+#ifdef MATRIX_INSTRUMENTATION
+#define MATRIX_PROFILE_CONCAT_IMPL(a, b) a##b
+#define MATRIX_PROFILE_CONCAT(a, b) MATRIX_PROFILE_CONCAT_IMPL(a, b)
+#define MATRIX_PROFILE_SCOPE(name, work, threads) \
+    const ProfileScope MATRIX_PROFILE_CONCAT(profile_scope_, __LINE__)(name, work, threads)
+#define MATRIX_PROFILE_TASK() const ProfileTask MATRIX_PROFILE_CONCAT(profile_task_, __LINE__)
+#else
+#define MATRIX_PROFILE_SCOPE(name, work, threads) static_cast<void>(0)
+#define MATRIX_PROFILE_TASK() static_cast<void>(0)
+#endif
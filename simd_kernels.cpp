@@ -0,0 +1,465 @@
+#include "simd_kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MATRIX_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t MR = 4;
+constexpr size_t NR = 8;
+
+void add_scalar(const double *a, const double *b, double *out, size_t n) {
+    for (size_t j = 0; j < n; j++) out[j] = a[j] + b[j];
+}
+
+void sub_scalar(const double *a, const double *b, double *out, size_t n) {
+    for (size_t j = 0; j < n; j++) out[j] = a[j] - b[j];
+}
+
+void add_scaled_scalar(const double *a, double alpha, const double *b, double *out, size_t n) {
+    for (size_t j = 0; j < n; j++) out[j] = a[j] + alpha * b[j];
+}
+
+void scale_scalar(double alpha, const double *a, double *out, size_t n) {
+    for (size_t j = 0; j < n; j++) out[j] = alpha * a[j];
+}
+
+void axpy_scalar(double alpha, const double *x, double *y, size_t n) {
+    for (size_t j = 0; j < n; j++) y[j] += alpha * x[j];
+}
+
+// Adds x[from..n) * y[from..n) to the lanes (element j to lane j % 8) and combines them.
+double dot_finish(double *lanes, const double *x, const double *y, size_t from, size_t n) {
+    for (size_t j = from; j < n; j++) lanes[j % 8] += x[j] * y[j];
+    return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+}
+
+double dot_scalar(const double *x, const double *y, size_t n) {
+    double lanes[8] = {};
+    return dot_finish(lanes, x, y, 0, n);
+}
+
+size_t iamax_scalar(const double *x, size_t n, size_t stride) {
+    if (n == 0) return 0;
+    double max = std::abs(x[0]);
+    size_t max_pos = 0;
+    for (size_t i = 1; i < n; i++) {
+        const double element = std::abs(x[i * stride]);
+        if (element > max) {
+            max = element;
+            max_pos = i;
+        }
+    }
+    return max_pos;
+}
+
+void gemm_tile_scalar(size_t kc, const double *a, const double *b, double *acc) {
+    for (size_t kk = 0; kk < kc; kk++) {
+        for (size_t r = 0; r < MR; r++) {
+            const double a_r = a[r];
+            for (size_t c = 0; c < NR; c++) {
+                acc[r * NR + c] += a_r * b[c];
+            }
+        }
+        a += MR;
+        b += NR;
+    }
+}
+
+// Finishes an iamax whose vector part left per-lane maxima (first occurrence within the lane)
+// in values/indices; scans x[from..n) like the scalar loop.
+size_t iamax_finish(const double *values, const long long *indices, size_t lanes,
+                    const double *x, size_t from, size_t n, size_t stride) {
+    double max = -1;
+    size_t max_pos = 0;
+    for (size_t lane = 0; lane < lanes; lane++) {
+        const auto index = static_cast<size_t>(indices[lane]);
+        if (values[lane] > max || (values[lane] == max && index < max_pos)) {
+            max = values[lane];
+            max_pos = index;
+        }
+    }
+    for (size_t i = from; i < n; i++) {
+        const double element = std::abs(x[i * stride]);
+        if (element > max) {
+            max = element;
+            max_pos = i;
+        }
+    }
+    return max_pos;
+}
+
+constexpr SimdKernels kScalar{SimdLevel::Scalar, "scalar", add_scalar, sub_scalar, add_scaled_scalar,
+                              scale_scalar, axpy_scalar, dot_scalar, iamax_scalar, gemm_tile_scalar};
+
+#ifdef MATRIX_SIMD_X86
+
+void add_sse2(const double *a, const double *b, double *out, size_t n) {
+    size_t j = 0;
+    for (; j + 2 <= n; j += 2) {
+        _mm_storeu_pd(out + j, _mm_add_pd(_mm_loadu_pd(a + j), _mm_loadu_pd(b + j)));
+    }
+    add_scalar(a + j, b + j, out + j, n - j);
+}
+
+void sub_sse2(const double *a, const double *b, double *out, size_t n) {
+    size_t j = 0;
+    for (; j + 2 <= n; j += 2) {
+        _mm_storeu_pd(out + j, _mm_sub_pd(_mm_loadu_pd(a + j), _mm_loadu_pd(b + j)));
+    }
+    sub_scalar(a + j, b + j, out + j, n - j);
+}
+
+void add_scaled_sse2(const double *a, double alpha, const double *b, double *out, size_t n) {
+    const __m128d va = _mm_set1_pd(alpha);
+    size_t j = 0;
+    for (; j + 2 <= n; j += 2) {
+        _mm_storeu_pd(out + j, _mm_add_pd(_mm_loadu_pd(a + j), _mm_mul_pd(va, _mm_loadu_pd(b + j))));
+    }
+    add_scaled_scalar(a + j, alpha, b + j, out + j, n - j);
+}
+
+void scale_sse2(double alpha, const double *a, double *out, size_t n) {
+    const __m128d va = _mm_set1_pd(alpha);
+    size_t j = 0;
+    for (; j + 2 <= n; j += 2) {
+        _mm_storeu_pd(out + j, _mm_mul_pd(va, _mm_loadu_pd(a + j)));
+    }
+    scale_scalar(alpha, a + j, out + j, n - j);
+}
+
+void axpy_sse2(double alpha, const double *x, double *y, size_t n) {
+    const __m128d va = _mm_set1_pd(alpha);
+    size_t j = 0;
+    for (; j + 2 <= n; j += 2) {
+        _mm_storeu_pd(y + j, _mm_add_pd(_mm_loadu_pd(y + j), _mm_mul_pd(va, _mm_loadu_pd(x + j))));
+    }
+    axpy_scalar(alpha, x + j, y + j, n - j);
+}
+
+double dot_sse2(const double *x, const double *y, size_t n) {
+    __m128d acc[4] = {_mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd()};
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        for (size_t k = 0; k < 4; k++) {
+            acc[k] = _mm_add_pd(acc[k], _mm_mul_pd(_mm_loadu_pd(x + j + 2 * k), _mm_loadu_pd(y + j + 2 * k)));
+        }
+    }
+    double lanes[8];
+    for (size_t k = 0; k < 4; k++) _mm_storeu_pd(lanes + 2 * k, acc[k]);
+    return dot_finish(lanes, x, y, j, n);
+}
+
+void gemm_tile_sse2(size_t kc, const double *a, const double *b, double *acc) {
+    __m128d c[MR][NR / 2];
+    for (size_t r = 0; r < MR; r++)
+        for (size_t q = 0; q < NR / 2; q++) c[r][q] = _mm_loadu_pd(acc + r * NR + 2 * q);
+    for (size_t kk = 0; kk < kc; kk++) {
+        const __m128d b0 = _mm_loadu_pd(b), b1 = _mm_loadu_pd(b + 2);
+        const __m128d b2 = _mm_loadu_pd(b + 4), b3 = _mm_loadu_pd(b + 6);
+        for (size_t r = 0; r < MR; r++) {
+            const __m128d a_r = _mm_set1_pd(a[r]);
+            c[r][0] = _mm_add_pd(c[r][0], _mm_mul_pd(a_r, b0));
+            c[r][1] = _mm_add_pd(c[r][1], _mm_mul_pd(a_r, b1));
+            c[r][2] = _mm_add_pd(c[r][2], _mm_mul_pd(a_r, b2));
+            c[r][3] = _mm_add_pd(c[r][3], _mm_mul_pd(a_r, b3));
+        }
+        a += MR;
+        b += NR;
+    }
+    for (size_t r = 0; r < MR; r++)
+        for (size_t q = 0; q < NR / 2; q++) _mm_storeu_pd(acc + r * NR + 2 * q, c[r][q]);
+}
+
+constexpr SimdKernels kSSE2{SimdLevel::SSE2, "sse2", add_sse2, sub_sse2, add_scaled_sse2,
+                            scale_sse2, axpy_sse2, dot_sse2, iamax_scalar, gemm_tile_sse2};
+
+__attribute__((target("avx2")))
+void add_avx2(const double *a, const double *b, double *out, size_t n) {
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        _mm256_storeu_pd(out + j, _mm256_add_pd(_mm256_loadu_pd(a + j), _mm256_loadu_pd(b + j)));
+    }
+    add_scalar(a + j, b + j, out + j, n - j);
+}
+
+__attribute__((target("avx2")))
+void sub_avx2(const double *a, const double *b, double *out, size_t n) {
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        _mm256_storeu_pd(out + j, _mm256_sub_pd(_mm256_loadu_pd(a + j), _mm256_loadu_pd(b + j)));
+    }
+    sub_scalar(a + j, b + j, out + j, n - j);
+}
+
+__attribute__((target("avx2")))
+void add_scaled_avx2(const double *a, double alpha, const double *b, double *out, size_t n) {
+    const __m256d va = _mm256_set1_pd(alpha);
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        _mm256_storeu_pd(out + j, _mm256_add_pd(_mm256_loadu_pd(a + j), _mm256_mul_pd(va, _mm256_loadu_pd(b + j))));
+    }
+    add_scaled_scalar(a + j, alpha, b + j, out + j, n - j);
+}
+
+__attribute__((target("avx2")))
+void scale_avx2(double alpha, const double *a, double *out, size_t n) {
+    const __m256d va = _mm256_set1_pd(alpha);
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        _mm256_storeu_pd(out + j, _mm256_mul_pd(va, _mm256_loadu_pd(a + j)));
+    }
+    scale_scalar(alpha, a + j, out + j, n - j);
+}
+
+__attribute__((target("avx2")))
+void axpy_avx2(double alpha, const double *x, double *y, size_t n) {
+    const __m256d va = _mm256_set1_pd(alpha);
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        _mm256_storeu_pd(y + j, _mm256_add_pd(_mm256_loadu_pd(y + j), _mm256_mul_pd(va, _mm256_loadu_pd(x + j))));
+    }
+    axpy_scalar(alpha, x + j, y + j, n - j);
+}
+
+__attribute__((target("avx2")))
+double dot_avx2(const double *x, const double *y, size_t n) {
+    __m256d low = _mm256_setzero_pd();
+    __m256d high = _mm256_setzero_pd();
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        low = _mm256_add_pd(low, _mm256_mul_pd(_mm256_loadu_pd(x + j), _mm256_loadu_pd(y + j)));
+        high = _mm256_add_pd(high, _mm256_mul_pd(_mm256_loadu_pd(x + j + 4), _mm256_loadu_pd(y + j + 4)));
+    }
+    double lanes[8];
+    _mm256_storeu_pd(lanes, low);
+    _mm256_storeu_pd(lanes + 4, high);
+    return dot_finish(lanes, x, y, j, n);
+}
+
+__attribute__((target("avx2")))
+size_t iamax_avx2(const double *x, size_t n, size_t stride) {
+    if (n < 8 || std::isnan(x[0])) return iamax_scalar(x, n, stride);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const auto step = static_cast<long long>(4 * stride);
+    __m256i offsets = _mm256_set_epi64x(3 * static_cast<long long>(stride), 2 * static_cast<long long>(stride),
+                                        static_cast<long long>(stride), 0);
+    __m256i index = _mm256_set_epi64x(3, 2, 1, 0);
+    const __m256i four = _mm256_set1_epi64x(4);
+    const __m256i advance = _mm256_set1_epi64x(step);
+    __m256d best = _mm256_set1_pd(-1);
+    __m256i best_index = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m256d v = _mm256_andnot_pd(sign, _mm256_i64gather_pd(x, offsets, 8));
+        const __m256d greater = _mm256_cmp_pd(v, best, _CMP_GT_OQ);
+        best = _mm256_blendv_pd(best, v, greater);
+        best_index = _mm256_blendv_epi8(best_index, index, _mm256_castpd_si256(greater));
+        offsets = _mm256_add_epi64(offsets, advance);
+        index = _mm256_add_epi64(index, four);
+    }
+    alignas(32) double values[4];
+    alignas(32) long long indices[4];
+    _mm256_store_pd(values, best);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(indices), best_index);
+    return iamax_finish(values, indices, 4, x, i, n, stride);
+}
+
+__attribute__((target("avx2")))
+void gemm_tile_avx2(size_t kc, const double *a, const double *b, double *acc) {
+    __m256d c[MR][2];
+    for (size_t r = 0; r < MR; r++) {
+        c[r][0] = _mm256_loadu_pd(acc + r * NR);
+        c[r][1] = _mm256_loadu_pd(acc + r * NR + 4);
+    }
+    for (size_t kk = 0; kk < kc; kk++) {
+        const __m256d b0 = _mm256_loadu_pd(b);
+        const __m256d b1 = _mm256_loadu_pd(b + 4);
+        for (size_t r = 0; r < MR; r++) {
+            const __m256d a_r = _mm256_broadcast_sd(a + r);
+            c[r][0] = _mm256_add_pd(c[r][0], _mm256_mul_pd(a_r, b0));
+            c[r][1] = _mm256_add_pd(c[r][1], _mm256_mul_pd(a_r, b1));
+        }
+        a += MR;
+        b += NR;
+    }
+    for (size_t r = 0; r < MR; r++) {
+        _mm256_storeu_pd(acc + r * NR, c[r][0]);
+        _mm256_storeu_pd(acc + r * NR + 4, c[r][1]);
+    }
+}
+
+constexpr SimdKernels kAVX2{SimdLevel::AVX2, "avx2", add_avx2, sub_avx2, add_scaled_avx2,
+                            scale_avx2, axpy_avx2, dot_avx2, iamax_avx2, gemm_tile_avx2};
+
+__attribute__((target("avx512f")))
+void add_avx512(const double *a, const double *b, double *out, size_t n) {
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        _mm512_storeu_pd(out + j, _mm512_add_pd(_mm512_loadu_pd(a + j), _mm512_loadu_pd(b + j)));
+    }
+    add_scalar(a + j, b + j, out + j, n - j);
+}
+
+__attribute__((target("avx512f")))
+void sub_avx512(const double *a, const double *b, double *out, size_t n) {
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        _mm512_storeu_pd(out + j, _mm512_sub_pd(_mm512_loadu_pd(a + j), _mm512_loadu_pd(b + j)));
+    }
+    sub_scalar(a + j, b + j, out + j, n - j);
+}
+
+__attribute__((target("avx512f")))
+void add_scaled_avx512(const double *a, double alpha, const double *b, double *out, size_t n) {
+    const __m512d va = _mm512_set1_pd(alpha);
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        _mm512_storeu_pd(out + j, _mm512_add_pd(_mm512_loadu_pd(a + j), _mm512_mul_pd(va, _mm512_loadu_pd(b + j))));
+    }
+    add_scaled_scalar(a + j, alpha, b + j, out + j, n - j);
+}
+
+__attribute__((target("avx512f")))
+void scale_avx512(double alpha, const double *a, double *out, size_t n) {
+    const __m512d va = _mm512_set1_pd(alpha);
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        _mm512_storeu_pd(out + j, _mm512_mul_pd(va, _mm512_loadu_pd(a + j)));
+    }
+    scale_scalar(alpha, a + j, out + j, n - j);
+}
+
+__attribute__((target("avx512f")))
+void axpy_avx512(double alpha, const double *x, double *y, size_t n) {
+    const __m512d va = _mm512_set1_pd(alpha);
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        _mm512_storeu_pd(y + j, _mm512_add_pd(_mm512_loadu_pd(y + j), _mm512_mul_pd(va, _mm512_loadu_pd(x + j))));
+    }
+    axpy_scalar(alpha, x + j, y + j, n - j);
+}
+
+__attribute__((target("avx512f")))
+double dot_avx512(const double *x, const double *y, size_t n) {
+    __m512d acc = _mm512_setzero_pd();
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        acc = _mm512_add_pd(acc, _mm512_mul_pd(_mm512_loadu_pd(x + j), _mm512_loadu_pd(y + j)));
+    }
+    double lanes[8];
+    _mm512_storeu_pd(lanes, acc);
+    return dot_finish(lanes, x, y, j, n);
+}
+
+__attribute__((target("avx512f")))
+size_t iamax_avx512(const double *x, size_t n, size_t stride) {
+    if (n < 16 || std::isnan(x[0])) return iamax_scalar(x, n, stride);
+    const auto s = static_cast<long long>(stride);
+    __m512i offsets = _mm512_set_epi64(7 * s, 6 * s, 5 * s, 4 * s, 3 * s, 2 * s, s, 0);
+    __m512i index = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m512i eight = _mm512_set1_epi64(8);
+    const __m512i advance = _mm512_set1_epi64(8 * s);
+    __m512d best = _mm512_set1_pd(-1);
+    __m512i best_index = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m512d v = _mm512_abs_pd(_mm512_mask_i64gather_pd(_mm512_setzero_pd(), 0xFF, offsets, x, 8));
+        const __mmask8 greater = _mm512_cmp_pd_mask(v, best, _CMP_GT_OQ);
+        best = _mm512_mask_blend_pd(greater, best, v);
+        best_index = _mm512_mask_blend_epi64(greater, best_index, index);
+        offsets = _mm512_add_epi64(offsets, advance);
+        index = _mm512_add_epi64(index, eight);
+    }
+    alignas(64) double values[8];
+    alignas(64) long long indices[8];
+    _mm512_store_pd(values, best);
+    _mm512_store_si512(indices, best_index);
+    return iamax_finish(values, indices, 8, x, i, n, stride);
+}
+
+__attribute__((target("avx512f")))
+void gemm_tile_avx512(size_t kc, const double *a, const double *b, double *acc) {
+    __m512d c[MR];
+    for (size_t r = 0; r < MR; r++) c[r] = _mm512_loadu_pd(acc + r * NR);
+    for (size_t kk = 0; kk < kc; kk++) {
+        const __m512d b_row = _mm512_loadu_pd(b);
+        for (size_t r = 0; r < MR; r++) {
+            c[r] = _mm512_add_pd(c[r], _mm512_mul_pd(_mm512_set1_pd(a[r]), b_row));
+        }
+        a += MR;
+        b += NR;
+    }
+    for (size_t r = 0; r < MR; r++) _mm512_storeu_pd(acc + r * NR, c[r]);
+}
+
+constexpr SimdKernels kAVX512{SimdLevel::AVX512, "avx512", add_avx512, sub_avx512, add_scaled_avx512,
+                              scale_avx512, axpy_avx512, dot_avx512, iamax_avx512, gemm_tile_avx512};
+
+#endif
+
+bool cpu_supports(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar:
+            return true;
+#ifdef MATRIX_SIMD_X86
+        case SimdLevel::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case SimdLevel::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case SimdLevel::AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+SimdLevel requested_level() {
+    const char *env = std::getenv("MATRIX_SIMD");
+    if (env == nullptr) return SimdLevel::AVX512;
+    if (std::strcmp(env, "scalar") == 0) return SimdLevel::Scalar;
+    if (std::strcmp(env, "sse2") == 0) return SimdLevel::SSE2;
+    if (std::strcmp(env, "avx2") == 0) return SimdLevel::AVX2;
+    return SimdLevel::AVX512;
+}
+
+}
+
+SimdLevel detected_simd_level() {
+    for (auto level: {SimdLevel::AVX512, SimdLevel::AVX2, SimdLevel::SSE2}) {
+        if (cpu_supports(level)) return level;
+    }
+    return SimdLevel::Scalar;
+}
+
+const SimdKernels *simd_kernels_for(SimdLevel level) {
+    if (!cpu_supports(level)) return nullptr;
+    switch (level) {
+#ifdef MATRIX_SIMD_X86
+        case SimdLevel::SSE2:
+            return &kSSE2;
+        case SimdLevel::AVX2:
+            return &kAVX2;
+        case SimdLevel::AVX512:
+            return &kAVX512;
+#endif
+        default:
+            return &kScalar;
+    }
+}
+
+const SimdKernels &simd() {
+    static const SimdKernels &kernels = [] () -> const SimdKernels & {
+        const auto best = static_cast<int>(detected_simd_level());
+        const auto level = static_cast<SimdLevel>(std::min(best, static_cast<int>(requested_level())));
+        return *simd_kernels_for(level);
+    }();
+    return kernels;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+// Table of the innermost loops. Every implementation performs the same operations in the same
+// order per element (no FMA contraction), so all levels give bit-identical results.
+struct SimdKernels {
+    SimdLevel level;
+    const char *name;
+
+    // out[j] = a[j] + b[j]
+    void (*add)(const double *a, const double *b, double *out, size_t n);
+
+    // out[j] = a[j] - b[j]
+    void (*sub)(const double *a, const double *b, double *out, size_t n);
+
+    // out[j] = a[j] + alpha * b[j]
+    void (*add_scaled)(const double *a, double alpha, const double *b, double *out, size_t n);
+
+    // out[j] = alpha * a[j]
+    void (*scale)(double alpha, const double *a, double *out, size_t n);
+
+    // y[j] += alpha * x[j]; the row elimination step of triangulation and LU.
+    void (*axpy)(double alpha, const double *x, double *y, size_t n);
+
+    // sum of x[j] * y[j] in a fixed order: element j goes to partial sum j % 8 and the partial
+    // sums are added pairwise as ((s0 + s4) + (s2 + s6)) + ((s1 + s5) + (s3 + s7)).
+    double (*dot)(const double *x, const double *y, size_t n);
+
+    // Index of the first element of maximal magnitude in x[0], x[stride], ..., x[(n - 1) * stride].
+    size_t (*iamax)(const double *x, size_t n, size_t stride);
+
+    // acc[MR x NR] (row-major, zero on entry) += packed A sliver * packed B sliver over kc steps;
+    // the register tile of gemm (GemmBlocking::MR == 4, GemmBlocking::NR == 8).
+    void (*gemm_tile)(size_t kc, const double *a, const double *b, double *acc);
+};
+
+// Kernels for the best level the CPU supports, chosen once on first use with CPUID.
+// The MATRIX_SIMD environment variable (scalar, sse2, avx2, avx512) can lower the choice.
+const SimdKernels &simd();
+
+SimdLevel detected_simd_level();
+
+// Kernels of a given level, or nullptr if this CPU cannot run them.
+const SimdKernels *simd_kernels_for(SimdLevel level);
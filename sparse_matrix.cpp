@@ -0,0 +1,329 @@
+#include "sparse_matrix.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// CSR <-> CSC: counting sort of the entries by their minor index.
+void swap_compression(size_t major, size_t minor,
+                      const std::vector<size_t> &offsets, const std::vector<size_t> &indices,
+                      const std::vector<double> &values,
+                      std::vector<size_t> &out_offsets, std::vector<size_t> &out_indices,
+                      std::vector<double> &out_values) {
+    out_offsets.assign(minor + 1, 0);
+    for (size_t index: indices) {
+        out_offsets[index + 1]++;
+    }
+    for (size_t i = 0; i < minor; i++) {
+        out_offsets[i + 1] += out_offsets[i];
+    }
+    out_indices.resize(indices.size());
+    out_values.resize(values.size());
+    std::vector<size_t> next(out_offsets.begin(), out_offsets.end() - 1);
+    // Walking the old majors in order keeps the new minor indices sorted.
+    for (size_t i = 0; i < major; i++) {
+        for (size_t k = offsets[i]; k < offsets[i + 1]; k++) {
+            const size_t position = next[indices[k]]++;
+            out_indices[position] = i;
+            out_values[position] = values[k];
+        }
+    }
+}
+
+const SparseMatrix &as_csr(const SparseMatrix &mat, SparseMatrix &converted) {
+    if (mat.format() == SparseMatrix::Format::CSR) return mat;
+    converted = mat.to_csr();
+    return converted;
+}
+
+}
+
+SparseMatrix::SparseMatrix(size_t nRows, size_t nCols, Format format)
+        : m_format(format), m_rows(nRows), m_cols(nCols),
+          m_offsets((format == Format::CSR ? nRows : nCols) + 1, 0) {}
+
+SparseMatrix SparseMatrix::from_entries(size_t nRows, size_t nCols, std::vector<SparseEntry> entries, Format format) {
+    SparseMatrix sparse(nRows, nCols, format);
+    const bool csr = format == Format::CSR;
+    const auto major = [csr](const SparseEntry &e) { return csr ? e.row : e.col; };
+    const auto minor = [csr](const SparseEntry &e) { return csr ? e.col : e.row; };
+    std::sort(entries.begin(), entries.end(), [&](const SparseEntry &l, const SparseEntry &r) {
+        return major(l) != major(r) ? major(l) < major(r) : minor(l) < minor(r);
+    });
+    const SparseEntry *previous = nullptr;
+    for (const SparseEntry &entry: entries) {
+        if (entry.row >= nRows || entry.col >= nCols) continue;
+        if (previous != nullptr && previous->row == entry.row && previous->col == entry.col) {
+            sparse.m_values.back() += entry.value;
+            continue;
+        }
+        sparse.m_indices.push_back(minor(entry));
+        sparse.m_values.push_back(entry.value);
+        sparse.m_offsets[major(entry) + 1]++;
+        previous = &entry;
+    }
+    for (size_t i = 1; i < sparse.m_offsets.size(); i++) {
+        sparse.m_offsets[i] += sparse.m_offsets[i - 1];
+    }
+    return sparse;
+}
+
+SparseMatrix SparseMatrix::from_dense(const Matrix &dense, double tolerance, Format format) {
+    SparseMatrix sparse(dense.getRows(), dense.getCols());
+    for (size_t i = 0; i < dense.getRows(); i++) {
+        const auto row = dense.row(i);
+        for (size_t j = 0; j < row.size(); j++) {
+            if (std::abs(row[j]) > tolerance) {
+                sparse.m_indices.push_back(j);
+                sparse.m_values.push_back(row[j]);
+            }
+        }
+        sparse.m_offsets[i + 1] = sparse.m_indices.size();
+    }
+    return format == Format::CSR ? sparse : sparse.to_csc();
+}
+
+Matrix SparseMatrix::to_dense() const {
+    Matrix dense(m_rows, m_cols);
+    const size_t major = m_offsets.size() - 1;
+    for (size_t i = 0; i < major; i++) {
+        for (size_t k = m_offsets[i]; k < m_offsets[i + 1]; k++) {
+            if (m_format == Format::CSR) {
+                dense.at(i, m_indices[k]) = m_values[k];
+            } else {
+                dense.at(m_indices[k], i) = m_values[k];
+            }
+        }
+    }
+    return dense;
+}
+
+SparseMatrix SparseMatrix::to_csr() const {
+    if (m_format == Format::CSR) return *this;
+    SparseMatrix csr(m_rows, m_cols, Format::CSR);
+    swap_compression(m_cols, m_rows, m_offsets, m_indices, m_values, csr.m_offsets, csr.m_indices, csr.m_values);
+    return csr;
+}
+
+SparseMatrix SparseMatrix::to_csc() const {
+    if (m_format == Format::CSC) return *this;
+    SparseMatrix csc(m_rows, m_cols, Format::CSC);
+    swap_compression(m_rows, m_cols, m_offsets, m_indices, m_values, csc.m_offsets, csc.m_indices, csc.m_values);
+    return csc;
+}
+
+SparseMatrix SparseMatrix::transposed() const {
+    // The CSR arrays of A are the CSC arrays of A^T.
+    SparseMatrix transposed(*this);
+    transposed.m_format = m_format == Format::CSR ? Format::CSC : Format::CSR;
+    std::swap(transposed.m_rows, transposed.m_cols);
+    return transposed;
+}
+
+SparseMatrix::Format SparseMatrix::format() const {
+    return m_format;
+}
+
+size_t SparseMatrix::getRows() const {
+    return m_rows;
+}
+
+size_t SparseMatrix::getCols() const {
+    return m_cols;
+}
+
+size_t SparseMatrix::nonZeros() const {
+    return m_values.size();
+}
+
+const std::vector<size_t> &SparseMatrix::offsets() const {
+    return m_offsets;
+}
+
+const std::vector<size_t> &SparseMatrix::indices() const {
+    return m_indices;
+}
+
+const std::vector<double> &SparseMatrix::values() const {
+    return m_values;
+}
+
+double SparseMatrix::at(size_t i, size_t j) const {
+    const size_t major = m_format == Format::CSR ? i : j;
+    const size_t minor = m_format == Format::CSR ? j : i;
+    const auto begin = m_indices.begin() + static_cast<std::ptrdiff_t>(m_offsets[major]);
+    const auto end = m_indices.begin() + static_cast<std::ptrdiff_t>(m_offsets[major + 1]);
+    const auto found = std::lower_bound(begin, end, minor);
+    return found != end && *found == minor ? m_values[static_cast<size_t>(found - m_indices.begin())] : 0.0;
+}
+
+std::vector<std::pair<size_t, size_t>> SparseMatrix::make_intervals(size_t count) const {
+    count = std::max<size_t>(1, std::min(count, m_rows));
+    std::vector<std::pair<size_t, size_t>> intervals(count);
+    const size_t nnz = nonZeros();
+    size_t begin = 0;
+    for (size_t t = 0; t < count; t++) {
+        size_t end = m_rows;
+        if (t + 1 < count) {
+            if (nnz == 0) {
+                end = (t + 1) * (m_rows / count);
+            } else {
+                // First row whose entries start at or after the t+1-th share of nnz.
+                const size_t target = (t + 1) * nnz / count;
+                end = static_cast<size_t>(std::lower_bound(m_offsets.begin(), m_offsets.end(), target) -
+                                          m_offsets.begin());
+                end = std::clamp(end, begin, m_rows);
+            }
+        }
+        intervals[t] = {begin, end};
+        begin = end;
+    }
+    return intervals;
+}
+
+size_t SparseMatrix::plan_intervals(double flops, double bytes, size_t num_of_threads) const {
+    WorkEstimate work;
+    work.flops = flops;
+    work.bytes = bytes;
+    work.max_parallelism = m_rows;
+    return CostModel::instance().threads_for(work, num_of_threads);
+}
+
+std::vector<double> SparseMatrix::multiply(const std::vector<double> &x, size_t num_of_threads) const {
+    if (x.size() != m_cols) return {};
+    SparseMatrix converted;
+    const SparseMatrix &a = as_csr(*this, converted);
+    std::vector<double> y(m_rows, 0.0);
+    const auto nnz = static_cast<double>(nonZeros());
+    const auto intervals = a.make_intervals(
+            plan_intervals(2 * nnz, nnz * (sizeof(double) + sizeof(size_t)) + sizeof(double) * (m_rows + m_cols),
+                           num_of_threads));
+    ThreadPool::instance().parallel_for(intervals.size(), [&](size_t t) {
+        for (size_t i = intervals[t].first; i < intervals[t].second; i++) {
+            double sum = 0;
+            for (size_t k = a.m_offsets[i]; k < a.m_offsets[i + 1]; k++) {
+                sum += a.m_values[k] * x[a.m_indices[k]];
+            }
+            y[i] = sum;
+        }
+    });
+    return y;
+}
+
+Matrix SparseMatrix::multiply(const Matrix &b, size_t num_of_threads) const {
+    if (b.getRows() != m_cols) return {};
+    SparseMatrix converted;
+    const SparseMatrix &a = as_csr(*this, converted);
+    const size_t n = b.getCols();
+    Matrix out(m_rows, n);
+    const auto nnz = static_cast<double>(nonZeros());
+    const auto intervals = a.make_intervals(
+            plan_intervals(2 * nnz * static_cast<double>(n), 2 * nnz * static_cast<double>(n) * sizeof(double),
+                           num_of_threads));
+    ThreadPool::instance().parallel_for(intervals.size(), [&](size_t t) {
+        const SimdKernels &kernels = simd();
+        for (size_t i = intervals[t].first; i < intervals[t].second; i++) {
+            double *row = out.row(i).data();
+            for (size_t k = a.m_offsets[i]; k < a.m_offsets[i + 1]; k++) {
+                kernels.axpy(a.m_values[k], b.row(a.m_indices[k]).data(), row, n);
+            }
+        }
+    });
+    return out;
+}
+
+SparseMatrix SparseMatrix::multiply(const SparseMatrix &b, size_t num_of_threads) const {
+    if (b.m_rows != m_cols) return {};
+    SparseMatrix converted_a;
+    SparseMatrix converted_b;
+    const SparseMatrix &a = as_csr(*this, converted_a);
+    const SparseMatrix &rhs = as_csr(b, converted_b);
+
+    // Every entry a_ik pulls in row k of B: estimate the work by the average row of B.
+    const double average_row = m_cols == 0 ? 0 : static_cast<double>(rhs.nonZeros()) / static_cast<double>(m_cols);
+    const double products = static_cast<double>(nonZeros()) * average_row;
+    const auto intervals = a.make_intervals(
+            plan_intervals(2 * products, products * (sizeof(double) + sizeof(size_t)), num_of_threads));
+
+    // Each interval builds its rows with a dense accumulator, then the pieces are concatenated.
+    struct Piece {
+        std::vector<size_t> row_sizes;
+        std::vector<size_t> indices;
+        std::vector<double> values;
+    };
+    std::vector<Piece> pieces(intervals.size());
+    const size_t n = rhs.m_cols;
+    ThreadPool::instance().parallel_for(intervals.size(), [&](size_t t) {
+        Piece &piece = pieces[t];
+        std::vector<double> accumulator(n, 0.0);
+        std::vector<size_t> marker(n, std::numeric_limits<size_t>::max());
+        std::vector<size_t> touched;
+        for (size_t i = intervals[t].first; i < intervals[t].second; i++) {
+            touched.clear();
+            for (size_t k = a.m_offsets[i]; k < a.m_offsets[i + 1]; k++) {
+                const size_t inner = a.m_indices[k];
+                const double value = a.m_values[k];
+                for (size_t l = rhs.m_offsets[inner]; l < rhs.m_offsets[inner + 1]; l++) {
+                    const size_t j = rhs.m_indices[l];
+                    if (marker[j] != i) {
+                        marker[j] = i;
+                        accumulator[j] = value * rhs.m_values[l];
+                        touched.push_back(j);
+                    } else {
+                        accumulator[j] += value * rhs.m_values[l];
+                    }
+                }
+            }
+            std::sort(touched.begin(), touched.end());
+            for (size_t j: touched) {
+                piece.indices.push_back(j);
+                piece.values.push_back(accumulator[j]);
+            }
+            piece.row_sizes.push_back(touched.size());
+        }
+    });
+
+    SparseMatrix product(m_rows, n);
+    size_t row = 0;
+    for (Piece &piece: pieces) {
+        for (size_t size: piece.row_sizes) {
+            product.m_offsets[row + 1] = product.m_offsets[row] + size;
+            row++;
+        }
+        product.m_indices.insert(product.m_indices.end(), piece.indices.begin(), piece.indices.end());
+        product.m_values.insert(product.m_values.end(), piece.values.begin(), piece.values.end());
+    }
+    return product;
+}
+
+Matrix SparseMatrix::add(const Matrix &b, size_t num_of_threads) const {
+    if (b.getRows() != m_rows || b.getCols() != m_cols) return {};
+    SparseMatrix converted;
+    const SparseMatrix &a = as_csr(*this, converted);
+    Matrix sum(b);
+    const auto nnz = static_cast<double>(nonZeros());
+    const auto intervals = a.make_intervals(
+            plan_intervals(nnz, nnz * (2 * sizeof(double) + sizeof(size_t)), num_of_threads));
+    ThreadPool::instance().parallel_for(intervals.size(), [&](size_t t) {
+        for (size_t i = intervals[t].first; i < intervals[t].second; i++) {
+            double *row = sum.row(i).data();
+            for (size_t k = a.m_offsets[i]; k < a.m_offsets[i + 1]; k++) {
+                row[a.m_indices[k]] += a.m_values[k];
+            }
+        }
+    });
+    return sum;
+}
+
+bool SparseMatrix::operator==(const SparseMatrix &another) const {
+    if (m_rows != another.m_rows || m_cols != another.m_cols) return false;
+    if (m_format != another.m_format) {
+        return m_format == Format::CSR ? *this == another.to_csr() : to_csr() == another;
+    }
+    return m_offsets == another.m_offsets && m_indices == another.m_indices && m_values == another.m_values;
+}
+
+bool SparseMatrix::operator!=(const SparseMatrix &another) const {
+    return !(*this == another);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "matrix.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+struct SparseEntry {
+    size_t row;
+    size_t col;
+    double value;
+};
+
+// Compressed sparse matrix. In CSR, row i holds the entries indices()[offsets()[i] .. offsets()[i+1])
+// (column numbers, ascending) with the matching values(); CSC is the same with rows and columns
+// swapped. Only stored entries cost memory or time, so a matrix with nnz entries multiplies a
+// vector in O(nnz) instead of O(rows * cols).
+//
+// Parallel operations split the rows into intervals holding about the same number of entries
+// (the make_intervals split of CalculationManager, weighted by nnz instead of rows) and let the
+// cost model choose how many. CSC operands are converted to CSR first. Shape mismatches return
+// an empty result, like the dense fast_* paths.
+class SparseMatrix final {
+public:
+    enum class Format {
+        CSR,
+        CSC,
+    };
+
+    SparseMatrix() = default;
+
+    // All-zero rows x cols matrix.
+    SparseMatrix(size_t nRows, size_t nCols, Format format = Format::CSR);
+
+    // Duplicated positions are summed; explicit zeros are kept.
+    static SparseMatrix from_entries(size_t nRows, size_t nCols, std::vector<SparseEntry> entries,
+                                     Format format = Format::CSR);
+
+    // Stores the elements with |value| > tolerance.
+    static SparseMatrix from_dense(const Matrix &dense, double tolerance = 0, Format format = Format::CSR);
+
+    [[nodiscard]] Matrix to_dense() const;
+
+    [[nodiscard]] SparseMatrix to_csr() const;
+
+    [[nodiscard]] SparseMatrix to_csc() const;
+
+    [[nodiscard]] SparseMatrix transposed() const;
+
+    [[nodiscard]] Format format() const;
+
+    [[nodiscard]] size_t getRows() const;
+
+    [[nodiscard]] size_t getCols() const;
+
+    [[nodiscard]] size_t nonZeros() const;
+
+    [[nodiscard]] const std::vector<size_t> &offsets() const;
+
+    [[nodiscard]] const std::vector<size_t> &indices() const;
+
+    [[nodiscard]] const std::vector<double> &values() const;
+
+    // Element (i, j), zero if it is not stored. O(log nnz of the row).
+    [[nodiscard]] double at(size_t i, size_t j) const;
+
+    // y = A * x (SpMV).
+    [[nodiscard]] std::vector<double> multiply(const std::vector<double> &x, size_t num_of_threads) const;
+
+    // out = A * B for a dense B (SpMM).
+    [[nodiscard]] Matrix multiply(const Matrix &b, size_t num_of_threads) const;
+
+    // A * B with Gustavson's row-by-row algorithm (SpGEMM); the result is CSR.
+    [[nodiscard]] SparseMatrix multiply(const SparseMatrix &b, size_t num_of_threads) const;
+
+    // Dense A + B.
+    [[nodiscard]] Matrix add(const Matrix &b, size_t num_of_threads) const;
+
+    bool operator==(const SparseMatrix &another) const;
+
+    bool operator!=(const SparseMatrix &another) const;
+
+private:
+    Format m_format = Format::CSR;
+    size_t m_rows = 0;
+    size_t m_cols = 0;
+    std::vector<size_t> m_offsets = {0};
+    std::vector<size_t> m_indices;
+    std::vector<double> m_values;
+
+    // Rows (of a CSR matrix) split into `count` intervals of about nnz / count entries each.
+    [[nodiscard]] std::vector<std::pair<size_t, size_t>> make_intervals(size_t count) const;
+
+    // Number of intervals worth using for an operation with the given flops and memory traffic.
+    [[nodiscard]] size_t plan_intervals(double flops, double bytes, size_t num_of_threads) const;
+};
@@ -0,0 +1,151 @@
+#include "strassen.h"
+#include "gemm.h"
+#include "simd_kernels.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Block {
+    const double *data;
+    size_t ld;
+
+    [[nodiscard]] Block at(size_t i, size_t j) const { return {data + i * ld + j, ld}; }
+};
+
+bool recurse(size_t m, size_t n, size_t k, size_t cutoff) {
+    return std::min({m, n, k}) > std::max<size_t>(cutoff, 1);
+}
+
+size_t child_threads(size_t threads) {
+    return (threads + 6) / 7;
+}
+
+size_t workspace(size_t m, size_t n, size_t k, size_t threads, size_t cutoff) {
+    if (!recurse(m, n, k, cutoff)) return 0;
+    const size_t m2 = m / 2, n2 = n / 2, k2 = k / 2;
+    const size_t level = 4 * m2 * k2 + 4 * k2 * n2 + 7 * m2 * n2;
+    const size_t child = workspace(m2, n2, k2, child_threads(threads), cutoff);
+    // Parallel children need a workspace each; serial ones take turns with one.
+    return level + (threads > 1 ? 7 : 1) * child;
+}
+
+void combine(size_t rows, size_t cols, Block x, Block y, double *out, size_t ldo, bool subtract) {
+    const SimdKernels &kernels = simd();
+    for (size_t i = 0; i < rows; i++) {
+        if (subtract) {
+            kernels.sub(x.data + i * x.ld, y.data + i * y.ld, out + i * ldo, cols);
+        } else {
+            kernels.add(x.data + i * x.ld, y.data + i * y.ld, out + i * ldo, cols);
+        }
+    }
+}
+
+void zero(size_t rows, size_t cols, double *c, size_t ldc) {
+    for (size_t i = 0; i < rows; i++) std::fill_n(c + i * ldc, cols, 0.0);
+}
+
+// C = A * B (overwritten), C m x n, A m x k, B k x n.
+void strassen(size_t m, size_t n, size_t k, Block a, Block b, double *c, size_t ldc,
+              double *ws, size_t threads, size_t cutoff) {
+    if (!recurse(m, n, k, cutoff)) {
+        zero(m, n, c, ldc);
+        ThreadPool::instance().parallel_ranges(0, m, threads, GemmBlocking::MR * 8, [&](size_t from, size_t to) {
+            gemm(to - from, n, k, 1.0, a.data + from * a.ld, a.ld, b.data, b.ld, c + from * ldc, ldc);
+        });
+        return;
+    }
+    const size_t m2 = m / 2, n2 = n / 2, k2 = k / 2;
+    const Block a11 = a, a12 = a.at(0, k2), a21 = a.at(m2, 0), a22 = a.at(m2, k2);
+    const Block b11 = b, b12 = b.at(0, n2), b21 = b.at(k2, 0), b22 = b.at(k2, n2);
+
+    double *s[4], *t[4], *p[7];
+    for (auto &x: s) x = std::exchange(ws, ws + m2 * k2);
+    for (auto &x: t) x = std::exchange(ws, ws + k2 * n2);
+    for (auto &x: p) x = std::exchange(ws, ws + m2 * n2);
+    const Block S[4] = {{s[0], k2}, {s[1], k2}, {s[2], k2}, {s[3], k2}};
+    const Block T[4] = {{t[0], n2}, {t[1], n2}, {t[2], n2}, {t[3], n2}};
+
+    combine(m2, k2, a21, a22, s[0], k2, false);   // S1 = A21 + A22
+    combine(m2, k2, S[0], a11, s[1], k2, true);   // S2 = S1 - A11
+    combine(m2, k2, a11, a21, s[2], k2, true);    // S3 = A11 - A21
+    combine(m2, k2, a12, S[1], s[3], k2, true);   // S4 = A12 - S2
+    combine(k2, n2, b12, b11, t[0], n2, true);    // T1 = B12 - B11
+    combine(k2, n2, b22, T[0], t[1], n2, true);   // T2 = B22 - T1
+    combine(k2, n2, b22, b12, t[2], n2, true);    // T3 = B22 - B12
+    combine(k2, n2, T[1], b21, t[3], n2, true);   // T4 = T2 - B21
+
+    const Block lhs[7] = {a11, a12, S[3], a22, S[0], S[1], S[2]};
+    const Block rhs[7] = {b11, b21, b22, T[3], T[0], T[1], T[2]};
+    const size_t children = child_threads(threads);
+    const size_t child_ws = workspace(m2, n2, k2, children, cutoff);
+    if (threads > 1) {
+        ThreadPool::instance().parallel_for(7, [&](size_t i) {
+            strassen(m2, n2, k2, lhs[i], rhs[i], p[i], n2, ws + i * child_ws, children, cutoff);
+        });
+    } else {
+        for (size_t i = 0; i < 7; i++) {
+            strassen(m2, n2, k2, lhs[i], rhs[i], p[i], n2, ws, 1, cutoff);
+        }
+    }
+
+    const Block P[7] = {{p[0], n2}, {p[1], n2}, {p[2], n2}, {p[3], n2}, {p[4], n2}, {p[5], n2}, {p[6], n2}};
+    combine(m2, n2, P[0], P[5], p[5], n2, false);               // U2 = P1 + P6
+    combine(m2, n2, P[5], P[6], p[6], n2, false);               // U3 = U2 + P7
+    combine(m2, n2, P[5], P[4], p[5], n2, false);               // U4 = U2 + P5
+    combine(m2, n2, P[0], P[1], c, ldc, false);                 // C11 = P1 + P2
+    combine(m2, n2, P[5], P[2], c + n2, ldc, false);            // C12 = U4 + P3
+    combine(m2, n2, P[6], P[3], c + m2 * ldc, ldc, true);       // C21 = U3 - P4
+    combine(m2, n2, P[6], P[4], c + m2 * ldc + n2, ldc, false); // C22 = U3 + P5
+
+    // Odd dimensions: the even part is done, gemm adds the peeled index, column and row.
+    const size_t me = 2 * m2, ne = 2 * n2, ke = 2 * k2;
+    if (k != ke) {
+        gemm(me, ne, 1, 1.0, a.data + ke, a.ld, b.data + ke * b.ld, b.ld, c, ldc);
+    }
+    if (n != ne) {
+        zero(me, 1, c + ne, ldc);
+        gemm(me, 1, k, 1.0, a.data, a.ld, b.data + ne, b.ld, c + ne, ldc);
+    }
+    if (m != me) {
+        zero(1, n, c + me * ldc, ldc);
+        gemm(1, n, k, 1.0, a.data + me * a.ld, a.ld, b.data, b.ld, c + me * ldc, ldc);
+    }
+}
+
+}
+
+size_t strassen_workspace_size(size_t m, size_t n, size_t k, const StrassenOptions &options) {
+    return workspace(m, n, k, std::max<size_t>(options.num_of_threads, 1), options.cutoff);
+}
+
+Matrix strassen_multiply(const Matrix &a, const Matrix &b, const StrassenOptions &options) {
+    Matrix result;
+    strassen_multiply_into(a, b, result, options);
+    return result;
+}
+
+void strassen_multiply_into(const Matrix &a, const Matrix &b, Matrix &out, const StrassenOptions &options) {
+    if (a.getCols() != b.getRows()) {
+        out = Matrix();
+        return;
+    }
+    const size_t m = a.getRows(), n = b.getCols(), k = a.getCols();
+    if (!recurse(m, n, k, options.cutoff)) {
+        a.multiply_into(b, out, std::max<size_t>(options.num_of_threads, 1));
+        return;
+    }
+    if (&out == &a || &out == &b) {
+        Matrix result;
+        strassen_multiply_into(a, b, result, options);
+        out = std::move(result);
+        return;
+    }
+    if (out.getRows() != m || out.getCols() != n) out = Matrix(m, n);
+    const size_t threads = std::max<size_t>(options.num_of_threads, 1);
+    std::vector<double> ws(workspace(m, n, k, threads, options.cutoff));
+    strassen(m, n, k, {a.data(), a.stride()}, {b.data(), b.stride()}, out.data(), out.stride(),
+             ws.data(), threads, options.cutoff);
+}
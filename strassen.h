@@ -0,0 +1,35 @@
+#pragma once
+
+#include "matrix.h"
+#include <cstddef>
+
+// Opt-in Strassen-Winograd multiplication for large products. Each recursion level replaces the
+// 8 half-size products of the classical algorithm by 7 plus 15 half-size additions, so the work
+// drops to O(n^2.81); at n = 4096 with a 512 cutoff that is 3 levels and (7/8)^3 = 0.67 of the
+// classical flops. Odd dimensions peel the last row, column or inner index off to gemm.
+//
+// The 7 products of a level run as separate pool tasks while more than one thread is left for
+// them (the threads are divided among the children); below that the recursion is serial and the
+// leaves call the classical gemm. All temporaries come from one workspace allocated up front
+// (strassen_workspace_size doubles), so a multiply does exactly one allocation besides the result.
+//
+// Accuracy: the classical product satisfies the componentwise bound |C - C^| <= k u |A| |B|;
+// Strassen-Winograd only satisfies a normwise one, ||C - C^|| <= c(n) u ||A|| ||B||, where c(n)
+// grows by a factor of roughly 18 per level instead of 2. For well-scaled matrices the
+// difference is one or two decimal digits per level (tests compare at 1e-12 relative to
+// ||A|| ||B||); for matrices whose entries span many orders of magnitude, small entries of C
+// can lose all accuracy. Prefer the classical operator* when that matters, and raise the cutoff
+// to trade speed for accuracy.
+struct StrassenOptions {
+    // Products whose smallest dimension is at most this go to the classical kernel.
+    size_t cutoff = 512;
+    size_t num_of_threads = ThreadPool::instance().concurrency();
+};
+
+// a * b; an empty matrix if the shapes do not match, like fast_multiply_with.
+[[nodiscard]] Matrix strassen_multiply(const Matrix &a, const Matrix &b, const StrassenOptions &options = {});
+
+void strassen_multiply_into(const Matrix &a, const Matrix &b, Matrix &out, const StrassenOptions &options = {});
+
+// Doubles of workspace an (m x k) * (k x n) product needs with these options.
+[[nodiscard]] size_t strassen_workspace_size(size_t m, size_t n, size_t k, const StrassenOptions &options);
@@ -1,7 +1,34 @@
 #include <gtest/gtest.h>
 #include "../matrix.h"
 #include "../calculator_manager.h"
+#include "../thread_pool.h"
+#include "../lu.h"
+#include "../simd_kernels.h"
+#include "../memory_arena.h"
+#include "../cost_model.h"
+#include "../matrix_file.h"
+#include "../out_of_core.h"
+#include "../sparse_matrix.h"
+#include "../basic_matrix.h"
+#include "../fixed_matrix.h"
+#include "../batch.h"
+#include "../strassen.h"
+#include "../numa.h"
+#include "../async.h"
+#include "../vector.h"
+#include "../profiler.h"
+#include "../cholesky.h"
+#include <bit>
 #include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+// Exercise the threaded paths even on single-core machines.
+[[maybe_unused]] static const bool pool_configured = (ThreadPool::set_default_workers(3), true);
 
 static const unsigned long big_size_for_mult = 500;
 static const unsigned long big_size_for_sum = 1000;
@@ -101,4 +128,1243 @@ TEST(Matrix_determinant, no_rec_d010) {
     identity.multithreadingOn();
     double det = identity.det();
     EXPECT_DOUBLE_EQ(det, -9.0);
-}
\ No newline at end of file
+}
+
+TEST(Matrix_storage, aligned_contiguous_rows) {
+    Matrix m(5, 3, 1.5);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(m.data()) % kMatrixAlignment, 0u);
+    EXPECT_GE(m.stride(), m.getCols());
+    EXPECT_EQ(m.stride() * sizeof(double) % kMatrixAlignment, 0u);
+    EXPECT_EQ(&m.at(1, 0), m.data() + m.stride());
+}
+
+TEST(Matrix_storage, row_and_col_views) {
+    Matrix m(3, 4);
+    for (size_t i = 0; i < m.getRows(); i++)
+        for (size_t j = 0; j < m.getCols(); j++)
+            m.at(i, j) = static_cast<double>(i * 10 + j);
+    auto row = m.row(2);
+    EXPECT_EQ(row.size(), 4u);
+    EXPECT_EQ(row[3], 23);
+    auto col = m.col(1);
+    EXPECT_EQ(col.size(), 3u);
+    EXPECT_EQ(col[2], 21);
+    col[0] = -1;
+    EXPECT_EQ(m.at(0, 1), -1);
+}
+
+TEST(Matrix_storage, rectangular_equality_ignores_padding) {
+    Matrix a(7, 3, 2);
+    Matrix b(7, 3, 2);
+    EXPECT_TRUE(a == b);
+    b.at(6, 2) = 0;
+    EXPECT_TRUE(a != b);
+    EXPECT_TRUE(Matrix(3, 7, 2) != a);
+}
+
+static Matrix naive_product(Matrix &a, Matrix &b) {
+    Matrix result(a.getRows(), b.getCols());
+    for (size_t i = 0; i < a.getRows(); i++)
+        for (size_t j = 0; j < b.getCols(); j++)
+            for (size_t k = 0; k < a.getCols(); k++)
+                result.at(i, j) += a.at(i, k) * b.at(k, j);
+    return result;
+}
+
+static Matrix sequence_matrix(size_t rows, size_t cols, size_t seed = 1) {
+    Matrix m(rows, cols);
+    for (size_t i = 0; i < rows; i++)
+        for (size_t j = 0; j < cols; j++)
+            m.at(i, j) = static_cast<double>((i * 31 + j * 17 + seed) % 13) - 6;
+    return m;
+}
+
+TEST(Matrix_multiplication, rectangular) {
+    Matrix a = sequence_matrix(37, 301, 1);
+    Matrix b = sequence_matrix(301, 19, 2);
+    Matrix product = a * b;
+    ASSERT_EQ(product.getRows(), 37u);
+    ASSERT_EQ(product.getCols(), 19u);
+    EXPECT_TRUE(product == naive_product(a, b));
+}
+
+TEST(Matrix_multiplication, rectangular_multithreading) {
+    Matrix a = sequence_matrix(263, 45, 3);
+    Matrix b = sequence_matrix(45, 2100, 4);
+    a.setContraints({1, 1, 1});
+    Matrix product = a.fast_multiply_with(b, 4);
+    EXPECT_TRUE(product == naive_product(a, b));
+}
+
+TEST(Matrix_multiplication, shape_mismatch) {
+    Matrix a(3, 4);
+    Matrix b(3, 4);
+    Matrix product = a * b;
+    EXPECT_EQ(product.getRows(), 0u);
+}
+
+TEST(Thread_pool, parallel_for_covers_every_index) {
+    ThreadPool pool(3);
+    std::vector<std::atomic<int>> hits(1000);
+    pool.parallel_for(hits.size(), [&](size_t i) { hits[i]++; });
+    for (auto &hit: hits) EXPECT_EQ(hit.load(), 1);
+}
+
+TEST(Thread_pool, nested_parallel_for_does_not_deadlock) {
+    ThreadPool pool(2);
+    std::atomic<size_t> total{0};
+    pool.parallel_for(8, [&](size_t) {
+        pool.parallel_for(8, [&](size_t) { total++; });
+    });
+    EXPECT_EQ(total.load(), 64u);
+}
+
+TEST(Thread_pool, submit_and_resize) {
+    ThreadPool pool(1);
+    auto answer = pool.submit([] { return 42; });
+    EXPECT_EQ(pool.wait(answer), 42);
+    pool.resize(4);
+    EXPECT_EQ(pool.size(), 4u);
+    EXPECT_EQ(pool.concurrency(), 5u);
+    auto after = pool.submit([] { return 7; });
+    EXPECT_EQ(pool.wait(after), 7);
+    pool.shutdown();
+    EXPECT_EQ(pool.size(), 0u);
+    auto inline_task = pool.submit([] { return 1; });
+    EXPECT_EQ(inline_task.get(), 1);
+}
+
+TEST(Thread_pool, exceptions_propagate_to_caller) {
+    ThreadPool pool(2);
+    EXPECT_THROW(pool.parallel_for(4, [](size_t i) { if (i == 3) throw std::runtime_error("fail"); }),
+                 std::runtime_error);
+}
+
+TEST(Matrix_determinant, more_threads_than_rows) {
+    Matrix m = diagonal0(5);
+    EXPECT_DOUBLE_EQ(m.fast_det(m, 16), 4.0);
+}
+
+TEST(Matrix_determinant, pipelined_matches_serial_elimination) {
+    for (size_t n: {3, 7, 33, 64}) {
+        Matrix m = sequence_matrix(n, n, n) + Matrix::createDiagonal(n, 3);
+        const double serial = m.fast_det(m, 1);
+        for (size_t threads: {2, 3, 4}) {
+            CostModel::instance().set_thread_override(threads);
+            const double pipelined = m.fast_det(m, threads);
+            CostModel::instance().set_thread_override(0);
+            EXPECT_NEAR(pipelined, serial, 1e-10 * std::abs(serial)) << n << "x" << n << ", " << threads << " threads";
+        }
+    }
+}
+
+TEST(Matrix_determinant, pipelined_sign_and_singular) {
+    // Reversed rows: every step pivots on the last remaining row.
+    Matrix reversed(6, 6, 0);
+    for (size_t i = 0; i < 6; i++) reversed.at(i, 5 - i) = static_cast<double>(i + 1);
+    Matrix singular = sequence_matrix(12, 12, 2) + Matrix::createDiagonal(12, 2);
+    for (size_t j = 0; j < 12; j++) singular.at(9, j) = singular.at(4, j);
+
+    CostModel::instance().set_thread_override(3);
+    EXPECT_DOUBLE_EQ(reversed.fast_det(reversed, 3), -720.0);
+    EXPECT_EQ(singular.fast_det(singular, 3), 0.0);
+    CostModel::instance().set_thread_override(0);
+}
+
+static double max_abs_difference(const Matrix &a, const Matrix &b) {
+    double diff = 0;
+    for (size_t i = 0; i < a.getRows(); i++)
+        for (size_t j = 0; j < a.getCols(); j++)
+            diff = std::max(diff, std::abs(a.at(i, j) - b.at(i, j)));
+    return diff;
+}
+
+TEST(Matrix_lu, reconstructs_permuted_matrix) {
+    Matrix a = sequence_matrix(150, 150, 5);
+    for (size_t i = 0; i < a.getRows(); i++) a.at(i, i) += 10;
+    LUDecomposition lu(a, 4);
+    const Matrix &packed = lu.packed();
+    Matrix l = Matrix::createDiagonal(150, 1), u(150, 150);
+    for (size_t i = 0; i < 150; i++)
+        for (size_t j = 0; j < 150; j++)
+            (j < i ? l.at(i, j) : u.at(i, j)) = packed.at(i, j);
+    Matrix pa(a);
+    for (size_t i = 0; i < 150; i++)
+        for (size_t j = 0; j < 150; j++) std::swap(pa.at(i, j), pa.at(lu.pivots()[i], j));
+    EXPECT_LT(max_abs_difference(l * u, pa), 1e-9);
+}
+
+TEST(Matrix_lu, det_solve_inverse_share_factors) {
+    Matrix a = sequence_matrix(97, 97, 7);
+    for (size_t i = 0; i < a.getRows(); i++) a.at(i, i) += 50;
+    a.multithreadingOn();
+    LUDecomposition lu = a.lu();
+    EXPECT_NEAR(lu.det() / a.fast_det(a, 1), 1.0, 1e-9);
+    EXPECT_EQ(lu.rank(), 97u);
+    Matrix b = sequence_matrix(97, 3, 9);
+    EXPECT_LT(max_abs_difference(a * lu.solve(b), b), 1e-9);
+    EXPECT_LT(max_abs_difference(a * lu.inverse(), Matrix::createDiagonal(97, 1)), 1e-9);
+}
+
+TEST(Matrix_lu, rank_deficient) {
+    Matrix a(80, 80);
+    for (size_t i = 0; i < 80; i++)
+        for (size_t j = 0; j < 80; j++)
+            a.at(i, j) = static_cast<double>((i % 3 + 1) * (j + 1));
+    LUDecomposition lu = a.lu();
+    EXPECT_EQ(lu.rank(), 1u);
+    EXPECT_EQ(a.det(), 0);
+    EXPECT_EQ(LUDecomposition(Matrix(4, 4)).rank(), 0u);
+    EXPECT_THROW(lu.solve(Matrix(80, 1)), std::domain_error);
+    EXPECT_THROW(LUDecomposition(Matrix(3, 4)), std::invalid_argument);
+}
+
+TEST(Matrix_lu, row_parallel_solve_and_inverse) {
+    Matrix a = sequence_matrix(300, 300, 3);
+    for (size_t i = 0; i < a.getRows(); i++) a.at(i, i) += 100;
+    const LUDecomposition lu(a, 3);
+    Matrix b = sequence_matrix(300, 2, 4);
+    // Two columns take the row-block path, 300 rows span several blocks.
+    EXPECT_LT(max_abs_difference(a * lu.solve(b), b), 1e-9);
+    EXPECT_LT(max_abs_difference(solve(a, b), lu.solve(b)), 1e-12);
+    EXPECT_LT(max_abs_difference(a * a.inverse(), Matrix::createDiagonal(300, 1)), 1e-9);
+    EXPECT_THROW((void) solve(a, Matrix(299, 1)), std::invalid_argument);
+}
+
+TEST(Matrix_lu, condition_estimate_and_singular_error) {
+    Matrix scaled = Matrix::createDiagonal(2, 1);
+    scaled.at(1, 1) = 1e-3;
+    EXPECT_NEAR(scaled.lu().rcond(), 1e-3, 1e-12);
+    EXPECT_NEAR(Matrix::createDiagonal(50, 4).lu().rcond(), 1.0, 1e-12);
+
+    // Hilbert matrices: cond_1(H_6) is about 2.9e7, H_14 is singular to working precision.
+    auto hilbert = [](size_t n) {
+        Matrix h(n, n);
+        for (size_t i = 0; i < n; i++)
+            for (size_t j = 0; j < n; j++)
+                h.at(i, j) = 1.0 / static_cast<double>(i + j + 1);
+        return h;
+    };
+    const double rcond6 = hilbert(6).lu().rcond();
+    EXPECT_GT(rcond6, 1.0 / 3e8);
+    EXPECT_LT(rcond6, 1.0 / 2.9e6);
+    EXPECT_NO_THROW((void) hilbert(6).inverse());
+    try {
+        (void) solve(hilbert(14), Matrix(14, 1, 1.0));
+        FAIL() << "expected SingularMatrixError";
+    } catch (const SingularMatrixError &error) {
+        EXPECT_LT(error.rcond(), std::numeric_limits<double>::epsilon());
+    }
+    EXPECT_THROW((void) Matrix(5, 5).inverse(), SingularMatrixError);
+    EXPECT_EQ(Matrix(5, 5).lu().rcond(), 0.0);
+}
+
+TEST(Matrix_expression, fused_chain) {
+    Matrix a = sequence_matrix(40, 33, 1);
+    Matrix b = sequence_matrix(40, 33, 2);
+    Matrix c = sequence_matrix(40, 33, 3);
+    Matrix result = a + b - 2 * c;
+    for (size_t i = 0; i < 40; i++)
+        for (size_t j = 0; j < 33; j++)
+            EXPECT_EQ(result.at(i, j), a.at(i, j) + b.at(i, j) - 2 * c.at(i, j));
+}
+
+TEST(Matrix_expression, assignment_reuses_buffer) {
+    Matrix a = sequence_matrix(20, 20, 1);
+    Matrix b = sequence_matrix(20, 20, 2);
+    Matrix out(20, 20);
+    const double *buffer = out.data();
+    out = a - b;
+    EXPECT_EQ(out.data(), buffer);
+    EXPECT_TRUE(out == a.fast_subtract_with(b, 1));
+}
+
+TEST(Matrix_expression, in_place_and_axpy) {
+    Matrix a = sequence_matrix(500, 64, 1);
+    Matrix b = sequence_matrix(500, 64, 2);
+    Matrix expected = a + 0.5 * b;
+    a.multithreadingOn();
+    a.setContraints({1, 1, 1});
+    a += 0.5 * b;
+    EXPECT_TRUE(a == expected);
+    a -= 0.5 * b;
+    a *= 3;
+    a -= a;
+    EXPECT_TRUE(a == Matrix(500, 64));
+}
+
+TEST(Matrix_expression, shape_mismatch_is_empty) {
+    Matrix sum = Matrix(3, 4, 1) + Matrix(4, 3, 1);
+    EXPECT_EQ(sum.getRows(), 0u);
+    EXPECT_EQ(sum.getCols(), 0u);
+}
+
+TEST(Simd_kernels, every_level_matches_scalar) {
+    const SimdKernels *scalar = simd_kernels_for(SimdLevel::Scalar);
+    ASSERT_NE(scalar, nullptr);
+    std::vector<double> a(203), b(203);
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i] = std::sin(static_cast<double>(i)) * 1e3;
+        b[i] = std::cos(static_cast<double>(i) * 0.7) / 3;
+    }
+    a[150] = -4e3;
+    a[170] = 4e3;
+    for (auto level: {SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        const SimdKernels *kernels = simd_kernels_for(level);
+        if (kernels == nullptr) continue;
+        SCOPED_TRACE(kernels->name);
+        for (size_t n: {0u, 1u, 7u, 64u, 203u}) {
+            std::vector<double> expected(n), actual(n);
+            scalar->add(a.data(), b.data(), expected.data(), n);
+            kernels->add(a.data(), b.data(), actual.data(), n);
+            EXPECT_EQ(expected, actual);
+            scalar->sub(a.data(), b.data(), expected.data(), n);
+            kernels->sub(a.data(), b.data(), actual.data(), n);
+            EXPECT_EQ(expected, actual);
+            scalar->add_scaled(a.data(), 0.3, b.data(), expected.data(), n);
+            kernels->add_scaled(a.data(), 0.3, b.data(), actual.data(), n);
+            EXPECT_EQ(expected, actual);
+            scalar->scale(-1.7, a.data(), expected.data(), n);
+            kernels->scale(-1.7, a.data(), actual.data(), n);
+            EXPECT_EQ(expected, actual);
+            expected.assign(b.begin(), b.begin() + n);
+            actual = expected;
+            scalar->axpy(0.1, a.data(), expected.data(), n);
+            kernels->axpy(0.1, a.data(), actual.data(), n);
+            EXPECT_EQ(expected, actual);
+            EXPECT_EQ(scalar->iamax(a.data(), n, 1), kernels->iamax(a.data(), n, 1));
+            EXPECT_EQ(scalar->iamax(a.data(), n / 3, 3), kernels->iamax(a.data(), n / 3, 3));
+            EXPECT_EQ(scalar->dot(a.data(), b.data(), n), kernels->dot(a.data(), b.data(), n));
+        }
+        std::vector<double> expected(32, 0), actual(32, 0);
+        scalar->gemm_tile(25, a.data(), b.data(), expected.data());
+        kernels->gemm_tile(25, a.data(), b.data(), actual.data());
+        EXPECT_EQ(expected, actual);
+    }
+}
+
+TEST(Matrix_in_place, into_reuses_buffers) {
+    Matrix a = sequence_matrix(320, 64, 1);
+    Matrix b = sequence_matrix(320, 64, 2);
+    Matrix c = sequence_matrix(64, 48, 3);
+    Matrix out(320, 64);
+    const double *buffer = out.data();
+    a.sum_into(b, out, 4);
+    EXPECT_EQ(out.data(), buffer);
+    EXPECT_TRUE(out == a + b);
+    a.subtract_into(b, out, 4);
+    EXPECT_EQ(out.data(), buffer);
+    EXPECT_TRUE(out == a - b);
+
+    Matrix product(320, 48, 5);
+    buffer = product.data();
+    a.multiply_into(c, product, 4);
+    EXPECT_EQ(product.data(), buffer);
+    EXPECT_TRUE(product == naive_product(a, c));
+
+    a.multiply_into(b, out, 4);
+    EXPECT_EQ(out.getRows(), 0u);
+}
+
+TEST(Matrix_in_place, add_and_sub_inplace) {
+    Matrix a = sequence_matrix(30, 30, 1);
+    Matrix b = sequence_matrix(30, 30, 2);
+    Matrix expected = a + b;
+    const double *buffer = a.data();
+    EXPECT_TRUE(a.add_inplace(b));
+    EXPECT_EQ(a.data(), buffer);
+    EXPECT_TRUE(a == expected);
+    EXPECT_TRUE(a.sub_inplace(b));
+    EXPECT_TRUE(a == sequence_matrix(30, 30, 1));
+    EXPECT_FALSE(a.add_inplace(Matrix(3, 3)));
+    EXPECT_EQ(a.getRows(), 30u);
+}
+
+TEST(Matrix_in_place, consuming_det_and_moves) {
+    Matrix a = diagonal0(40);
+    const double *buffer = a.data();
+    LUDecomposition lu = std::move(a).lu();
+    EXPECT_EQ(lu.packed().data(), buffer);
+    EXPECT_NEAR(lu.det(), -39.0, 1e-9);
+    EXPECT_NEAR(diagonal0(41).det(), 40.0, 1e-9);
+    Matrix b = diagonal0(9);
+    EXPECT_DOUBLE_EQ(b.fast_det(std::move(b), 2), 8.0);
+
+    Matrix source(10, 10, 1);
+    buffer = source.data();
+    Matrix moved(std::move(source));
+    EXPECT_EQ(moved.data(), buffer);
+    Matrix copy(10, 10);
+    buffer = copy.data();
+    copy = moved;
+    EXPECT_EQ(copy.data(), buffer);
+    EXPECT_TRUE(copy == moved);
+}
+
+TEST(Matrix_memory, scratch_scope_uses_thread_arena) {
+    BumpArena &arena = BumpArena::thread_local_arena();
+    const size_t before = arena.used();
+    Matrix kept;
+    {
+        ScratchScope scratch;
+        Matrix a(100, 100, 1);
+        Matrix b = a + a;
+        EXPECT_EQ(a.resource(), &arena);
+        EXPECT_EQ(b.resource(), &arena);
+        EXPECT_GE(arena.used(), before + 2 * 100 * 100 * sizeof(double));
+        {
+            ScratchScope nested;
+            Matrix c(a);
+            EXPECT_EQ(c.resource(), &arena);
+        }
+        kept = std::move(b);
+        EXPECT_NE(kept.resource(), &arena);
+    }
+    EXPECT_EQ(arena.used(), before);
+    EXPECT_EQ(matrix_memory_resource(), std::pmr::new_delete_resource());
+    EXPECT_TRUE(kept == Matrix(100, 100, 2));
+}
+
+TEST(Matrix_memory, explicit_resources) {
+    BumpArena arena(4096);
+    Matrix a(10, 10, 3, &arena);
+    EXPECT_EQ(a.resource(), &arena);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(a.data()) % kMatrixAlignment, 0u);
+    Matrix pooled(a, matrix_pool_resource());
+    EXPECT_EQ(pooled.resource(), matrix_pool_resource());
+    EXPECT_TRUE(pooled == a);
+    pooled = Matrix(20, 20, 1);
+    EXPECT_EQ(pooled.resource(), matrix_pool_resource());
+    EXPECT_EQ(pooled.getRows(), 20u);
+    arena.reset();
+    EXPECT_EQ(arena.used(), 0u);
+}
+
+TEST(Cost_model, threads_follow_the_work) {
+    CostModel &model = CostModel::instance();
+    const HostProfile saved = model.profile();
+    HostProfile host;
+    host.flops_per_second = 1e9;
+    host.bytes_per_second = 4e9;
+    host.parallel_bytes_per_second = 8e9;
+    host.sync_seconds = 1e-5;
+    host.per_thread_seconds = 1e-6;
+    model.set_profile(host);
+
+    EXPECT_EQ(model.threads_for(WorkEstimate::elementwise(6, 6), 8), 1u);
+    EXPECT_EQ(model.threads_for(WorkEstimate::determinant(6), 8), 1u);
+    EXPECT_EQ(model.threads_for(WorkEstimate::multiply(2000, 2000, 2000), 8), 8u);
+    // The sum is bandwidth-bound: past B_all / B = 2 threads nothing gets faster.
+    EXPECT_EQ(model.threads_for(WorkEstimate::elementwise(4000, 4000), 8), 2u);
+    // Never more threads than rows.
+    EXPECT_EQ(model.threads_for(WorkEstimate::multiply(3, 100000, 100000), 8), 3u);
+    EXPECT_LT(model.predict_seconds(WorkEstimate::multiply(1000, 1000, 1000), 4),
+              model.predict_seconds(WorkEstimate::multiply(1000, 1000, 1000), 1));
+
+    model.set_profile(saved);
+}
+
+TEST(Cost_model, override_forces_thread_count) {
+    CostModel &model = CostModel::instance();
+    model.set_thread_override(3);
+    EXPECT_EQ(model.threads_for(WorkEstimate::elementwise(2, 2), 8), 3u);
+    EXPECT_EQ(model.threads_for(WorkEstimate::elementwise(2, 2), 2), 2u);
+
+    // Default constraints follow the model, so the forced count reaches every fast path.
+    Matrix a = sequence_matrix(120, 90, 5);
+    Matrix b = sequence_matrix(120, 90, 6);
+    Matrix c = sequence_matrix(90, 70, 7);
+    a.multithreadingOn();
+    Matrix sum = a + b;
+    EXPECT_TRUE(sum == a.fast_sum_with(b, 1));
+    EXPECT_TRUE(a.fast_multiply_with(c, 8) == naive_product(a, c));
+    Matrix square = sequence_matrix(70, 70, 8) + Matrix::createDiagonal(70, 50);
+    square.multithreadingOn();
+    EXPECT_NEAR(square.det() / square.fast_det(square, 8), 1.0, 1e-9);
+    model.set_thread_override(0);
+    EXPECT_EQ(model.thread_override(), 0u);
+}
+
+// The first profile() of a process used to hold a once-flag across pool work, so a pool task
+// asking for it while the calibration helped with queued tasks deadlocked. Runs in a fresh
+// process (the profile is measured once per process); the alarm turns a hang into a failure.
+TEST(Cost_model_DeathTest, first_calibration_from_pool_tasks) {
+    GTEST_FLAG_SET(death_test_style, "threadsafe");
+    EXPECT_EXIT({
+        alarm(30);
+        Matrix a = sequence_matrix(64, 64, 1);
+        a.multithreadingOn();
+        ThreadPool::instance().parallel_for(64, [&](size_t) { (void) a.fast_sum_with(a, 4); });
+        std::exit(0);
+    }, ::testing::ExitedWithCode(0), "");
+}
+
+static std::string temp_matrix_path(const std::string &name) {
+    return (std::filesystem::temp_directory_path() / ("parprog_" + name + ".mat")).string();
+}
+
+TEST(Matrix_file, save_map_and_load) {
+    const std::string path = temp_matrix_path("roundtrip");
+    Matrix a = sequence_matrix(37, 13, 9);
+    save_matrix(a, path);
+    EXPECT_EQ(std::filesystem::file_size(path), sizeof(MatrixFileHeader) + 37 * a.stride() * sizeof(double));
+
+    Matrix view = map_matrix(path);
+    EXPECT_TRUE(view.is_view());
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(view.data()) % kMatrixAlignment, 0u);
+    EXPECT_TRUE(view == a);
+    EXPECT_TRUE(view * Matrix::createDiagonal(13, 1) == a);
+
+    // Writes stay in private pages; copies own their buffer.
+    view.at(0, 0) = -1;
+    Matrix copy(view);
+    EXPECT_FALSE(copy.is_view());
+    EXPECT_DOUBLE_EQ(copy.at(0, 0), -1.0);
+    Matrix loaded = load_matrix(path);
+    EXPECT_FALSE(loaded.is_view());
+    EXPECT_TRUE(loaded == a);
+
+    // Assigning a same-shape matrix does not write into the mapping.
+    const double *mapped = view.data();
+    view = loaded;
+    EXPECT_FALSE(view.is_view());
+    EXPECT_NE(view.data(), mapped);
+    EXPECT_TRUE(view == a);
+    std::filesystem::remove(path);
+}
+
+TEST(Matrix_file, nonzero_padding_is_not_trusted) {
+    const std::string path = temp_matrix_path("padding");
+    Matrix a = sequence_matrix(6, 5, 3);
+    save_matrix(a, path);
+    {
+        // Garbage in the padding of row 4.
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        const double garbage = 7.5;
+        file.seekp(static_cast<std::streamoff>(sizeof(MatrixFileHeader) + (4 * a.stride() + 6) * sizeof(double)));
+        file.write(reinterpret_cast<const char *>(&garbage), sizeof(garbage));
+    }
+    for (const Matrix &read: {map_matrix(path), load_matrix(path)}) {
+        EXPECT_FALSE(read.is_view());
+        EXPECT_TRUE(read == a);
+        for (size_t i = 0; i < 6; i++) {
+            for (size_t j = 5; j < read.stride(); j++) EXPECT_EQ(read.data()[i * read.stride() + j], 0.0);
+        }
+    }
+    Matrix block(6, 5);
+    MatrixFile(path).read_block(0, 0, block);
+    EXPECT_EQ(block.data()[4 * block.stride() + 6], 0.0);
+    std::filesystem::remove(path);
+}
+
+TEST(Matrix_file, streaming_writer) {
+    const std::string path = temp_matrix_path("stream");
+    Matrix a = sequence_matrix(10, 21, 4);
+    {
+        MatrixFileWriter writer(path, 10, 21);
+        for (size_t i = 0; i < 3; i++) {
+            writer.write_row(a.row(i).data());
+        }
+        Matrix tail(7, 21);
+        for (size_t i = 0; i < 7; i++) {
+            std::copy(a.row(i + 3).begin(), a.row(i + 3).end(), tail.row(i).begin());
+        }
+        writer.write_rows(tail);
+        EXPECT_EQ(writer.rows_written(), 10u);
+        EXPECT_THROW(writer.write_row(a.row(0).data()), std::logic_error);
+        writer.close();
+    }
+    EXPECT_TRUE(map_matrix(path) == a);
+
+    MatrixFileWriter short_writer(path, 2, 21);
+    short_writer.write_row(a.row(0).data());
+    EXPECT_THROW(short_writer.close(), std::runtime_error);
+    EXPECT_THROW((void) load_matrix(path), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+TEST(Matrix_file, foreign_byte_order_and_bad_files) {
+    const std::string path = temp_matrix_path("swapped");
+    Matrix a = sequence_matrix(5, 3, 2);
+    {
+        // The same matrix as written by a machine of the other byte order.
+        MatrixFileHeader header{};
+        std::memcpy(header.magic, MatrixFileHeader::kMagic, sizeof(header.magic));
+        header.version = __builtin_bswap32(MatrixFileHeader::kVersion);
+        header.header_size = __builtin_bswap32(sizeof(MatrixFileHeader));
+        header.dtype = MatrixFileHeader::kFloat64;
+        header.endianness = std::endian::native == std::endian::little ?
+                            MatrixFileHeader::kBigEndian : MatrixFileHeader::kLittleEndian;
+        header.alignment = __builtin_bswap32(64);
+        header.rows = __builtin_bswap64(5);
+        header.cols = __builtin_bswap64(3);
+        header.stride = __builtin_bswap64(a.stride());
+        header.data_offset = __builtin_bswap64(sizeof(MatrixFileHeader));
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (size_t i = 0; i < 5; i++) {
+            for (size_t j = 0; j < a.stride(); j++) {
+                const uint64_t bits = __builtin_bswap64(std::bit_cast<uint64_t>(j < 3 ? a.at(i, j) : 0.0));
+                out.write(reinterpret_cast<const char *>(&bits), sizeof(bits));
+            }
+        }
+    }
+    Matrix swapped = map_matrix(path);
+    EXPECT_FALSE(swapped.is_view());
+    EXPECT_TRUE(swapped == a);
+
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << "definitely not a matrix, but long enough to hold a complete header of 64 bytes....";
+    }
+    EXPECT_THROW((void) map_matrix(path), std::runtime_error);
+    std::filesystem::remove(path);
+    EXPECT_THROW((void) load_matrix(path), std::system_error);
+}
+
+TEST(Out_of_core, tiled_add_and_multiply) {
+    const std::string a_path = temp_matrix_path("ooc_a");
+    const std::string b_path = temp_matrix_path("ooc_b");
+    const std::string c_path = temp_matrix_path("ooc_c");
+    Matrix a = sequence_matrix(70, 45, 1);
+    Matrix b = sequence_matrix(70, 45, 2);
+    Matrix c = sequence_matrix(45, 53, 3);
+    save_matrix(a, a_path);
+    save_matrix(b, b_path);
+    save_matrix(c, c_path);
+
+    // 16 KiB: far less than the operands, so every operation walks many tiles.
+    OutOfCoreEngine engine(16 * 1024, 4);
+    const std::string out = temp_matrix_path("ooc_out");
+    engine.add(a_path, b_path, out);
+    EXPECT_LE(engine.peak_bytes(), engine.memory_budget());
+    EXPECT_TRUE(load_matrix(out) == a + b);
+    engine.subtract(a_path, b_path, out);
+    EXPECT_TRUE(load_matrix(out) == a - b);
+    engine.multiply(a_path, c_path, out);
+    EXPECT_LE(engine.peak_bytes(), engine.memory_budget());
+    EXPECT_LT(max_abs_difference(load_matrix(out), naive_product(a, c)), 1e-9);
+
+    EXPECT_THROW(engine.multiply(a_path, b_path, out), std::invalid_argument);
+    EXPECT_THROW(engine.add(a_path, b_path, a_path), std::invalid_argument);
+    EXPECT_THROW(OutOfCoreEngine(100).add(a_path, b_path, out), std::length_error);
+    for (const auto &path: {a_path, b_path, c_path, out}) {
+        std::filesystem::remove(path);
+    }
+}
+
+TEST(Out_of_core, panel_determinant) {
+    const std::string path = temp_matrix_path("ooc_det");
+    Matrix a = sequence_matrix(90, 90, 5) + Matrix::createDiagonal(90, 40);
+    a.at(0, 0) = 0;
+    save_matrix(a, path);
+    // Room for three 90 x 16 strips: six panels, pivoting across panel boundaries.
+    OutOfCoreEngine engine(3 * 90 * 16 * sizeof(double), 2);
+    const double det = engine.det(path);
+    EXPECT_LE(engine.peak_bytes(), engine.memory_budget());
+    EXPECT_NEAR(det / a.det(), 1.0, 1e-9);
+
+    save_matrix(diagonal0(12), path);
+    EXPECT_NEAR(engine.det(path), -11.0, 1e-9);
+
+    // Just enough for three unpadded 90 x 90 tiles, not for the padded ones.
+    save_matrix(a, path);
+    OutOfCoreEngine tight(3 * 90 * 90 * sizeof(double), 2);
+    EXPECT_NEAR(tight.det(path) / a.det(), 1.0, 1e-9);
+    EXPECT_LE(tight.peak_bytes(), tight.memory_budget());
+    std::filesystem::remove(path);
+}
+
+// About 5% of the elements are non-zero.
+static Matrix sparse_pattern(size_t rows, size_t cols, size_t seed) {
+    Matrix m(rows, cols);
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < cols; j++) {
+            if ((i * 31 + j * 17 + seed) % 20 == 0) m.at(i, j) = static_cast<double>((i + j + seed) % 9) - 4.5;
+        }
+    }
+    return m;
+}
+
+TEST(Sparse_matrix, conversions) {
+    Matrix dense = sparse_pattern(40, 27, 1);
+    SparseMatrix csr = SparseMatrix::from_dense(dense);
+    SparseMatrix csc = SparseMatrix::from_dense(dense, 0, SparseMatrix::Format::CSC);
+    EXPECT_EQ(csr.nonZeros(), csc.nonZeros());
+    EXPECT_LT(csr.nonZeros(), 40u * 27u / 10);
+    EXPECT_TRUE(csr.to_dense() == dense);
+    EXPECT_TRUE(csc.to_dense() == dense);
+    EXPECT_TRUE(csr == csc);
+    EXPECT_TRUE(csc.to_csr() == csr);
+    EXPECT_DOUBLE_EQ(csc.at(0, 0), dense.at(0, 0));
+    EXPECT_DOUBLE_EQ(csr.at(39, 26), dense.at(39, 26));
+    EXPECT_EQ(csr.transposed().getRows(), 27u);
+    EXPECT_DOUBLE_EQ(csr.transposed().at(5, 12), dense.at(12, 5));
+
+    SparseMatrix built = SparseMatrix::from_entries(3, 3, {{2, 1, 1.0}, {0, 0, 2.0}, {2, 1, 4.0}, {7, 0, 1.0}});
+    EXPECT_EQ(built.nonZeros(), 2u);
+    EXPECT_DOUBLE_EQ(built.at(2, 1), 5.0);
+    EXPECT_EQ(built.offsets(), (std::vector<size_t>{0, 1, 1, 2}));
+}
+
+TEST(Sparse_matrix, spmv_spmm_spgemm_and_add) {
+    Matrix a = sparse_pattern(300, 200, 2);
+    Matrix b = sparse_pattern(200, 150, 3);
+    SparseMatrix sa = SparseMatrix::from_dense(a);
+    SparseMatrix sb = SparseMatrix::from_dense(b, 0, SparseMatrix::Format::CSC);
+
+    std::vector<double> x(200);
+    for (size_t j = 0; j < x.size(); j++) x[j] = static_cast<double>(j % 7) - 3;
+    const std::vector<double> y = sa.multiply(x, 4);
+    ASSERT_EQ(y.size(), 300u);
+    for (size_t i = 0; i < 300; i++) {
+        double expected = 0;
+        for (size_t j = 0; j < 200; j++) expected += a.at(i, j) * x[j];
+        EXPECT_DOUBLE_EQ(y[i], expected);
+    }
+
+    const Matrix product = naive_product(a, b);
+    EXPECT_LT(max_abs_difference(sa.multiply(b, 4), product), 1e-12);
+    EXPECT_LT(max_abs_difference(sa.multiply(sb, 4).to_dense(), product), 1e-12);
+    CostModel::instance().set_thread_override(3);
+    EXPECT_LT(max_abs_difference(sa.multiply(sb, 4).to_dense(), product), 1e-12);
+    EXPECT_TRUE(sa.add(a, 4) == a + a);
+    CostModel::instance().set_thread_override(0);
+
+    EXPECT_EQ(sa.add(b, 2).getRows(), 0u);
+    EXPECT_TRUE(sa.multiply(std::vector<double>(3), 2).empty());
+}
+
+TEST(Basic_matrix, float_and_complex_match_double) {
+    Matrix a = sequence_matrix(70, 50, 4);
+    Matrix b = sequence_matrix(50, 40, 5);
+    const FloatMatrix fa(a);
+    const FloatMatrix fb(b);
+    EXPECT_LT(max_abs_difference((fa * fb).to_matrix(), naive_product(a, b)), 1e-3);
+    EXPECT_LT(max_abs_difference((fa + fa).to_matrix(), a + a), 1e-5);
+    EXPECT_EQ((fa * fa).getRows(), 0u);
+
+    ComplexMatrix c(2, 2);
+    c.at(0, 0) = {1, 1};
+    c.at(0, 1) = {2, 0};
+    c.at(1, 0) = {0, 3};
+    c.at(1, 1) = {1, -1};
+    // (1+i)(1-i) - 2 * 3i
+    EXPECT_NEAR(std::abs(c.det() - std::complex<double>(2, -6)), 0, 1e-12);
+    const ComplexMatrix square = c * c;
+    EXPECT_NEAR(std::abs(square.at(0, 0) - (std::complex<double>(1, 1) * std::complex<double>(1, 1) +
+                                            std::complex<double>(0, 6))), 0, 1e-12);
+    EXPECT_TRUE(square - square == ComplexMatrix(2, 2));
+
+    Matrix diagonal = Matrix::createDiagonal(60, 1.5);
+    diagonal.at(3, 7) = 2;
+    EXPECT_NEAR(FloatMatrix(diagonal).fast_det(3), static_cast<float>(std::pow(1.5, 60)), std::pow(1.5, 60) * 1e-4);
+    EXPECT_NEAR(BasicMatrix<double>(diagonal).fast_det(3), diagonal.det(), 1e-6 * std::abs(diagonal.det()));
+}
+
+TEST(Basic_matrix, exact_integer_determinant) {
+    IntMatrix m(3, 3);
+    const int64_t values[3][3] = {{2, -3, 1}, {2, 0, -1}, {1, 4, 5}};
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 3; j++) m.at(i, j) = values[i][j];
+    }
+    EXPECT_EQ(m.det(), 49);
+
+    // Unimodular: upper and lower triangular with unit diagonals, so the determinant is exactly 1
+    // even though the entries are far beyond what double elimination resolves.
+    const size_t n = 90;
+    IntMatrix upper = IntMatrix::createDiagonal(n, 1);
+    IntMatrix lower = IntMatrix::createDiagonal(n, 1);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            upper.at(i, j) = static_cast<int64_t>((i * 7 + j * 3) % 5) - 2;
+            lower.at(j, i) = static_cast<int64_t>((i + j) % 3) - 1;
+        }
+    }
+    const IntMatrix product = lower.fast_multiply_with(upper, 3);
+    EXPECT_EQ(product.fast_det(3), 1);
+    EXPECT_EQ(IntMatrix(4, 4, 7).det(), 0);
+
+    IntMatrix big = IntMatrix::createDiagonal(3, int64_t{1} << 40);
+    EXPECT_THROW((void) big.det(), std::overflow_error);
+    EXPECT_THROW((void) IntMatrix(2, 3).det(), std::invalid_argument);
+
+    // Extremes of int64_t: the products are near 2^126 and the result must be range-checked, and a
+    // row swap must not negate INT64_MIN.
+    constexpr int64_t lowest = std::numeric_limits<int64_t>::min();
+    constexpr int64_t highest = std::numeric_limits<int64_t>::max();
+    IntMatrix extremes(2, 2);
+    extremes.at(0, 0) = lowest;
+    extremes.at(0, 1) = highest;
+    extremes.at(1, 0) = lowest;
+    extremes.at(1, 1) = lowest;
+    EXPECT_THROW((void) extremes.det(), std::overflow_error);
+    IntMatrix swapped(2, 2);
+    swapped.at(0, 1) = 1;
+    swapped.at(1, 0) = lowest;
+    EXPECT_THROW((void) swapped.det(), std::overflow_error);
+    IntMatrix unswapped = IntMatrix::createDiagonal(2, 1);
+    unswapped.at(0, 0) = lowest;
+    EXPECT_EQ(unswapped.det(), lowest);
+}
+
+TEST(Fixed_matrix, constexpr_arithmetic_and_closed_form_det) {
+    constexpr FixedMatrix<2, 3> a{1, 2, 3, 4, 5, 6};
+    constexpr FixedMatrix<3, 2> b{7, 8, 9, 10, 11, 12};
+    constexpr FixedMatrix<2, 2> product = a * b;
+    static_assert(product == FixedMatrix<2, 2>{58, 64, 139, 154});
+    static_assert(product.det() == 58 * 154 - 64 * 139);
+    static_assert((a + a - a) == a);
+    static_assert(FixedSquareMatrix<3>{2, -3, 1, 2, 0, -1, 1, 4, 5}.det() == 49);
+    static_assert(FixedSquareMatrix<5>::createDiagonal(2).det() == 32);
+
+    Matrix dense = sequence_matrix(4, 4, 6);
+    for (size_t i = 0; i < 4; i++) dense.at(i, i) += 10;
+    const FixedSquareMatrix<4> fixed(dense);
+    EXPECT_NEAR(fixed.det(), dense.det(), 1e-9 * std::abs(dense.det()));
+    EXPECT_TRUE((fixed * fixed).to_matrix() == naive_product(dense, dense));
+    EXPECT_THROW(FixedSquareMatrix<3>{dense}, std::invalid_argument);
+}
+
+TEST(Fixed_matrix, eliminated_det_matches_dynamic) {
+    for (size_t seed = 0; seed < 4; seed++) {
+        Matrix dense = sequence_matrix(7, 7, seed);
+        for (size_t i = 0; i < 7; i++) dense.at(i, (i * 3 + seed) % 7) += 5;
+        const FixedSquareMatrix<7> fixed(dense);
+        EXPECT_NEAR(fixed.det(), dense.det(), 1e-9 * std::max(1.0, std::abs(dense.det())));
+        EXPECT_TRUE(fixed.transposed().transposed() == fixed);
+    }
+    FixedSquareMatrix<6, float> singular(1.0f);
+    EXPECT_EQ(singular.det(), 0.0f);
+}
+
+TEST(Batch, interleaved_and_general_determinants) {
+    std::vector<Matrix> uniform;
+    for (size_t s = 0; s < 21; s++) {
+        Matrix m = sequence_matrix(6, 6, s);
+        for (size_t i = 0; i < 6; i++) m.at(i, (i + s) % 6) += 4;
+        uniform.push_back(std::move(m));
+    }
+    uniform[5] = Matrix(6, 6, 1.0);
+    std::vector<Matrix> mixed = {sequence_matrix(3, 3, 1), diagonal0(40, 2), Matrix::createDiagonal(25, 1.1), Matrix()};
+
+    CostModel::instance().set_thread_override(3);
+    const std::vector<double> dets = batch_det(uniform, 3);
+    const std::vector<double> mixed_dets = batch_det(mixed, 3);
+    CostModel::instance().set_thread_override(0);
+
+    ASSERT_EQ(dets.size(), uniform.size());
+    for (size_t s = 0; s < uniform.size(); s++) {
+        const double expected = uniform[s].fast_det(uniform[s], 1);
+        EXPECT_NEAR(dets[s], expected, 1e-10 * std::max(1.0, std::abs(expected)));
+    }
+    EXPECT_EQ(dets[5], 0.0);
+    for (size_t s = 0; s + 1 < mixed.size(); s++) {
+        EXPECT_DOUBLE_EQ(mixed_dets[s], mixed[s].fast_det(mixed[s], 1));
+    }
+    EXPECT_EQ(mixed_dets.back(), 1.0);
+    EXPECT_THROW((void) batch_det(std::vector<Matrix>{Matrix(2, 3)}), std::invalid_argument);
+}
+
+TEST(Batch, multiply_and_add) {
+    std::vector<Matrix> a, b;
+    for (size_t s = 0; s < 13; s++) {
+        a.push_back(sequence_matrix(5, 3, s));
+        b.push_back(sequence_matrix(3, 4, s + 1));
+    }
+    CostModel::instance().set_thread_override(3);
+    const std::vector<Matrix> products = batch_multiply(a, b);
+    const std::vector<Matrix> sums = batch_add(a, a);
+    CostModel::instance().set_thread_override(0);
+    for (size_t s = 0; s < a.size(); s++) {
+        EXPECT_LT(max_abs_difference(products[s], naive_product(a[s], b[s])), 1e-12);
+        EXPECT_TRUE(sums[s] == a[s] + a[s]);
+    }
+
+    a.push_back(sequence_matrix(30, 20, 1));
+    b.push_back(sequence_matrix(20, 30, 2));
+    b[0] = Matrix(2, 2);
+    const std::vector<Matrix> general = batch_multiply(a, b, 2);
+    EXPECT_EQ(general[0].getRows(), 0u);
+    EXPECT_TRUE(general.back() == naive_product(a.back(), b.back()));
+    EXPECT_EQ(batch_add(a, b)[1].getRows(), 0u);
+    EXPECT_THROW((void) batch_add(a, std::span<const Matrix>(b).first(2)), std::invalid_argument);
+}
+
+static double max_abs_element(const Matrix &m) {
+    double max = 0;
+    for (size_t i = 0; i < m.getRows(); i++)
+        for (size_t j = 0; j < m.getCols(); j++)
+            max = std::max(max, std::abs(m.at(i, j)));
+    return max;
+}
+
+TEST(Strassen, matches_classical_product) {
+    // Odd sizes peel a row, a column and an inner index at several levels.
+    Matrix a = sequence_matrix(301, 263, 1);
+    Matrix b = sequence_matrix(263, 277, 2);
+    const Matrix classical = naive_product(a, b);
+    const double scale = max_abs_element(a) * max_abs_element(b) * 263;
+    for (size_t threads: {1, 3, 16}) {
+        const Matrix product = strassen_multiply(a, b, {.cutoff = 40, .num_of_threads = threads});
+        ASSERT_EQ(product.getRows(), 301u);
+        ASSERT_EQ(product.getCols(), 277u);
+        EXPECT_LT(max_abs_difference(product, classical) / scale, 1e-12) << threads;
+    }
+    EXPECT_TRUE(strassen_multiply(a, b, {.cutoff = 512, .num_of_threads = 1}) == a.fast_multiply_with(b, 1));
+    EXPECT_EQ(strassen_multiply(a, a).getRows(), 0u);
+}
+
+TEST(Strassen, workspace_and_aliasing) {
+    const StrassenOptions serial{.cutoff = 64, .num_of_threads = 1};
+    // One level: 4 S, 4 T and 7 P blocks of 100 x 100; the serial children share one workspace.
+    EXPECT_EQ(strassen_workspace_size(200, 200, 200, serial), 15u * 100 * 100 + 15u * 50 * 50);
+    EXPECT_EQ(strassen_workspace_size(64, 1000, 1000, serial), 0u);
+    EXPECT_GT(strassen_workspace_size(200, 200, 200, {.cutoff = 64, .num_of_threads = 8}),
+              strassen_workspace_size(200, 200, 200, serial));
+
+    Matrix a = sequence_matrix(150, 150, 5);
+    const Matrix expected = naive_product(a, a);
+    strassen_multiply_into(a, a, a, serial);
+    EXPECT_LT(max_abs_difference(a, expected) / max_abs_element(expected), 1e-12);
+}
+
+TEST(Transpose, blocked_and_inplace) {
+    Matrix a = sequence_matrix(77, 130, 3);
+    const Matrix t = a.transposed(3);
+    ASSERT_EQ(t.getRows(), 130u);
+    ASSERT_EQ(t.getCols(), 77u);
+    for (size_t i = 0; i < 77; i++)
+        for (size_t j = 0; j < 130; j++)
+            ASSERT_EQ(t.at(j, i), a.at(i, j));
+
+    Matrix square = sequence_matrix(101, 101, 4);
+    const Matrix original = square;
+    CostModel::instance().set_thread_override(3);
+    square.transpose_inplace(3);
+    CostModel::instance().set_thread_override(0);
+    EXPECT_TRUE(square == original.transposed());
+    square.transpose_inplace();
+    EXPECT_TRUE(square == original);
+
+    a.transpose_inplace();
+    EXPECT_TRUE(a == t);
+}
+
+TEST(Transpose, transposed_operands_and_gram) {
+    Matrix a = sequence_matrix(90, 70, 1);
+    Matrix b = sequence_matrix(90, 60, 2);
+    Matrix c = sequence_matrix(50, 70, 3);
+    Matrix at = a.transposed();
+    Matrix bt = b.transposed();
+    Matrix ct = c.transposed();
+    EXPECT_LT(max_abs_difference(multiply(a, b, true, false), naive_product(at, b)), 1e-9);
+    EXPECT_LT(max_abs_difference(multiply(a, c, false, true), naive_product(a, ct)), 1e-9);
+    EXPECT_LT(max_abs_difference(multiply(b, a, true, true), naive_product(bt, at)), 1e-9);
+    EXPECT_TRUE(multiply(a, c) == a.fast_multiply_with(c, 1));
+    EXPECT_EQ(multiply(a, c, true, false).getRows(), 0u);
+
+    CostModel::instance().set_thread_override(3);
+    const Matrix gram_a = gram(a);
+    const Matrix outer = gram(a, false);
+    Matrix parallel;
+    multiply_into(a, b, parallel, true, false, 3);
+    CostModel::instance().set_thread_override(0);
+    EXPECT_LT(max_abs_difference(gram_a, naive_product(at, a)), 1e-9);
+    EXPECT_LT(max_abs_difference(outer, naive_product(a, at)), 1e-9);
+    EXPECT_TRUE(gram_a == gram_a.transposed());
+    EXPECT_LT(max_abs_difference(parallel, naive_product(at, b)), 1e-9);
+}
+
+TEST(Transpose, gram_keeps_to_the_planned_threads) {
+    // 200 columns give four tile rows; two threads must share them instead of one task each.
+    Matrix a = sequence_matrix(30, 200, 2);
+    Matrix at = a.transposed();
+    CostModel::instance().set_thread_override(3);
+    Profiler::instance().start();
+    const Matrix g = gram(a, true, 2);
+    Profiler::instance().stop();
+    CostModel::instance().set_thread_override(0);
+    const std::vector<ProfileEvent> events = Profiler::instance().events();
+    EXPECT_EQ(std::count_if(events.begin(), events.end(), [](const ProfileEvent &event) {
+        return std::string(event.name) == "task";
+    }), 2);
+    EXPECT_LT(max_abs_difference(g, naive_product(at, a)), 1e-9);
+    EXPECT_TRUE(g == gram(a, true, 1));
+}
+
+TEST(Numa, topology_pinning_and_placement) {
+    const NumaTopology &topology = NumaTopology::instance();
+    ASSERT_GE(topology.node_count(), 1u);
+    for (const NumaNode &node: topology.nodes()) EXPECT_FALSE(node.cpus.empty());
+
+    ThreadPool pool(2);
+    EXPECT_TRUE(pin_workers_round_robin(pool, topology));
+    EXPECT_FALSE(pool.set_worker_affinity(2, {0}));
+
+    // Two logical nodes on the same physical one exercise the per-node paths on any host.
+    const NumaTopology doubled({topology.nodes()[0], topology.nodes()[0]});
+    Matrix m = sequence_matrix(600, 700, 1);
+    const Matrix copy = m;
+    // Heap buffers are left alone: a policy would outlive them on the address range.
+    EXPECT_FALSE(place_rows_by_node(m, doubled));
+    NumaMemoryResource bound(NumaMemoryResource::Policy::Bind);
+    Matrix placed(600, 700, 0, &bound);
+    placed = copy;
+    (void) place_rows_by_node(placed, doubled);
+    EXPECT_TRUE(m == copy);
+    EXPECT_TRUE(placed == copy);
+
+    NumaExecutor executor(doubled);
+    std::vector<std::pair<size_t, size_t>> ranges(2);
+    executor.for_each_node(101, [&](size_t node, size_t begin, size_t end) { ranges[node] = {begin, end}; });
+    EXPECT_EQ(ranges, make_row_intervals(101, 2));
+}
+
+TEST(Numa, interleaved_resource_and_node_split_arithmetic) {
+    NumaMemoryResource interleaved(NumaMemoryResource::Policy::Interleave);
+    Matrix a(300, 257, 0, &interleaved);
+    Matrix b(300, 257, 0, &interleaved);
+    a = sequence_matrix(300, 257, 1);
+    b = sequence_matrix(300, 257, 2);
+    EXPECT_EQ(a.resource(), &interleaved);
+
+    Matrix sum, difference;
+    numa_sum_into(a, b, sum);
+    numa_subtract_into(a, b, difference);
+    EXPECT_TRUE(sum == a + b);
+    EXPECT_TRUE(difference == a - b);
+    // The fresh result was never zero-filled, but its padding must still be zero.
+    ASSERT_GT(sum.stride(), sum.getCols());
+    EXPECT_EQ(sum.data()[sum.stride() - 1], 0.0);
+    EXPECT_EQ(difference.data()[299 * difference.stride() + 257], 0.0);
+    const Matrix original = a;
+    numa_sum_into(a, a, a);
+    EXPECT_TRUE(a == original + original);
+    numa_sum_into(a, Matrix(3, 3), sum);
+    EXPECT_EQ(sum.getRows(), 0u);
+}
+
+TEST(Async, graph_matches_synchronous_result) {
+    Matrix a = sequence_matrix(60, 40, 1);
+    Matrix b = sequence_matrix(40, 60, 2);
+    Matrix c = Matrix::createDiagonal(60, 3);
+    Matrix d = sequence_matrix(60, 60, 3);
+
+    // A * B and C + D are independent nodes; their sum waits for both.
+    const AsyncMatrix product = multiply_async(a, b);
+    const AsyncMatrix shifted = sum_async(c, d);
+    const AsyncMatrix total = sum_async(product, shifted);
+    const MatrixFuture<double> det = det_async(total);
+    const MatrixFuture<double> trace = total.then([](const Matrix &m) {
+        double sum = 0;
+        for (size_t i = 0; i < m.getRows(); i++) sum += m.at(i, i);
+        return sum;
+    });
+
+    const Matrix expected = a * b + (c + d);
+    EXPECT_LT(max_abs_difference(total.get(), expected), 1e-9);
+    EXPECT_NEAR(det.get(), expected.det(), 1e-9 * std::abs(expected.det()));
+    double expected_trace = 0;
+    for (size_t i = 0; i < 60; i++) expected_trace += expected.at(i, i);
+    EXPECT_NEAR(trace.get(), expected_trace, 1e-9);
+    EXPECT_LT(max_abs_difference(multiply_async(solve_async(total, c), inverse_async(c)).get(),
+                                 expected.inverse()), 1e-9);
+}
+
+TEST(Async, nodes_wait_for_operands_and_propagate_errors) {
+    std::atomic<bool> release{false};
+    const MatrixFuture<int> gate = when_ready([&] {
+        while (!release) std::this_thread::yield();
+        return 1;
+    });
+    const MatrixFuture<int> dependent = gate.then([](int value) { return value + 1; });
+    const MatrixFuture<int> nested = dependent.then([](int value) { return MatrixFuture<int>(value * 10); });
+    EXPECT_FALSE(dependent.ready());
+    release = true;
+    EXPECT_EQ(dependent.get(), 2);
+    EXPECT_EQ(nested.get(), 20);
+
+    const AsyncMatrix singular = inverse_async(Matrix(4, 4));
+    const AsyncMatrix downstream = sum_async(singular, Matrix(4, 4));
+    EXPECT_THROW((void) downstream.get(), SingularMatrixError);
+    EXPECT_THROW((void) singular.get(), SingularMatrixError);
+    EXPECT_EQ(sum_async(Matrix(2, 2), Matrix(3, 3)).get().getRows(), 0u);
+}
+
+TEST(Vector_kernels, gemv_and_transposed_gemv) {
+    Matrix a = sequence_matrix(150, 97, 1);
+    Vector x(97);
+    Vector z(150);
+    Matrix x_column(97, 1);
+    for (size_t j = 0; j < 97; j++) x_column.at(j, 0) = x[j] = std::sin(static_cast<double>(j));
+    for (size_t i = 0; i < 150; i++) z[i] = std::cos(static_cast<double>(i));
+
+    const Vector y = gemv(a, x, 1);
+    const Matrix expected = naive_product(a, x_column);
+    ASSERT_EQ(y.size(), 150u);
+    for (size_t i = 0; i < 150; i++) EXPECT_NEAR(y[i], expected.at(i, 0), 1e-9);
+
+    CostModel::instance().set_thread_override(3);
+    EXPECT_TRUE(gemv(a, x, 3) == y);
+    const Vector t = gemv_transposed(a, z, 3);
+    CostModel::instance().set_thread_override(0);
+    EXPECT_TRUE(gemv_transposed(a, z, 1) == t);
+    for (size_t j = 0; j < 97; j++) {
+        double sum = 0;
+        for (size_t i = 0; i < 150; i++) sum += a.at(i, j) * z[i];
+        EXPECT_NEAR(t[j], sum, 1e-9);
+    }
+    EXPECT_TRUE(gemv(a, z).empty());
+    EXPECT_TRUE(gemv_transposed(a, x).empty());
+}
+
+TEST(Vector_kernels, deterministic_reductions_and_axpy) {
+    const size_t n = 3 * kReductionBlock + 123;
+    Vector x(n), y(n);
+    for (size_t i = 0; i < n; i++) {
+        x[i] = std::sin(static_cast<double>(i)) * 1e8;
+        y[i] = 1.0 / static_cast<double>(i + 1);
+    }
+    const double serial = dot(x, y, 1);
+    CostModel::instance().set_thread_override(3);
+    EXPECT_EQ(dot(x, y, 3), serial);
+    EXPECT_EQ(norm2(x, 3), norm2(x, 1));
+    Vector sum = y;
+    EXPECT_TRUE(axpy(2.0, x, sum, 3));
+    CostModel::instance().set_thread_override(0);
+    for (size_t i = 0; i < n; i += 997) EXPECT_EQ(sum[i], y[i] + 2.0 * x[i]);
+
+    EXPECT_DOUBLE_EQ(norm2(Vector{3, 4}), 5);
+    EXPECT_DOUBLE_EQ(norm2(Vector{3e200, 4e200}), 5e200);
+    EXPECT_DOUBLE_EQ(norm2(Vector{3e-200, 4e-200}), 5e-200);
+    EXPECT_DOUBLE_EQ(dot(Vector{1, 2, 3}, Vector{4, 5, 6}), 32);
+    EXPECT_THROW((void) dot(Vector(2), Vector(3)), std::invalid_argument);
+    EXPECT_FALSE(axpy(1, Vector(2), sum));
+}
+
+TEST(Profiler, records_operations_and_pool_tasks) {
+    Matrix a = sequence_matrix(96, 64, 1);
+    Matrix c = sequence_matrix(64, 80, 2);
+    a.multithreadingOn();
+    Profiler &profiler = Profiler::instance();
+
+    CostModel::instance().set_thread_override(3);
+    profiler.start();
+    Matrix product = a.fast_multiply_with(c, 3);
+    profiler.stop();
+    (void) a.fast_sum_with(a, 3);
+    CostModel::instance().set_thread_override(0);
+
+    const std::vector<ProfileEvent> events = profiler.events();
+    const auto multiply = std::find_if(events.begin(), events.end(), [](const ProfileEvent &event) {
+        return std::string(event.name) == "multiply_into";
+    });
+    ASSERT_NE(multiply, events.end());
+    EXPECT_EQ(multiply->threads, 3u);
+    EXPECT_DOUBLE_EQ(multiply->flops, WorkEstimate::multiply(96, 80, 64).flops);
+    const auto tasks = std::count_if(events.begin(), events.end(), [](const ProfileEvent &event) {
+        return std::string(event.name) == "task";
+    });
+    EXPECT_EQ(tasks, 3);
+    // Recording stopped before the sum.
+    EXPECT_TRUE(std::none_of(events.begin(), events.end(), [](const ProfileEvent &event) {
+        return std::string(event.name) == "sum_into";
+    }));
+
+    size_t utilized_tasks = 0;
+    for (const ThreadUtilization &thread: profiler.utilization()) {
+        utilized_tasks += thread.tasks;
+        EXPECT_GT(thread.busy_ns + thread.idle_ns, 0u);
+    }
+    EXPECT_EQ(utilized_tasks, 3u);
+}
+
+TEST(Profiler, json_and_chrome_trace) {
+    Matrix square = sequence_matrix(40, 40, 3) + Matrix::createDiagonal(40, 5);
+    Profiler &profiler = Profiler::instance();
+    profiler.start();
+    (void) square.fast_det(square, 2);
+    profiler.stop();
+    const size_t recorded = profiler.events().size();
+    ASSERT_GT(recorded, 0u);
+
+    std::ostringstream json;
+    profiler.write_json(json);
+    EXPECT_EQ(json.str().rfind("{\"duration_us\": ", 0), 0u);
+    EXPECT_NE(json.str().find("\"name\": \"fast_det\""), std::string::npos);
+    EXPECT_NE(json.str().find("\"threads\": ["), std::string::npos);
+
+    std::ostringstream trace;
+    profiler.write_chrome_trace(trace);
+    const std::string text = trace.str();
+    size_t complete_events = 0;
+    for (size_t at = text.find("\"ph\": \"X\""); at != std::string::npos; at = text.find("\"ph\": \"X\"", at + 1)) {
+        complete_events++;
+    }
+    EXPECT_EQ(complete_events, recorded);
+    EXPECT_EQ(text.back(), '\n');
+}
+
+TEST(Cholesky, blocked_factor_det_and_solve) {
+    // Spans several panels, with a partial last one.
+    const size_t n = 150;
+    Matrix a = gram(sequence_matrix(170, n, 4)) + Matrix::createDiagonal(n, 2);
+    ASSERT_TRUE(is_symmetric(a));
+    Matrix b = sequence_matrix(n, 3, 9);
+    for (size_t threads: {1, 3}) {
+        CholeskyDecomposition factors(a, threads);
+        ASSERT_TRUE(factors.positive_definite());
+        Matrix l = factors.lower();
+        EXPECT_EQ(l.at(3, 7), 0.0);
+        EXPECT_LT(max_abs_difference(multiply(l, l, false, true), a), 1e-9 * max_abs_element(a));
+        EXPECT_NEAR(factors.log_det(), std::log(a.det()), 1e-9 * std::abs(factors.log_det()));
+        Matrix x = factors.solve(b);
+        EXPECT_LT(max_abs_difference(a * x, b), 1e-9 * max_abs_element(b));
+    }
+    // Packed storage holds the lower triangle only and factors the same way.
+    const SymmetricMatrix packed(a);
+    EXPECT_TRUE(packed.to_matrix() == a);
+    EXPECT_DOUBLE_EQ(packed.at(5, 90), a.at(90, 5));
+    EXPECT_DOUBLE_EQ(CholeskyDecomposition(packed).log_det(), CholeskyDecomposition(a).log_det());
+}
+
+TEST(Cholesky, non_spd_falls_back_to_lu) {
+    Matrix indefinite = Matrix::createDiagonal(4, 1);
+    indefinite.at(2, 2) = -3;
+    indefinite.at(0, 3) = indefinite.at(3, 0) = 0.5;
+    EXPECT_FALSE(CholeskyDecomposition(indefinite).positive_definite());
+    EXPECT_THROW((void) CholeskyDecomposition(indefinite).det(), std::domain_error);
+    EXPECT_NEAR(spd_det(indefinite), indefinite.det(), 1e-12);
+    const LogDeterminant indefinite_log = log_det(indefinite);
+    EXPECT_EQ(indefinite_log.sign, -1);
+    EXPECT_NEAR(indefinite_log.log_abs, std::log(std::abs(indefinite.det())), 1e-12);
+
+    Matrix general = sequence_matrix(5, 5, 2) + Matrix::createDiagonal(5, 4);
+    ASSERT_FALSE(is_symmetric(general));
+    Matrix rhs = sequence_matrix(5, 2, 1);
+    EXPECT_LT(max_abs_difference(spd_solve(general, rhs), solve(general, rhs)), 1e-12);
+    EXPECT_EQ(log_det(Matrix(3, 3, 1.0)).sign, 0);
+
+    Matrix spd = Matrix::createDiagonal(3, 4);
+    EXPECT_DOUBLE_EQ(spd_det(spd), 64);
+    EXPECT_NEAR(log_det(spd).log_abs, std::log(64.0), 1e-15);
+}
+
+TEST(Cholesky, ill_conditioned_spd_is_rejected_like_solve) {
+    const size_t n = 12;
+    Matrix hilbert(n, n);
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++) hilbert.at(i, j) = 1.0 / static_cast<double>(i + j + 1);
+    const CholeskyDecomposition factors(hilbert);
+    ASSERT_TRUE(factors.positive_definite());
+    EXPECT_LT(factors.rcond(), std::numeric_limits<double>::epsilon());
+    EXPECT_NEAR(std::log10(factors.rcond()), std::log10(hilbert.lu().rcond()), 1.0);
+    const Matrix rhs(n, 1, 1.0);
+    EXPECT_THROW((void) solve(hilbert, rhs), SingularMatrixError);
+    EXPECT_THROW((void) spd_solve(hilbert, rhs), SingularMatrixError);
+
+    Matrix spd = Matrix::createDiagonal(4, 2);
+    spd.at(0, 1) = spd.at(1, 0) = 0.5;
+    EXPECT_NEAR(CholeskyDecomposition(spd).rcond(), spd.lu().rcond(), 1e-12);
+}
@@ -0,0 +1,200 @@
+#include "thread_pool.h"
+#include "memory_arena.h"
+#include "profiler.h"
+#include <exception>
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+constexpr size_t kNoWorker = static_cast<size_t>(-1);
+
+thread_local const ThreadPool *t_pool = nullptr;
+thread_local size_t t_worker = kNoWorker;
+
+std::atomic<size_t> g_default_workers{kNoWorker};
+
+}
+
+ThreadPool &ThreadPool::instance() {
+    static ThreadPool pool([] {
+        const size_t requested = g_default_workers.load();
+        if (requested != kNoWorker) return requested;
+        const size_t hardware = std::thread::hardware_concurrency();
+        return hardware > 1 ? hardware - 1 : size_t{0};
+    }());
+    return pool;
+}
+
+void ThreadPool::set_default_workers(size_t workers) {
+    g_default_workers = workers;
+}
+
+ThreadPool::ThreadPool(size_t workers) {
+    start(workers);
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown();
+}
+
+size_t ThreadPool::size() const {
+    return m_threads.size();
+}
+
+size_t ThreadPool::concurrency() const {
+    return size() + 1;
+}
+
+void ThreadPool::resize(size_t workers) {
+    shutdown();
+    start(workers);
+}
+
+void ThreadPool::start(size_t workers) {
+    {
+        std::lock_guard lock(m_sleep_mutex);
+        m_stop = false;
+    }
+    m_queues.clear();
+    for (size_t i = 0; i < workers; i++) {
+        m_queues.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < workers; i++) {
+        m_threads.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+bool ThreadPool::set_worker_affinity(size_t worker, const std::vector<size_t> &cpus) {
+    if (worker >= m_threads.size() || cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t cpu: cpus) {
+        if (cpu >= CPU_SETSIZE) return false;
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(m_threads[worker].native_handle(), sizeof(set), &set) == 0;
+}
+
+void ThreadPool::shutdown() {
+    {
+        std::lock_guard lock(m_sleep_mutex);
+        m_stop = true;
+    }
+    m_wakeup.notify_all();
+    for (auto &thread: m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+    // Anything pushed while the workers were exiting still has to complete.
+    Task task;
+    while (try_pop(task)) {
+        task();
+    }
+}
+
+void ThreadPool::push(Task task) {
+    if (m_threads.empty()) {
+        task();
+        return;
+    }
+    const size_t index = t_pool == this ? t_worker : m_next_queue.fetch_add(1) % m_queues.size();
+    // Counted before it is visible: a thief may pop (and decrement) it as soon as it is queued.
+    // A count ahead of the deques only costs try_pop a scan of empty ones.
+    m_pending.fetch_add(1);
+    {
+        std::lock_guard lock(m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard lock(m_sleep_mutex);
+    }
+    m_wakeup.notify_one();
+}
+
+bool ThreadPool::try_pop(Task &task) {
+    if (m_pending.load() == 0) return false;
+    const size_t count = m_queues.size();
+    const size_t own = t_pool == this ? t_worker : kNoWorker;
+    if (own != kNoWorker) {
+        Worker &worker = *m_queues[own];
+        std::lock_guard lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            m_pending.fetch_sub(1);
+            return true;
+        }
+    }
+    const size_t first = own != kNoWorker ? own + 1 : 0;
+    for (size_t offset = 0; offset < count; offset++) {
+        Worker &victim = *m_queues[(first + offset) % count];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            m_pending.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::run_pending_task() {
+    Task task;
+    if (!try_pop(task)) return false;
+    // A stolen task may belong to an unrelated caller: it must not allocate from this thread's scratch arena.
+    std::pmr::memory_resource *previous = set_matrix_memory_resource(nullptr);
+    {
+        MATRIX_PROFILE_TASK();
+        task();
+    }
+    set_matrix_memory_resource(previous);
+    return true;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+    t_pool = this;
+    t_worker = index;
+    while (true) {
+        if (run_pending_task()) continue;
+        std::unique_lock lock(m_sleep_mutex);
+        m_wakeup.wait(lock, [this] { return m_stop || m_pending.load() > 0; });
+        if (m_stop && m_pending.load() == 0) break;
+    }
+    t_pool = nullptr;
+    t_worker = kNoWorker;
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)> &body) {
+    if (count == 0) return;
+    if (count == 1 || m_threads.empty()) {
+        for (size_t i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+    std::atomic<size_t> remaining{count};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto run = [&](size_t i) {
+        try {
+            body(i);
+        } catch (...) {
+            std::lock_guard lock(error_mutex);
+            if (!error) error = std::current_exception();
+        }
+        remaining.fetch_sub(1, std::memory_order_release);
+    };
+    for (size_t i = 1; i < count; i++) {
+        push([&run, i] { run(i); });
+    }
+    {
+        MATRIX_PROFILE_TASK();
+        run(0);
+    }
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (!run_pending_task()) std::this_thread::yield();
+    }
+    if (error) std::rethrow_exception(error);
+}
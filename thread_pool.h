@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Process-wide pool of long-lived workers. Every worker owns a deque: it pushes and pops
+// its own tasks at the back and idle workers steal from the front of the others.
+// Threads that wait on pool work (parallel_for, wait) run queued tasks meanwhile,
+// so nested parallel calls from inside a task cannot deadlock the pool.
+class ThreadPool final {
+public:
+    using Task = std::function<void()>;
+
+    // Shared instance used by every fast_* path; sized by set_default_workers() or
+    // hardware_concurrency() - 1 (the calling thread is the remaining one).
+    static ThreadPool &instance();
+
+    // Must be called before the first instance() call to take effect; instance().resize() works later.
+    static void set_default_workers(size_t workers);
+
+    explicit ThreadPool(size_t workers);
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool();
+
+    [[nodiscard]] size_t size() const;
+
+    // Number of threads that take part in a parallel_for: the workers plus the caller.
+    [[nodiscard]] size_t concurrency() const;
+
+    // Drains queued tasks, joins the workers and starts `workers` new ones. Not callable from a worker.
+    void resize(size_t workers);
+
+    // Runs the remaining tasks and joins all workers. Later submissions run inline in the caller.
+    void shutdown();
+
+    // Restricts worker `worker` to the given CPUs (Linux affinity mask). Returns false if the
+    // worker does not exist or the OS refused. resize() starts unpinned workers.
+    bool set_worker_affinity(size_t worker, const std::vector<size_t> &cpus);
+
+    template<typename F>
+    auto submit(F &&f) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using R = std::invoke_result_t<std::decay_t<F>>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        auto future = task->get_future();
+        push([task] { (*task)(); });
+        return future;
+    }
+
+    // Runs body(0) ... body(count - 1) across the pool and returns when all of them finished.
+    void parallel_for(size_t count, const std::function<void(size_t)> &body);
+
+    // Splits [begin, end) into at most `parts` contiguous ranges of at least min_chunk elements and
+    // runs body(from, to) on each of them; a single range runs inline.
+    template<typename F>
+    void parallel_ranges(size_t begin, size_t end, size_t parts, size_t min_chunk, F &&body) {
+        const size_t total = end > begin ? end - begin : 0;
+        parts = std::max<size_t>(1, std::min(parts, total / std::max<size_t>(min_chunk, 1)));
+        if (parts == 1) {
+            if (total > 0) body(begin, end);
+            return;
+        }
+        const size_t chunk = total / parts;
+        parallel_for(parts, [&](size_t part) {
+            const size_t from = begin + part * chunk;
+            const size_t to = part + 1 == parts ? end : from + chunk;
+            body(from, to);
+        });
+    }
+
+    // Blocks until the future is ready, executing queued tasks instead of sleeping.
+    template<typename R>
+    R wait(std::future<R> &future) {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!run_pending_task()) std::this_thread::yield();
+        }
+        return future.get();
+    }
+
+    // Pops one task (own deque first, then steals) and runs it. Returns false if none was found.
+    bool run_pending_task();
+
+private:
+    struct Worker {
+        std::deque<Task> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_pending{0};
+    std::atomic<size_t> m_next_queue{0};
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wakeup;
+    bool m_stop = false;
+
+    void start(size_t workers);
+
+    void push(Task task);
+
+    bool try_pop(Task &task);
+
+    void worker_loop(size_t index);
+};
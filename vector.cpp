@@ -0,0 +1,199 @@
+#include "vector.h"
+#include "calculator_manager.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+size_t plan(const WorkEstimate &work, size_t num_of_threads) {
+    return CostModel::instance().threads_for(work, std::max<size_t>(num_of_threads, 1));
+}
+
+// Runs body(begin, end) on the make_row_intervals(count, threads) ranges.
+template<typename F>
+void for_intervals(size_t count, size_t threads, F &&body) {
+    const auto intervals = make_row_intervals(count, threads);
+    if (intervals.size() == 1) {
+        body(intervals[0].first, intervals[0].second);
+        return;
+    }
+    ThreadPool::instance().parallel_for(intervals.size(), [&](size_t i) {
+        body(intervals[i].first, intervals[i].second);
+    });
+}
+
+// Doubles per 64-byte cache line; Vector and Matrix rows start on a line (kMatrixAlignment).
+constexpr size_t kLineDoubles = kMatrixAlignment / sizeof(double);
+
+// Runs body(from, to) on up to `threads` ranges of [0, count) whose boundaries are whole cache
+// lines, so threads writing neighbouring ranges never share a line.
+template<typename F>
+void for_cache_lines(size_t count, size_t threads, F &&body) {
+    const size_t lines = (count + kLineDoubles - 1) / kLineDoubles;
+    ThreadPool::instance().parallel_ranges(0, lines, threads, 1, [&](size_t first, size_t last) {
+        body(first * kLineDoubles, std::min(count, last * kLineDoubles));
+    });
+}
+
+// sum over j of x[j] * y[j]: block sums of kReductionBlock elements, added in block order.
+double blocked_dot(const double *x, const double *y, size_t n, size_t num_of_threads) {
+    const size_t blocks = (n + kReductionBlock - 1) / kReductionBlock;
+    if (blocks == 0) return 0;
+    std::vector<double> partial(blocks);
+    WorkEstimate work = WorkEstimate::elementwise(1, n, 2);
+    work.max_parallelism = blocks;
+    const SimdKernels &kernels = simd();
+    for_intervals(blocks, plan(work, num_of_threads), [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; b++) {
+            const size_t from = b * kReductionBlock;
+            partial[b] = kernels.dot(x + from, y + from, std::min(kReductionBlock, n - from));
+        }
+    });
+    double sum = 0;
+    for (double value: partial) sum += value;
+    return sum;
+}
+
+}
+
+Vector::Vector(size_t n, double value) : m_storage(n == 0 ? 0 : 1, n) {
+    if (value != 0) std::fill(begin(), end(), value);
+}
+
+Vector::Vector(std::initializer_list<double> values) : Vector(values.size()) {
+    std::copy(values.begin(), values.end(), begin());
+}
+
+size_t Vector::size() const {
+    return m_storage.cols();
+}
+
+bool Vector::empty() const {
+    return size() == 0;
+}
+
+double &Vector::operator[](size_t i) {
+    return m_storage(0, i);
+}
+
+const double &Vector::operator[](size_t i) const {
+    return m_storage(0, i);
+}
+
+double *Vector::data() {
+    return m_storage.data();
+}
+
+const double *Vector::data() const {
+    return m_storage.data();
+}
+
+double *Vector::begin() {
+    return data();
+}
+
+double *Vector::end() {
+    return data() + size();
+}
+
+const double *Vector::begin() const {
+    return data();
+}
+
+const double *Vector::end() const {
+    return data() + size();
+}
+
+bool Vector::operator==(const Vector &another) const {
+    return size() == another.size() && std::equal(begin(), end(), another.begin());
+}
+
+bool Vector::operator!=(const Vector &another) const {
+    return !(*this == another);
+}
+
+Vector gemv(const Matrix &a, const Vector &x, size_t num_of_threads) {
+    Vector y;
+    gemv_into(a, x, y, num_of_threads);
+    return y;
+}
+
+void gemv_into(const Matrix &a, const Vector &x, Vector &y, size_t num_of_threads) {
+    const size_t rows = a.getRows();
+    const size_t cols = a.getCols();
+    if (x.size() != cols) {
+        y = Vector();
+        return;
+    }
+    if (&y == &x) {
+        Vector result;
+        gemv_into(a, x, result, num_of_threads);
+        y = std::move(result);
+        return;
+    }
+    if (y.size() != rows) y = Vector(rows);
+    // One pass over A (8 bytes per 2 flops) dominates; x stays in cache.
+    WorkEstimate work = WorkEstimate::elementwise(rows, cols, 1);
+    work.flops = 2.0 * static_cast<double>(rows) * static_cast<double>(cols);
+    const SimdKernels &kernels = simd();
+    for_intervals(rows, plan(work, num_of_threads), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            y[i] = kernels.dot(a.data() + i * a.stride(), x.data(), cols);
+        }
+    });
+}
+
+Vector gemv_transposed(const Matrix &a, const Vector &x, size_t num_of_threads) {
+    const size_t rows = a.getRows();
+    const size_t cols = a.getCols();
+    if (x.size() != rows) return {};
+    Vector y(cols);
+    WorkEstimate work = WorkEstimate::elementwise(rows, cols, 1);
+    work.flops = 2.0 * static_cast<double>(rows) * static_cast<double>(cols);
+    // Whole cache lines of y per thread, so no two threads write the same line.
+    work.max_parallelism = (cols + kLineDoubles - 1) / kLineDoubles;
+    const size_t threads = plan(work, num_of_threads);
+    const SimdKernels &kernels = simd();
+    for_cache_lines(cols, threads, [&](size_t from, size_t to) {
+        double *out = y.data() + from;
+        for (size_t i = 0; i < rows; i++) {
+            kernels.axpy(x[i], a.data() + i * a.stride() + from, out, to - from);
+        }
+    });
+    return y;
+}
+
+double dot(const Vector &x, const Vector &y, size_t num_of_threads) {
+    if (x.size() != y.size()) {
+        throw std::invalid_argument("dot: vectors differ in size");
+    }
+    return blocked_dot(x.data(), y.data(), x.size(), num_of_threads);
+}
+
+double norm2(const Vector &x, size_t num_of_threads) {
+    const double squares = blocked_dot(x.data(), x.data(), x.size(), num_of_threads);
+    if (std::isfinite(squares) && squares > std::numeric_limits<double>::min()) {
+        return std::sqrt(squares);
+    }
+    // Squares overflowed or underflowed: scale by the largest magnitude first.
+    double scale = 0;
+    for (double value: x) scale = std::max(scale, std::abs(value));
+    if (scale == 0 || !std::isfinite(scale)) return scale;
+    double sum = 0;
+    for (double value: x) sum += (value / scale) * (value / scale);
+    return scale * std::sqrt(sum);
+}
+
+bool axpy(double alpha, const Vector &x, Vector &y, size_t num_of_threads) {
+    if (x.size() != y.size()) return false;
+    WorkEstimate work = WorkEstimate::elementwise(1, x.size(), 2);
+    work.max_parallelism = (x.size() + kLineDoubles - 1) / kLineDoubles;
+    const SimdKernels &kernels = simd();
+    for_cache_lines(x.size(), plan(work, num_of_threads), [&](size_t from, size_t to) {
+        kernels.axpy(alpha, x.data() + from, y.data() + from, to - from);
+    });
+    return true;
+}
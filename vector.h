@@ -0,0 +1,72 @@
+#pragma once
+
+#include "matrix.h"
+#include <cstddef>
+#include <initializer_list>
+
+// Dense vector for the matrix-vector kernels, stored like one Matrix row (aligned, padded,
+// allocated from matrix_memory_resource()).
+class Vector final {
+public:
+    Vector() = default;
+
+    explicit Vector(size_t n, double value = 0);
+
+    Vector(std::initializer_list<double> values);
+
+    [[nodiscard]] size_t size() const;
+
+    [[nodiscard]] bool empty() const;
+
+    double &operator[](size_t i);
+
+    const double &operator[](size_t i) const;
+
+    double *data();
+
+    [[nodiscard]] const double *data() const;
+
+    double *begin();
+
+    double *end();
+
+    [[nodiscard]] const double *begin() const;
+
+    [[nodiscard]] const double *end() const;
+
+    bool operator==(const Vector &another) const;
+
+    bool operator!=(const Vector &another) const;
+
+private:
+    MatrixStorage<double> m_storage;
+};
+
+// Level-2 and level-1 kernels. The work is split like make_intervals: contiguous row ranges
+// (columns for gemv_transposed), as many as the cost model finds worth it. Where threads write
+// neighbouring ranges of one output vector (gemv_transposed, axpy) the ranges are whole 64-byte
+// cache lines, so no line is written by two threads.
+//
+// Results do not depend on the thread count. Every dot product - the rows of gemv included - is
+// summed in the fixed order of SimdKernels::dot; dot and norm2 cut the vectors into blocks of
+// kReductionBlock elements regardless of the threads and add the block sums in order; and
+// gemv_transposed gives every thread whole output elements, accumulated over the rows in order.
+inline constexpr size_t kReductionBlock = 4096;
+
+// A * x; an empty vector if x.size() != A.getCols().
+[[nodiscard]] Vector gemv(const Matrix &a, const Vector &x, size_t num_of_threads = ThreadPool::instance().concurrency());
+
+// A^T * x without forming A^T; an empty vector if x.size() != A.getRows().
+[[nodiscard]] Vector gemv_transposed(const Matrix &a, const Vector &x,
+                                     size_t num_of_threads = ThreadPool::instance().concurrency());
+
+// y = A * x into y's buffer (resized if needed); y becomes empty on a shape mismatch.
+void gemv_into(const Matrix &a, const Vector &x, Vector &y, size_t num_of_threads = ThreadPool::instance().concurrency());
+
+// Throws std::invalid_argument if the sizes differ.
+[[nodiscard]] double dot(const Vector &x, const Vector &y, size_t num_of_threads = ThreadPool::instance().concurrency());
+
+[[nodiscard]] double norm2(const Vector &x, size_t num_of_threads = ThreadPool::instance().concurrency());
+
+// y += alpha * x; returns false and leaves y untouched if the sizes differ, like add_inplace.
+bool axpy(double alpha, const Vector &x, Vector &y, size_t num_of_threads = ThreadPool::instance().concurrency());